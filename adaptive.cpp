@@ -0,0 +1,129 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "adaptive.h"
+#include "stats.h"
+
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+
+// Share of the time spent blocked on writes (as a moving average) above
+// which output gets cheaper, and below which it gets richer again
+static const double StepDownPressure = 0.5;
+static const double StepUpPressure = 0.1;
+
+// Going back up is slower, so a link that's just keeping up doesn't flap
+static const qint64 StepDownDelay = 200 * 1000000LL;
+static const qint64 StepUpDelay = 2000 * 1000000LL;
+
+static QString level_name(EscCodeHighlighter::OutputLevel level)
+{
+    switch (level) {
+    case EscCodeHighlighter::FullOutput:
+        return QObject::tr("full output");
+    case EscCodeHighlighter::Reduced256:
+        return QObject::tr("256 colors");
+    case EscCodeHighlighter::Reduced16:
+        return QObject::tr("16 colors");
+    case EscCodeHighlighter::NoAttributes:
+        return QObject::tr("no italic, underline or strikethrough");
+    case EscCodeHighlighter::MergedSpans:
+        return QObject::tr("merged spans");
+    }
+    return QString();
+}
+
+AdaptiveOutput::AdaptiveOutput(int fd, const QVector<EscCodeHighlighter::OutputLevel> &levels)
+    : m_fd(fd), m_levels(levels), m_step(), m_lastWrite(), m_lastChange(), m_pressure()
+{
+    m_clock.start();
+    QIODevice::open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+}
+
+void AdaptiveOutput::changeStep(int step, const QString &reason)
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    m_changes.append(QObject::tr("  at %1 ms: %2 -> %3 (%4)")
+                     .arg(now / 1000000)
+                     .arg(level_name(m_levels.at(m_step)), level_name(m_levels.at(step)), reason));
+    RunStats::count(step > m_step ? "adaptive steps down" : "adaptive steps up", 1);
+    m_step = step;
+    m_lastChange = now;
+
+    // Start over, since the new level changes how much gets written
+    m_pressure = (StepDownPressure + StepUpPressure) / 2;
+}
+
+qint64 AdaptiveOutput::readData(char *data, qint64 maxSize)
+{
+    (void)data;
+    (void)maxSize;
+
+    qFatal("AdaptiveOutput does not support reading");
+    return -1;
+}
+
+qint64 AdaptiveOutput::writeData(const char *data, qint64 maxSize)
+{
+    const qint64 start = m_clock.nsecsElapsed();
+    qint64 written = 0;
+    int shortWrites = 0;
+    while (written < maxSize) {
+        const ssize_t bytes = ::write(m_fd, data + written, maxSize - written);
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("AdaptiveOutput::writeData");
+            return written ? written : -1;
+        }
+        written += bytes;
+        if (written < maxSize)
+            ++shortWrites;
+    }
+
+    // Blocked time as a share of the time since the last write finished,
+    // which includes producing this output
+    const qint64 end = m_clock.nsecsElapsed();
+    const qint64 blocked = end - start;
+    const qint64 interval = qMax<qint64>(1, end - m_lastWrite);
+    m_lastWrite = end;
+    m_pressure = (0.75 * m_pressure) + (0.25 * double(blocked) / double(interval));
+    RunStats::addTime("blocked on output", blocked);
+    RunStats::count("short writes", shortWrites);
+
+    const bool canStepDown = m_step + 1 < m_levels.size() && end - m_lastChange > StepDownDelay;
+    if (canStepDown && shortWrites > 0) {
+        changeStep(m_step + 1, QObject::tr("%n short write(s)", "", shortWrites));
+    } else if (canStepDown && m_pressure > StepDownPressure) {
+        changeStep(m_step + 1, QObject::tr("blocked %1% of the time")
+                               .arg(qRound(m_pressure * 100)));
+    } else if (m_step > 0 && end - m_lastChange > StepUpDelay && m_pressure < StepUpPressure) {
+        changeStep(m_step - 1, QObject::tr("blocked %1% of the time")
+                               .arg(qRound(m_pressure * 100)));
+    }
+    return written;
+}
+
+void AdaptiveOutput::printChanges() const
+{
+    if (m_changes.isEmpty())
+        return;
+    fputs(qPrintable(QObject::tr("Adaptive output level changes:\n")), stderr);
+    for (const QString &change : m_changes)
+        fputs(qPrintable(change + QLatin1Char('\n')), stderr);
+}
@@ -0,0 +1,63 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ADAPTIVE_H
+#define _ADAPTIVE_H
+
+#include "esc_highlight.h"
+
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QStringList>
+#include <QVector>
+
+/* Writes to a file descriptor (stdout) for --adaptive, keeping track of
+ * how much of the time writes spend blocked and how often they come up
+ * short.  When the terminal, or the link to it, can't keep up, the output
+ * level steps down to cheaper output; once writes stop blocking for a
+ * while it steps back up.  The highlighter picks up the current level at
+ * each line boundary. */
+class AdaptiveOutput : public QIODevice
+{
+public:
+    // levels goes from the full output to the cheapest
+    AdaptiveOutput(int fd, const QVector<EscCodeHighlighter::OutputLevel> &levels);
+
+    EscCodeHighlighter::OutputLevel level() const { return m_levels.at(m_step); }
+
+    // The level changes and why they happened, for --stats
+    void printChanges() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+    qint64 writeData(const char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+
+private:
+    int m_fd;
+    QVector<EscCodeHighlighter::OutputLevel> m_levels;
+    int m_step;
+
+    QElapsedTimer m_clock;
+    qint64 m_lastWrite;
+    qint64 m_lastChange;
+    double m_pressure;
+    QStringList m_changes;
+
+    void changeStep(int step, const QString &reason);
+};
+
+#endif // _ADAPTIVE_H
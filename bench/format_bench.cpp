@@ -0,0 +1,329 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esc_highlight.h"
+#include "esc_color.h"
+
+#include <KSyntaxHighlighting/AbstractHighlighter>
+#include <KSyntaxHighlighting/Definition>
+#include <KSyntaxHighlighting/Format>
+#include <KSyntaxHighlighting/Repository>
+#include <KSyntaxHighlighting/State>
+#include <KSyntaxHighlighting/Theme>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QIODevice>
+#include <QTextStream>
+
+#include <cstdio>
+
+/* Runs the given files through the syntax highlighter once, recording every
+ * applyFormat() call along with the line texts, and then replays that
+ * recording through EscCodeHighlighter::formatSpan() for each palette.  The
+ * time and output size per span only cover our own escape building and
+ * output, so changes to that code can be measured without the noise of
+ * KSyntaxHighlighting's matching.
+ *
+ * With --record, the recording is saved to a file instead, and --replay
+ * benchmarks a saved one, so a before and after comparison can use exactly
+ * the same spans even if the syntax definitions change in between.  Formats
+ * are saved by name, along with the definition that owns them. */
+
+namespace {
+
+// "SFB1", for srccat format benchmark
+static const quint32 RecordingMagic = 0x53464231;
+
+struct Recording
+{
+    struct Span
+    {
+        qint32 m_line;
+        qint32 m_offset;
+        qint32 m_length;
+        qint32 m_format;
+    };
+
+    QVector<QString> m_lines;
+    QVector<Span> m_spans;
+
+    // The owning definition and name of each format, which is enough to
+    // find it again in another run
+    QVector<QPair<QString, QString>> m_formatNames;
+    QVector<KSyntaxHighlighting::Format> m_formats;
+
+    bool save(const QString &filename) const;
+    bool load(const QString &filename, KSyntaxHighlighting::Repository *repository);
+};
+
+bool Recording::save(const QString &filename) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        fputs(qPrintable(QObject::tr("Could not open %1 for writing\n").arg(filename)), stderr);
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << RecordingMagic << m_formatNames << m_lines << qint32(m_spans.size());
+    for (const Span &span : m_spans)
+        out << span.m_line << span.m_offset << span.m_length << span.m_format;
+    return out.status() == QDataStream::Ok;
+}
+
+bool Recording::load(const QString &filename, KSyntaxHighlighting::Repository *repository)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fputs(qPrintable(QObject::tr("Could not open %1 for reading\n").arg(filename)), stderr);
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0;
+    qint32 spanCount = 0;
+    in >> magic;
+    if (magic != RecordingMagic) {
+        fputs(qPrintable(QObject::tr("%1 is not a format recording\n").arg(filename)), stderr);
+        return false;
+    }
+    in >> m_formatNames >> m_lines >> spanCount;
+    for (qint32 i = 0; i < spanCount && in.status() == QDataStream::Ok; ++i) {
+        Span span;
+        in >> span.m_line >> span.m_offset >> span.m_length >> span.m_format;
+        m_spans.append(span);
+    }
+    if (in.status() != QDataStream::Ok) {
+        fputs(qPrintable(QObject::tr("%1 is truncated\n").arg(filename)), stderr);
+        return false;
+    }
+
+    for (const auto &name : m_formatNames) {
+        const auto definition = repository->definitionForName(name.first);
+        KSyntaxHighlighting::Format found;
+        for (const auto &format : definition.formats()) {
+            if (format.name() == name.second)
+                found = format;
+        }
+        if (!found.isValid()) {
+            fputs(qPrintable(QObject::tr("Format %1 of %2 no longer exists\n")
+                             .arg(name.second, name.first)), stderr);
+            return false;
+        }
+        m_formats.append(found);
+    }
+    return true;
+}
+
+class FormatRecorder : public KSyntaxHighlighting::AbstractHighlighter
+{
+public:
+    explicit FormatRecorder(Recording *recording) : m_recording(recording) { }
+
+    void record(QTextStream &in)
+    {
+        indexFormats();
+        KSyntaxHighlighting::State state;
+        while (!in.atEnd()) {
+            m_recording->m_lines.append(in.readLine());
+            state = highlightLine(m_recording->m_lines.last(), state);
+        }
+    }
+
+protected:
+    void applyFormat(int offset, int length,
+                     const KSyntaxHighlighting::Format &format) Q_DECL_OVERRIDE
+    {
+        if (length > 0) {
+            const int line = m_recording->m_lines.size() - 1;
+            m_recording->m_spans.append(Recording::Span{line, offset, length, formatIndex(format)});
+        }
+    }
+
+private:
+    Recording *m_recording;
+
+    // Which definition each format id comes from, and where it is in the
+    // recording's format list once it's been used
+    QHash<quint16, QString> m_owners;
+    QHash<quint16, int> m_indices;
+
+    void indexFormats()
+    {
+        // Like SyntaxProfile, the outer definition claims its formats first
+        QVector<KSyntaxHighlighting::Definition> definitions{definition()};
+        for (const auto &included : definition().includedDefinitions())
+            definitions.append(included);
+        for (const auto &def : definitions) {
+            for (const auto &format : def.formats()) {
+                if (!m_owners.contains(format.id()))
+                    m_owners.insert(format.id(), def.name());
+            }
+        }
+    }
+
+    int formatIndex(const KSyntaxHighlighting::Format &format)
+    {
+        auto iter = m_indices.constFind(format.id());
+        if (iter != m_indices.constEnd())
+            return *iter;
+
+        const int index = m_recording->m_formats.size();
+        m_recording->m_formats.append(format);
+        m_recording->m_formatNames.append(qMakePair(m_owners.value(format.id()), format.name()));
+        m_indices.insert(format.id(), index);
+        return index;
+    }
+};
+
+// Discards everything written to it, only counting the bytes
+class NullDevice : public QIODevice
+{
+public:
+    NullDevice() : m_written() { open(QIODevice::WriteOnly); }
+
+    qint64 m_written;
+
+protected:
+    qint64 readData(char *, qint64) Q_DECL_OVERRIDE { return -1; }
+    qint64 writeData(const char *, qint64 len) Q_DECL_OVERRIDE
+    {
+        m_written += len;
+        return len;
+    }
+};
+
+struct ReplayResult
+{
+    double m_nsecsPerSpan;
+    double m_bytesPerSpan;
+};
+
+ReplayResult replay(const Recording &recording, const KSyntaxHighlighting::Theme &theme,
+                    const EscPalette *palette, bool stream)
+{
+    NullDevice sink;
+    QTextStream output(&sink);
+    QString rendered;
+    qint64 chars = 0;
+    qint64 spans = 0;
+
+    // Repeat the whole recording until the timing is stable enough
+    QElapsedTimer timer;
+    timer.start();
+    do {
+        int spanIndex = 0;
+        for (int line = 0; line < recording.m_lines.size(); ++line) {
+            const QString &text = recording.m_lines.at(line);
+            rendered.clear();
+            for ( ; spanIndex < recording.m_spans.size()
+                    && recording.m_spans.at(spanIndex).m_line == line; ++spanIndex) {
+                const auto &span = recording.m_spans.at(spanIndex);
+                EscCodeHighlighter::formatSpan(rendered, text, span.m_offset, span.m_length,
+                                               recording.m_formats.at(span.m_format),
+                                               theme, palette);
+            }
+            if (stream)
+                output << rendered << "\n";
+            else
+                chars += rendered.size() + 1;
+        }
+        spans += recording.m_spans.size();
+    } while (timer.elapsed() < 250);
+    output.flush();
+
+    const qint64 nsecs = timer.nsecsElapsed();
+    const qint64 bytes = stream ? sink.m_written : chars * qint64(sizeof(QChar));
+    ReplayResult result;
+    result.m_nsecsPerSpan = spans ? double(nsecs) / double(spans) : 0.0;
+    result.m_bytesPerSpan = spans ? double(bytes) / double(spans) : 0.0;
+    return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("files"), QObject::tr("Files to record"));
+    QCommandLineOption optTheme(QStringList{"T", "theme"},
+            QObject::tr("Theme to format with"), QObject::tr("theme"));
+    QCommandLineOption optRecord("record",
+            QObject::tr("Save the recording of the files to a file instead of\n"
+                        "replaying it"), QObject::tr("file"));
+    QCommandLineOption optReplay("replay",
+            QObject::tr("Replay a recording saved with --record"), QObject::tr("file"));
+    parser.addOption(optTheme);
+    parser.addOption(optRecord);
+    parser.addOption(optReplay);
+    parser.process(app);
+
+    KSyntaxHighlighting::Repository repository;
+    Recording recording;
+    if (parser.isSet(optReplay)) {
+        if (!recording.load(parser.value(optReplay), &repository))
+            return 1;
+    } else {
+        FormatRecorder recorder(&recording);
+        for (const QString &filename : parser.positionalArguments()) {
+            QFile file(filename);
+            if (!file.open(QIODevice::ReadOnly)) {
+                fputs(qPrintable(QObject::tr("Could not open %1 for reading\n").arg(filename)),
+                      stderr);
+                continue;
+            }
+            recorder.setDefinition(repository.definitionForFileName(filename));
+            QTextStream stream(&file);
+            recorder.record(stream);
+        }
+        if (parser.isSet(optRecord))
+            return recording.save(parser.value(optRecord)) ? 0 : 1;
+    }
+    if (recording.m_lines.isEmpty()) {
+        fputs(qPrintable(QObject::tr("Nothing to replay\n")), stderr);
+        return 1;
+    }
+
+    const KSyntaxHighlighting::Theme theme = parser.isSet(optTheme)
+            ? repository.theme(parser.value(optTheme))
+            : repository.defaultTheme(KSyntaxHighlighting::Repository::DarkTheme);
+
+    puts(qPrintable(QObject::tr("Formatter replay of %1 lines, %2 spans (theme %3):")
+                    .arg(recording.m_lines.size()).arg(recording.m_spans.size())
+                    .arg(theme.name())));
+    printf("  %-6s %14s %14s %14s %14s\n", "colors", "build ns/span", "build B/span",
+           "stream ns/span", "stream B/span");
+    for (const EscPalette *palette : EscPalette::builtins()) {
+        // Building the escapes into a QString, and then also encoding and
+        // writing them through a QTextStream the way real output is
+        const ReplayResult build = replay(recording, theme, palette, false);
+        const ReplayResult stream = replay(recording, theme, palette, true);
+        printf("  %-6s %14.1f %14.1f %14.1f %14.1f\n", palette->name(),
+               build.m_nsecsPerSpan, build.m_bytesPerSpan,
+               stream.m_nsecsPerSpan, stream.m_bytesPerSpan);
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esc_color.h"
+#include "theme_colors.h"
+
+#include <KSyntaxHighlighting/Repository>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <cstdio>
+
+/* Measures how fast each indexed palette finds the closest entry, for
+ * every color used by the installed themes and for a grid over the RGB
+ * cube.  The mappings themselves are checked by tests/palette_test. */
+
+static QVector<QColor> grid_colors()
+{
+    // 52 steps per channel hits 0 and 255 exactly, along with every level
+    // of the xterm color cube
+    QVector<QColor> colors;
+    colors.reserve(52 * 52 * 52);
+    for (int r = 0; r <= 255; r += 5) {
+        for (int g = 0; g <= 255; g += 5) {
+            for (int b = 0; b <= 255; b += 5)
+                colors.append(QColor(r, g, b));
+        }
+    }
+    return colors;
+}
+
+static double lookup_rate(const EscPalette *palette, const QVector<QColor> &colors)
+{
+    QElapsedTimer timer;
+    qint64 lookups = 0;
+    int checksum = 0;
+    timer.start();
+    do {
+        for (const auto &color : colors) {
+            checksum += palette->foreground(color).size();
+            ++lookups;
+        }
+    } while (timer.elapsed() < 250);
+
+    const qint64 nsecs = timer.nsecsElapsed();
+    (void)checksum;
+    return nsecs ? double(lookups) * 1.0e9 / double(nsecs) : 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    KSyntaxHighlighting::Repository repository;
+    const QVector<QColor> themeColors = theme_colors(repository.themes());
+    const QVector<QColor> grid = grid_colors();
+
+    printf("%-6s %16s %16s\n", "colors", "theme lookups/s", "grid lookups/s");
+    for (const EscPalette *palette : EscPalette::builtins()) {
+        if (palette->isTrueColor())
+            continue;
+        printf("%-6s %16.0f %16.0f\n", palette->name(),
+               themeColors.isEmpty() ? 0.0 : lookup_rate(palette, themeColors),
+               lookup_rate(palette, grid));
+    }
+    return 0;
+}
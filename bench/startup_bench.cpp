@@ -0,0 +1,211 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QStringList>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Measures how long srccat takes to write its first byte and to finish on a
+ * tiny input, with a few of the options that change what gets loaded at
+ * startup.  Each run's --stats supply the breakdown by startup phase. */
+
+struct RunResult
+{
+    qint64 m_firstByte;
+    qint64 m_total;
+    QMap<QString, double> m_phases;
+};
+
+struct Config
+{
+    const char *m_name;
+    QStringList m_args;
+};
+
+static bool run_once(const QString &srccat, const QStringList &args, RunResult *result)
+{
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert(QStringLiteral("SRCCAT_PAGER"), QStringLiteral("cat"));
+
+    QProcess process;
+    process.setProcessEnvironment(env);
+    process.setReadChannel(QProcess::StandardOutput);
+
+    QElapsedTimer timer;
+    timer.start();
+    process.start(srccat, QStringList{QStringLiteral("--stats")} + args);
+    if (!process.waitForStarted())
+        return false;
+
+    result->m_firstByte = -1;
+    while (process.waitForReadyRead(-1)) {
+        if (result->m_firstByte < 0)
+            result->m_firstByte = timer.nsecsElapsed();
+        process.readAllStandardOutput();
+    }
+    process.waitForFinished(-1);
+    result->m_total = timer.nsecsElapsed();
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+        return false;
+
+    // Times from --stats look like "load translations     0.123 ms"
+    static const QRegularExpression timeLine(QStringLiteral("^(.*\\S)\\s+([0-9.]+) ms$"),
+                                             QRegularExpression::MultilineOption);
+    auto match = timeLine.globalMatch(QString::fromLocal8Bit(process.readAllStandardError()));
+    while (match.hasNext()) {
+        const auto time = match.next();
+        result->m_phases[time.captured(1)] = time.captured(2).toDouble();
+    }
+    return true;
+}
+
+#ifdef Q_OS_LINUX
+// The shared libraries srccat loads, which are most of what a cold start reads
+static QStringList linked_libraries(const QString &srccat)
+{
+    QProcess ldd;
+    ldd.start(QStringLiteral("ldd"), QStringList{srccat});
+    ldd.waitForFinished(-1);
+
+    QStringList libraries;
+    static const QRegularExpression libraryPath(QStringLiteral("=> (/\\S+)"));
+    auto match = libraryPath.globalMatch(QString::fromLocal8Bit(ldd.readAllStandardOutput()));
+    while (match.hasNext())
+        libraries.append(match.next().captured(1));
+    return libraries;
+}
+#endif
+
+/* Dropping the whole page cache needs root.  Otherwise the files srccat
+ * reads at startup are evicted one by one, which is close enough as long
+ * as nothing else has them mapped. */
+static bool drop_page_cache(const QStringList &files)
+{
+#ifdef Q_OS_LINUX
+    ::sync();
+    QFile drop(QStringLiteral("/proc/sys/vm/drop_caches"));
+    if (drop.open(QIODevice::WriteOnly) && drop.write("1\n") == 2)
+        return true;
+
+    for (const QString &file : files) {
+        const int fd = ::open(QFile::encodeName(file).constData(), O_RDONLY);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+    }
+    return true;
+#else
+    (void)files;
+    return false;
+#endif
+}
+
+static double median_msecs(std::vector<qint64> nsecs)
+{
+    if (nsecs.empty())
+        return 0.0;
+    std::sort(nsecs.begin(), nsecs.end());
+    return nsecs[nsecs.size() / 2] / 1.0e6;
+}
+
+static bool report(const QString &srccat, const Config &config, const char *cache,
+                   int runs, const QStringList &coldFiles)
+{
+    std::vector<qint64> firstBytes, totals;
+    QMap<QString, double> phases;
+    for (int run = 0; run < runs; ++run) {
+        if (!coldFiles.isEmpty())
+            drop_page_cache(coldFiles);
+        RunResult result;
+        if (!run_once(srccat, config.m_args, &result)) {
+            fprintf(stderr, "%s: srccat failed with %s\n", config.m_name,
+                    qPrintable(config.m_args.join(QLatin1Char(' '))));
+            return false;
+        }
+        if (result.m_firstByte >= 0)
+            firstBytes.push_back(result.m_firstByte);
+        totals.push_back(result.m_total);
+        for (auto it = result.m_phases.constBegin(); it != result.m_phases.constEnd(); ++it)
+            phases[it.key()] += it.value() / runs;
+    }
+
+    printf("%-10s %-5s  first byte %8.2f ms  total %8.2f ms  (median of %d)\n",
+           config.m_name, cache, median_msecs(firstBytes), median_msecs(totals), runs);
+    for (auto it = phases.constBegin(); it != phases.constEnd(); ++it)
+        printf("    %-28s %8.3f ms\n", qPrintable(it.key()), it.value());
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    args.removeFirst();
+
+    int runs = 10;
+    if (args.size() >= 2 && args.first() == QLatin1String("--runs")) {
+        runs = qMax(1, args.at(1).toInt());
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    if (args.size() != 2) {
+        fputs("Usage: startup_bench [--runs N] <srccat> <input>\n", stderr);
+        return 1;
+    }
+    const QString srccat = args.at(0);
+    const QString input = args.at(1);
+
+    const Config configs[] = {
+        {"default", {input}},
+        {"--theme", {QStringLiteral("--theme"), QStringLiteral("Breeze Dark"), input}},
+        {"-S", {QStringLiteral("-S"), QStringLiteral("C++"), input}},
+        {"-p", {QStringLiteral("-p"), input}},
+    };
+
+    QStringList coldFiles{srccat, input};
+#ifdef Q_OS_LINUX
+    coldFiles += linked_libraries(srccat);
+#endif
+    const bool canCool = drop_page_cache(coldFiles);
+    if (!canCool)
+        fputs("Can't drop the page cache here, so only warm runs are measured\n", stderr);
+
+    for (const Config &config : configs) {
+        if (canCool && !report(srccat, config, "cold", runs, coldFiles))
+            return 1;
+
+        // One run first, so everything is in the page cache
+        RunResult warmup;
+        run_once(srccat, config.m_args, &warmup);
+        if (!report(srccat, config, "warm", runs, QStringList()))
+            return 1;
+    }
+    return 0;
+}
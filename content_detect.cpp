@@ -0,0 +1,280 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "content_detect.h"
+
+#include <KSyntaxHighlighting/Repository>
+#include <QList>
+
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+struct DefinitionAlias
+{
+    const char *m_key;
+    const char *m_definition;
+};
+
+// Interpreter and modeline names that don't match a definition name directly
+const DefinitionAlias s_aliases[] = {
+    {"sh",            "Bash"},
+    {"ash",           "Bash"},
+    {"dash",          "Bash"},
+    {"ksh",           "Bash"},
+    {"mksh",          "Bash"},
+    {"shell-script",  "Bash"},
+    {"zsh",           "Zsh"},
+    {"fish",          "Fish"},
+    {"python",        "Python"},
+    {"pypy",          "Python"},
+    {"perl",          "Perl"},
+    {"cperl",         "Perl"},
+    {"ruby",          "Ruby"},
+    {"node",          "JavaScript"},
+    {"nodejs",        "JavaScript"},
+    {"deno",          "JavaScript"},
+    {"js",            "JavaScript"},
+    {"ts",            "TypeScript"},
+    {"php",           "PHP/PHP"},
+    {"lua",           "Lua"},
+    {"luajit",        "Lua"},
+    {"tclsh",         "Tcl/Tk"},
+    {"wish",          "Tcl/Tk"},
+    {"awk",           "AWK"},
+    {"gawk",          "AWK"},
+    {"mawk",          "AWK"},
+    {"nawk",          "AWK"},
+    {"make",          "Makefile"},
+    {"gmake",         "Makefile"},
+    {"rscript",       "R Script"},
+    {"guile",         "Scheme"},
+    {"runghc",        "Haskell"},
+    {"runhaskell",    "Haskell"},
+    {"escript",       "Erlang"},
+    {"pwsh",          "PowerShell"},
+    {"c++",           "C++"},
+    {"cpp",           "C++"},
+    {"xml",           "XML"},
+    {"html",          "HTML"},
+    {"json",          "JSON"},
+    {"yaml",          "YAML"},
+    {"diff",          "Diff"},
+    {"markdown",      "Markdown"},
+    {"rst",           "reStructuredText"},
+    {"tex",           "LaTeX"},
+    {"latex",         "LaTeX"},
+};
+
+QByteArray base_name(const QByteArray &path)
+{
+    return path.mid(path.lastIndexOf('/') + 1);
+}
+
+QByteArray shebang_interpreter(const QByteArray &line)
+{
+    const QList<QByteArray> args = line.mid(2).simplified().split(' ');
+    if (args.isEmpty() || args.first().isEmpty())
+        return QByteArray();
+
+    QByteArray interpreter = base_name(args.first());
+    if (interpreter == "env") {
+        // Skip env's options and variable assignments
+        interpreter.clear();
+        for (int i = 1; i < args.size(); ++i) {
+            if (args.at(i).startsWith('-') || args.at(i).contains('='))
+                continue;
+            interpreter = base_name(args.at(i));
+            break;
+        }
+    }
+    return interpreter.toLower();
+}
+
+QByteArray emacs_mode(const QByteArray &line)
+{
+    // -*- mode: c++; indent-tabs-mode: nil -*-  or just  -*- c++ -*-
+    const int start = line.indexOf("-*-");
+    if (start < 0)
+        return QByteArray();
+    const int end = line.indexOf("-*-", start + 3);
+    if (end < 0)
+        return QByteArray();
+
+    const QByteArray vars = line.mid(start + 3, end - start - 3);
+    if (!vars.contains(':'))
+        return vars.trimmed().toLower();
+
+    for (const QByteArray &var : vars.split(';')) {
+        const int colon = var.indexOf(':');
+        if (colon > 0 && var.left(colon).trimmed().toLower() == "mode")
+            return var.mid(colon + 1).trimmed().toLower();
+    }
+    return QByteArray();
+}
+
+QByteArray vim_filetype(const QByteArray &line)
+{
+    // vim: set ft=python :  or  vim: filetype=python
+    int start = -1;
+    for (const char *marker : {"vim:", "vi:", "ex:"}) {
+        const int pos = line.indexOf(marker);
+        if (pos >= 0 && (pos == 0 || line.at(pos - 1) == ' ' || line.at(pos - 1) == '\t')) {
+            start = pos;
+            break;
+        }
+    }
+    if (start < 0)
+        return QByteArray();
+
+    for (const char *option : {"filetype=", "ft=", "syntax=", "syn="}) {
+        int pos = line.indexOf(option, start);
+        if (pos < 0)
+            continue;
+        pos += static_cast<int>(strlen(option));
+        int end = pos;
+        while (end < line.size() && line.at(end) != ' ' && line.at(end) != ':'
+               && line.at(end) != '\t')
+            ++end;
+        return line.mid(pos, end - pos).toLower();
+    }
+    return QByteArray();
+}
+
+char first_non_space(const QByteArray &data, int from)
+{
+    for (int i = from; i < data.size(); ++i) {
+        const char ch = data.at(i);
+        if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n')
+            return ch;
+    }
+    return 0;
+}
+
+}
+
+ContentDetector::ContentDetector(KSyntaxHighlighting::Repository *repo)
+    : m_repo(repo)
+{
+}
+
+KSyntaxHighlighting::Definition ContentDetector::lookup(const QByteArray &key)
+{
+    if (key.isEmpty())
+        return KSyntaxHighlighting::Definition();
+
+    auto iter = m_definitions.constFind(key);
+    if (iter != m_definitions.constEnd())
+        return iter.value();
+
+    // Versioned interpreters (python3.11) share the unversioned definition
+    QByteArray baseKey = key;
+    while (baseKey.size() > 1 && (isdigit(static_cast<unsigned char>(baseKey.at(baseKey.size() - 1)))
+                                  || baseKey.at(baseKey.size() - 1) == '.'))
+        baseKey.chop(1);
+
+    KSyntaxHighlighting::Definition definition;
+    for (const auto &alias : s_aliases) {
+        if (baseKey == alias.m_key) {
+            definition = m_repo->definitionForName(QString::fromLatin1(alias.m_definition));
+            break;
+        }
+    }
+    if (!definition.isValid()) {
+        // Try it as a definition name, and then as a file extension
+        const QString name = QString::fromUtf8(baseKey);
+        for (const auto &def : m_repo->definitions()) {
+            if (QString::compare(def.name(), name, Qt::CaseInsensitive) == 0) {
+                definition = def;
+                break;
+            }
+        }
+        if (!definition.isValid())
+            definition = m_repo->definitionForFileName(QStringLiteral("file.") + name);
+    }
+
+    m_definitions.insert(key, definition);
+    return definition;
+}
+
+KSyntaxHighlighting::Definition ContentDetector::detect(const QByteArray &data)
+{
+    QByteArray prefix = data.left(PrefixSize);
+    if (prefix.startsWith("\xEF\xBB\xBF"))
+        prefix.remove(0, 3);
+    if (prefix.isEmpty())
+        return KSyntaxHighlighting::Definition();
+
+    QList<QByteArray> lines = prefix.split('\n');
+    if (lines.size() > 1) {
+        // The last line may have been cut off by the prefix limit
+        lines.removeLast();
+    }
+    for (auto &line : lines) {
+        if (line.endsWith('\r'))
+            line.chop(1);
+    }
+    const QByteArray &firstLine = lines.first();
+
+    if (firstLine.startsWith("#!")) {
+        const auto definition = lookup(shebang_interpreter(firstLine));
+        if (definition.isValid())
+            return definition;
+    }
+
+    // Modelines are only honored near the top, since we only have a prefix
+    for (int i = 0; i < lines.size() && i < 5; ++i) {
+        QByteArray mode = emacs_mode(lines.at(i));
+        if (mode.isEmpty())
+            mode = vim_filetype(lines.at(i));
+        if (!mode.isEmpty()) {
+            const auto definition = lookup(mode);
+            if (definition.isValid())
+                return definition;
+        }
+    }
+
+    if (firstLine.startsWith("<?xml"))
+        return lookup("xml");
+    const QByteArray lowerFirst = firstLine.trimmed().toLower();
+    if (lowerFirst.startsWith("<!doctype html") || lowerFirst.startsWith("<html"))
+        return lookup("html");
+    if (firstLine.startsWith("diff --git ") || firstLine.startsWith("diff -")
+            || firstLine.startsWith("Index: ")
+            || (firstLine.startsWith("--- ") && lines.size() > 1
+                && lines.at(1).startsWith("+++ ")))
+        return lookup("diff");
+    if (firstLine.startsWith("%YAML") || firstLine == "---")
+        return lookup("yaml");
+
+    // JSON: an object or array opener followed by something only JSON would
+    // have there (so an INI "[section]" header doesn't count)
+    int start = 0;
+    while (start < prefix.size() && isspace(static_cast<unsigned char>(prefix.at(start))))
+        ++start;
+    const char opener = (start < prefix.size()) ? prefix.at(start) : 0;
+    if (opener == '{' || opener == '[') {
+        const char next = first_non_space(prefix, start + 1);
+        if (next == '"' || (opener == '{' && next == '}')
+                || (opener == '[' && (next == '{' || next == '[' || next == ']'
+                                      || next == '-' || isdigit(static_cast<unsigned char>(next)))))
+            return lookup("json");
+    }
+
+    return KSyntaxHighlighting::Definition();
+}
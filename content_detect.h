@@ -0,0 +1,51 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CONTENT_DETECT_H
+#define _CONTENT_DETECT_H
+
+#include <KSyntaxHighlighting/Definition>
+#include <QByteArray>
+#include <QHash>
+
+namespace KSyntaxHighlighting {
+class Repository;
+}
+
+/* Cheap language detection from the first few lines of a file, for input
+ * that can't be identified by name (stdin, extensionless scripts).  This
+ * only looks for explicit markers: #! lines, Emacs and Vim modelines, and
+ * the distinctive openers of XML, HTML, JSON, YAML and diffs.  Lookups are
+ * cached, so repeated markers across files cost a single hash lookup. */
+class ContentDetector
+{
+public:
+    // The most input detect() will look at
+    enum { PrefixSize = 1024 };
+
+    explicit ContentDetector(KSyntaxHighlighting::Repository *repo);
+
+    KSyntaxHighlighting::Definition detect(const QByteArray &prefix);
+
+private:
+    KSyntaxHighlighting::Repository *m_repo;
+    QHash<QByteArray, KSyntaxHighlighting::Definition> m_definitions;
+
+    KSyntaxHighlighting::Definition lookup(const QByteArray &key);
+};
+
+#endif // _CONTENT_DETECT_H
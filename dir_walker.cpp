@@ -0,0 +1,294 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dir_walker.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+
+#include <algorithm>
+#include <memory>
+
+/* Translate a gitignore(5) style glob into a regular expression.  A single
+ * '*' or '?' never crosses a directory separator, while "**" does. */
+static QString glob_to_regex(const QString &glob)
+{
+    QString regex;
+    for (int i = 0; i < glob.size(); ++i) {
+        const QChar ch = glob.at(i);
+        if (ch == QLatin1Char('*')) {
+            if (i + 1 < glob.size() && glob.at(i + 1) == QLatin1Char('*')) {
+                ++i;
+                if (i + 1 < glob.size() && glob.at(i + 1) == QLatin1Char('/')) {
+                    // "**/" matches zero or more leading directories
+                    ++i;
+                    regex += QLatin1String("(?:.*/)?");
+                } else {
+                    regex += QLatin1String(".*");
+                }
+            } else {
+                regex += QLatin1String("[^/]*");
+            }
+        } else if (ch == QLatin1Char('?')) {
+            regex += QLatin1String("[^/]");
+        } else if (ch == QLatin1Char('[')) {
+            int end = i + 1;
+            if (end < glob.size() && glob.at(end) == QLatin1Char('!'))
+                ++end;
+            if (end < glob.size() && glob.at(end) == QLatin1Char(']'))
+                ++end;
+            end = glob.indexOf(QLatin1Char(']'), end);
+            if (end < 0) {
+                regex += QLatin1String("\\[");
+                continue;
+            }
+            QString charClass = glob.mid(i + 1, end - i - 1);
+            if (charClass.startsWith(QLatin1Char('!')))
+                charClass[0] = QLatin1Char('^');
+            charClass.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+            regex += QLatin1Char('[') + charClass + QLatin1Char(']');
+            i = end;
+        } else if (ch == QLatin1Char('\\') && i + 1 < glob.size()) {
+            regex += QRegularExpression::escape(QString(glob.at(++i)));
+        } else {
+            regex += QRegularExpression::escape(QString(ch));
+        }
+    }
+    return regex;
+}
+
+struct IgnorePattern
+{
+    QRegularExpression m_regex;
+    bool m_negate;
+    bool m_dirOnly;
+    bool m_anchored;
+};
+
+class IgnoreRules
+{
+public:
+    IgnoreRules(const QString &baseDir, std::shared_ptr<const IgnoreRules> parent)
+        : m_baseDir(baseDir), m_parent(std::move(parent)) { }
+
+    void load(const QString &filename);
+    bool isEmpty() const { return m_patterns.isEmpty(); }
+
+    static bool isIgnored(const IgnoreRules *rules, const QString &path, bool isDir);
+
+private:
+    QString m_baseDir;
+    QVector<IgnorePattern> m_patterns;
+    std::shared_ptr<const IgnoreRules> m_parent;
+
+    // Returns 1 if ignored, -1 if explicitly re-included, or 0 if no
+    // pattern in this file applies
+    int match(const QString &path, bool isDir) const;
+};
+
+void IgnoreRules::load(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    while (!file.atEnd()) {
+        QString line = QString::fromUtf8(file.readLine());
+        while (line.endsWith(QLatin1Char('\n')) || line.endsWith(QLatin1Char('\r')))
+            line.chop(1);
+        while (line.endsWith(QLatin1Char(' ')) && !line.endsWith(QLatin1String("\\ ")))
+            line.chop(1);
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+
+        IgnorePattern pattern;
+        pattern.m_negate = line.startsWith(QLatin1Char('!'));
+        if (pattern.m_negate)
+            line.remove(0, 1);
+        pattern.m_dirOnly = line.endsWith(QLatin1Char('/'));
+        if (pattern.m_dirOnly)
+            line.chop(1);
+
+        // Patterns with a slash anywhere but the end are relative to the
+        // directory containing the ignore file; others match the basename
+        // at any depth.
+        pattern.m_anchored = line.contains(QLatin1Char('/'));
+        if (line.startsWith(QLatin1Char('/')))
+            line.remove(0, 1);
+        if (line.isEmpty())
+            continue;
+
+        pattern.m_regex.setPattern(QLatin1String("\\A(?:") + glob_to_regex(line)
+                                   + QLatin1String(")\\z"));
+        if (!pattern.m_regex.isValid())
+            continue;
+        pattern.m_regex.optimize();
+        m_patterns.append(pattern);
+    }
+}
+
+int IgnoreRules::match(const QString &path, bool isDir) const
+{
+    if (!path.startsWith(m_baseDir))
+        return 0;
+
+    const QString relative = path.mid(m_baseDir.size());
+    const QString name = relative.mid(relative.lastIndexOf(QLatin1Char('/')) + 1);
+
+    // The last matching pattern in the file wins
+    for (int i = m_patterns.size() - 1; i >= 0; --i) {
+        const IgnorePattern &pattern = m_patterns.at(i);
+        if (pattern.m_dirOnly && !isDir)
+            continue;
+        if (pattern.m_regex.match(pattern.m_anchored ? relative : name).hasMatch())
+            return pattern.m_negate ? -1 : 1;
+    }
+    return 0;
+}
+
+bool IgnoreRules::isIgnored(const IgnoreRules *rules, const QString &path, bool isDir)
+{
+    // Ignore files in deeper directories take precedence over their parents
+    for ( ; rules; rules = rules->m_parent.get()) {
+        const int result = rules->match(path, isDir);
+        if (result != 0)
+            return result > 0;
+    }
+    return false;
+}
+
+static bool looks_binary(const QString &filename)
+{
+    // Same heuristic as git and grep: a NUL in the first block means binary
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    return file.read(8192).contains('\0');
+}
+
+struct WalkContext
+{
+    explicit WalkContext(qint64 maxFileSize) : m_maxFileSize(maxFileSize) { }
+
+    qint64 m_maxFileSize;
+    QThreadPool m_pool;
+    QMutex m_mutex;
+    QStringList m_files;
+};
+
+class WalkTask : public QRunnable
+{
+public:
+    WalkTask(WalkContext *context, const QString &dir,
+             std::shared_ptr<const IgnoreRules> rules)
+        : m_context(context), m_dir(dir), m_rules(std::move(rules)) { }
+
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    WalkContext *m_context;
+    QString m_dir;
+    std::shared_ptr<const IgnoreRules> m_rules;
+};
+
+void WalkTask::run()
+{
+    TraceSpan span("scan directory", "io", m_dir);
+
+    QString prefix = m_dir;
+    if (!prefix.endsWith(QLatin1Char('/')))
+        prefix += QLatin1Char('/');
+
+    auto localRules = std::make_shared<IgnoreRules>(prefix, m_rules);
+    localRules->load(prefix + QLatin1String(".gitignore"));
+    localRules->load(prefix + QLatin1String(".ignore"));
+    std::shared_ptr<const IgnoreRules> rules = m_rules;
+    if (!localRules->isEmpty())
+        rules = localRules;
+
+    const QFileInfoList entries = QDir(m_dir).entryInfoList(
+            QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+            QDir::NoSort);
+
+    QStringList files;
+    for (const QFileInfo &info : entries) {
+        const QString name = info.fileName();
+        const QString path = prefix + name;
+        if (info.isDir()) {
+            // Don't follow directory links, to avoid walking in circles
+            if (info.isSymLink() || name == QLatin1String(".git"))
+                continue;
+            if (IgnoreRules::isIgnored(rules.get(), path, true))
+                continue;
+            m_context->m_pool.start(new WalkTask(m_context, path, rules));
+        } else if (info.isFile()) {
+            if (IgnoreRules::isIgnored(rules.get(), path, false))
+                continue;
+            if (info.size() > m_context->m_maxFileSize || looks_binary(path))
+                continue;
+            files.append(path);
+        }
+    }
+
+    QMutexLocker lock(&m_context->m_mutex);
+    m_context->m_files += files;
+}
+
+static bool path_less(const QString &left, const QString &right)
+{
+    // Order '/' before everything else, so a directory's contents are
+    // listed together ahead of siblings that merely share its prefix
+    const int length = std::min(left.size(), right.size());
+    for (int i = 0; i < length; ++i) {
+        const QChar lch = left.at(i);
+        const QChar rch = right.at(i);
+        if (lch == rch)
+            continue;
+        if (lch == QLatin1Char('/'))
+            return true;
+        if (rch == QLatin1Char('/'))
+            return false;
+        return lch < rch;
+    }
+    return left.size() < right.size();
+}
+
+QStringList DirWalker::walk(const QStringList &paths) const
+{
+    QStringList result;
+    for (const QString &path : paths) {
+        if (path == "-" || !QFileInfo(path).isDir()) {
+            result.append(path);
+            continue;
+        }
+
+        WalkContext context(m_maxFileSize);
+        context.m_pool.start(new WalkTask(&context, QDir::cleanPath(path), Q_NULLPTR));
+        context.m_pool.waitForDone();
+
+        std::sort(context.m_files.begin(), context.m_files.end(), path_less);
+        result += context.m_files;
+    }
+    return result;
+}
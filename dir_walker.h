@@ -0,0 +1,42 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DIR_WALKER_H
+#define _DIR_WALKER_H
+
+#include <QStringList>
+
+/* Expands directories into the (sorted) list of source files below them,
+ * scanning subdirectories in parallel.  Paths matched by .gitignore or
+ * .ignore files are skipped, as are files that look binary or are larger
+ * than the configured maximum size.  Non-directory arguments are passed
+ * through unchanged. */
+class DirWalker
+{
+public:
+    DirWalker() : m_maxFileSize(1024 * 1024) { }
+
+    void setMaxFileSize(qint64 size) { m_maxFileSize = size; }
+    qint64 maxFileSize() const { return m_maxFileSize; }
+
+    QStringList walk(const QStringList &paths) const;
+
+private:
+    qint64 m_maxFileSize;
+};
+
+#endif // _DIR_WALKER_H
@@ -16,35 +16,271 @@
  */
 
 #include "esc_color.h"
+#include "esc_color_reference.h"
+#include "probes.h"
 
 #include <array>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
 
-const EscPalette *EscPalette::Palette8()
+/* The palettes are built entirely at compile time, including each entry's
+ * position in the lookup space, so they need no setup at runtime and can be
+ * shared freely between threads.  This needs a few constexpr versions of
+ * standard math functions, which are accurate enough for color matching. */
+
+static constexpr double const_pi = 3.14159265358979323846;
+
+static constexpr double const_round(double value)
+{
+    // Same as qRound() for the non-negative values used here
+    return double(static_cast<long long>(value + 0.5));
+}
+
+static constexpr double const_sin(double x)
+{
+    // Taylor series, with x reduced to [-pi/2, pi/2] so it converges fast
+    // and stays accurate near the zeros at +/-pi
+    while (x > const_pi)
+        x -= 2.0 * const_pi;
+    while (x < -const_pi)
+        x += 2.0 * const_pi;
+    if (x > const_pi / 2.0)
+        x = const_pi - x;
+    else if (x < -const_pi / 2.0)
+        x = -const_pi - x;
+
+    double term = x;
+    double sum = term;
+    for (int n = 2; n < 26; n += 2) {
+        term *= -x * x / (n * (n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+static constexpr double const_cos(double x)
+{
+    return const_sin((const_pi / 2.0) - x);
+}
+
+/* HSL values as QColor::getHslF() gives them, including rounding to its
+ * 16-bit storage, so results match what the lookups used when they were
+ * done through QColor.  The hue of grays is 0 rather than Qt's -1; see
+ * hsl_point(). */
+struct HslValues
+{
+    float m_hue, m_saturation, m_lightness;
+};
+
+static constexpr HslValues hsl_values(int red, int green, int blue)
+{
+    // QColor keeps 16-bit channels, and the order of operations matters
+    // for values that land exactly between two steps of its storage.
+    const double r = (red * 257) / 65535.0;
+    const double g = (green * 257) / 65535.0;
+    const double b = (blue * 257) / 65535.0;
+    const double max = (r > g) ? (r > b ? r : b) : (g > b ? g : b);
+    const double min = (r < g) ? (r < b ? r : b) : (g < b ? g : b);
+    const double delta = max - min;
+    const double delta2 = max + min;
+    const double lightness = 0.5 * delta2;
+    const double l = const_round(lightness * 65535.0) / 65535.0;
+
+    double h = 0.0, s = 0.0;
+    if (delta > 0.0) {
+        if (lightness < 0.5)
+            s = delta / delta2;
+        else
+            s = delta / (2.0 - delta2);
+        s = const_round(s * 65535.0) / 65535.0;
+
+        if (r == max)
+            h = (g - b) / delta;
+        else if (g == max)
+            h = 2.0 + (b - r) / delta;
+        else
+            h = 4.0 + (r - g) / delta;
+        h *= 60.0;
+        if (h < 0.0)
+            h += 360.0;
+        h = const_round(h * 100.0) / 36000.0;
+    }
+
+    // The rest is done in single precision, like the QColor based lookups
+    // were, so near-ties between palette entries resolve the same way.
+    return { float(h), float(s), float(l) };
+}
+
+/* Position in (cylindrical) HSL space.  HSL space seems to give "good
+ * enough" results with minimal performance impact.  However, rgb_space(),
+ * xyz_space() and lab_space() below are still available in case someone
+ * wants to experiment with lookups in other color spaces.
+ *
+ * Qt reports a hue of -1 for anything along the grayscale spectrum, and
+ * [0,1) for non-gray values... In order to make grayish colors less likely
+ * to show up as random reds and browns, we move it closer to the rest of
+ * the color space.
+ */
+static constexpr EscPalette::LookupPoint hsl_point(int red, int green, int blue)
 {
-    static EscPalette pal;
-    if (!pal.isCompiled()) {
-        QVector<ColorCode> colors {
-            {QColor{  0,   0,   0}, "30", "40"},
-            {QColor{128,   0,   0}, "31", "41"},
-            {QColor{  0, 128,   0}, "32", "42"},
-            {QColor{128, 128,   0}, "33", "43"},
-            {QColor{  0,   0, 128}, "34", "44"},
-            {QColor{128,   0, 128}, "35", "45"},
-            {QColor{  0, 128, 128}, "36", "46"},
-            {QColor{192, 192, 192}, "37", "47"},
-            {QColor{128, 128, 128}, "1;30", ""},
-            {QColor{255,   0,   0}, "1;31", ""},
-            {QColor{  0, 255,   0}, "1;32", ""},
-            {QColor{255, 255,   0}, "1;33", ""},
-            {QColor{  0,   0, 255}, "1;34", ""},
-            {QColor{255,   0, 255}, "1;35", ""},
-            {QColor{  0, 255, 255}, "1;36", ""},
-            {QColor{255, 255, 255}, "1;37", ""},
-        };
-        pal.compile(colors);
+    const HslValues hsl = hsl_values(red, green, blue);
+    const float angle = 2.0f * hsl.m_hue * float(const_pi);
+    return { hsl.m_saturation * float(const_cos(angle)),
+             hsl.m_saturation * float(const_sin(angle)),
+             (2.0f * hsl.m_lightness) - 1.0f };
+}
+
+/* The same for colors only known at runtime, where the library's sin and
+ * cos are much faster than the series above.  Both are accurate to far
+ * better than a float, so an exact match for a palette entry lands on
+ * exactly that entry's position. */
+static EscPalette::LookupPoint runtime_hsl_point(const QColor &color)
+{
+    const HslValues hsl = hsl_values(color.red(), color.green(), color.blue());
+    const float angle = 2.0f * hsl.m_hue * float(const_pi);
+    return { hsl.m_saturation * float(std::cos(double(angle))),
+             hsl.m_saturation * float(std::sin(double(angle))),
+             (2.0f * hsl.m_lightness) - 1.0f };
+}
+
+static constexpr EscPalette::ColorCode make_color(int red, int green, int blue,
+                                                  const char *foreFormat,
+                                                  const char *backFormat)
+{
+    return { static_cast<unsigned char>(red), static_cast<unsigned char>(green),
+             static_cast<unsigned char>(blue), foreFormat, backFormat,
+             hsl_point(red, green, blue) };
+}
+
+template <typename Type, int Size>
+static constexpr int array_size(const Type (&)[Size])
+{
+    return Size;
+}
+
+/* Compile-time checks on the tables: the foreground and background codes
+ * of each extended palette entry must refer to the same color index, and
+ * the indices must be increasing. */
+static constexpr bool starts_with(const char *str, const char *prefix)
+{
+    while (*prefix) {
+        if (*str++ != *prefix++)
+            return false;
+    }
+    return true;
+}
+
+static constexpr int extended_index(const char *code)
+{
+    // Index from a "38;5;N" or "48;5;N" code
+    int index = 0;
+    for (code += 5; *code; ++code) {
+        if (*code < '0' || *code > '9')
+            return -1;
+        index = (index * 10) + (*code - '0');
     }
+    return index;
+}
 
+template <int Size>
+static constexpr bool check_extended(const EscPalette::ColorCode (&colors)[Size])
+{
+    int lastIndex = -1;
+    for (int i = 0; i < Size; ++i) {
+        if (!starts_with(colors[i].m_foreFormat, "38;5;")
+                || !starts_with(colors[i].m_backFormat, "48;5;"))
+            return false;
+        const int index = extended_index(colors[i].m_foreFormat);
+        if (index <= lastIndex || index > 255
+                || index != extended_index(colors[i].m_backFormat))
+            return false;
+        lastIndex = index;
+    }
+    return true;
+}
+
+static constexpr bool roughly_equal(float value, float expected)
+{
+    return (value > expected ? value - expected : expected - value) < 1.0e-4f;
+}
+
+static constexpr bool same_string(const char *str, const char *expected)
+{
+    while (*str && *str == *expected) {
+        ++str;
+        ++expected;
+    }
+    return *str == *expected;
+}
+
+/* The series in const_sin() is accurate to well under a bit of a float,
+ * but the std::sin() and std::cos() the QColor based lookups used aren't
+ * always correctly rounded, so positions may differ in the last bit. */
+static constexpr bool within_ulp(float value, float expected)
+{
+    return (value > expected ? value - expected : expected - value)
+            <= (expected < 0.0f ? -expected : expected) * std::numeric_limits<float>::epsilon();
+}
+
+// The whole table against the palette as it was built through QColor
+template <int Size, int ReferenceSize>
+static constexpr bool matches_reference(const EscPalette::ColorCode (&colors)[Size],
+                                        const ReferenceColor (&reference)[ReferenceSize])
+{
+    if (Size != ReferenceSize)
+        return false;
+    for (int i = 0; i < Size; ++i) {
+        const EscPalette::ColorCode &color = colors[i];
+        const ReferenceColor &expected = reference[i];
+        if (color.m_red != expected.m_red || color.m_green != expected.m_green
+                || color.m_blue != expected.m_blue
+                || !same_string(color.m_foreFormat, expected.m_foreFormat)
+                || !same_string(color.m_backFormat, expected.m_backFormat)
+                || !within_ulp(color.m_point.m_x, expected.m_x)
+                || !within_ulp(color.m_point.m_y, expected.m_y)
+                || !within_ulp(color.m_point.m_z, expected.m_z))
+            return false;
+    }
+    return true;
+}
+
+// Spot checks of the lookup space math against known HSL values
+static_assert(roughly_equal(hsl_point(255, 0, 0).m_x, 1.0f) && roughly_equal(hsl_point(255, 0, 0).m_y, 0.0f)
+              && roughly_equal(hsl_point(255, 0, 0).m_z, 0.0f), "pure red");
+static_assert(roughly_equal(hsl_point(0, 255, 0).m_x, -0.5f) && roughly_equal(hsl_point(0, 255, 0).m_y, 0.8660254f)
+              && roughly_equal(hsl_point(0, 255, 0).m_z, 0.0f), "pure green");
+static_assert(roughly_equal(hsl_point(0, 0, 128).m_x, -0.5f) && roughly_equal(hsl_point(0, 0, 128).m_y, -0.8660254f)
+              && roughly_equal(hsl_point(0, 0, 128).m_z, -0.4980392f), "dark blue");
+static_assert(roughly_equal(hsl_point(128, 128, 128).m_x, 0.0f) && roughly_equal(hsl_point(128, 128, 128).m_y, 0.0f)
+              && roughly_equal(hsl_point(128, 128, 128).m_z, 0.0039216f), "gray");
+
+const EscPalette *EscPalette::Palette8()
+{
+    static constexpr ColorCode colors[] = {
+        make_color(  0,   0,   0, "30", "40"),
+        make_color(128,   0,   0, "31", "41"),
+        make_color(  0, 128,   0, "32", "42"),
+        make_color(128, 128,   0, "33", "43"),
+        make_color(  0,   0, 128, "34", "44"),
+        make_color(128,   0, 128, "35", "45"),
+        make_color(  0, 128, 128, "36", "46"),
+        make_color(192, 192, 192, "37", "47"),
+        make_color(128, 128, 128, "1;30", ""),
+        make_color(255,   0,   0, "1;31", ""),
+        make_color(  0, 255,   0, "1;32", ""),
+        make_color(255, 255,   0, "1;33", ""),
+        make_color(  0,   0, 255, "1;34", ""),
+        make_color(255,   0, 255, "1;35", ""),
+        make_color(  0, 255, 255, "1;36", ""),
+        make_color(255, 255, 255, "1;37", ""),
+    };
+    static_assert(array_size(colors) == 16, "Unexpected palette size");
+    static_assert(matches_reference(colors, reference_palette8), "Palette differs from the QColor built one");
+
+    static constexpr EscPalette pal("8", colors, array_size(colors));
     return &pal;
 }
 
@@ -53,29 +289,28 @@ const EscPalette *EscPalette::Palette16()
     // Based on xterm, but should be close enough for most 16-color graphical
     // terminals that support xterm escape sequences
 
-    static EscPalette pal;
-    if (!pal.isCompiled()) {
-        QVector<ColorCode> colors {
-            {QColor{  0,   0,   0}, "30", "40"},
-            {QColor{205,   0,   0}, "31", "41"},
-            {QColor{  0, 205,   0}, "32", "42"},
-            {QColor{205, 205,   0}, "33", "43"},
-            {QColor{  0,   0, 238}, "34", "44"},
-            {QColor{205,   0, 205}, "35", "45"},
-            {QColor{  0, 205, 205}, "36", "46"},
-            {QColor{229, 229, 229}, "37", "47"},
-            {QColor{127, 127, 127}, "90", "100"},
-            {QColor{255,   0,   0}, "91", "101"},
-            {QColor{  0, 255,   0}, "92", "102"},
-            {QColor{255, 255,   0}, "93", "103"},
-            {QColor{ 92,  92, 255}, "94", "104"},
-            {QColor{255,   0, 255}, "95", "105"},
-            {QColor{  0, 255, 255}, "96", "106"},
-            {QColor{255, 255, 255}, "97", "107"},
-        };
-        pal.compile(colors);
-    }
-
+    static constexpr ColorCode colors[] = {
+        make_color(  0,   0,   0, "30", "40"),
+        make_color(205,   0,   0, "31", "41"),
+        make_color(  0, 205,   0, "32", "42"),
+        make_color(205, 205,   0, "33", "43"),
+        make_color(  0,   0, 238, "34", "44"),
+        make_color(205,   0, 205, "35", "45"),
+        make_color(  0, 205, 205, "36", "46"),
+        make_color(229, 229, 229, "37", "47"),
+        make_color(127, 127, 127, "90", "100"),
+        make_color(255,   0,   0, "91", "101"),
+        make_color(  0, 255,   0, "92", "102"),
+        make_color(255, 255,   0, "93", "103"),
+        make_color( 92,  92, 255, "94", "104"),
+        make_color(255,   0, 255, "95", "105"),
+        make_color(  0, 255, 255, "96", "106"),
+        make_color(255, 255, 255, "97", "107"),
+    };
+    static_assert(array_size(colors) == 16, "Unexpected palette size");
+    static_assert(matches_reference(colors, reference_palette16), "Palette differs from the QColor built one");
+
+    static constexpr EscPalette pal("16", colors, array_size(colors));
     return &pal;
 }
 
@@ -83,425 +318,470 @@ const EscPalette *EscPalette::Palette88()
 {
     // Based on rxvt's color palette
 
-    static EscPalette pal;
-    if (!pal.isCompiled()) {
-        QVector<ColorCode> colors {
-            //DUP {QColor{  0,   0,   0}, "38;5;0", "48;5;0"},
-            //DUP {QColor{205,   0,   0}, "38;5;1", "48;5;1"},
-            //DUP {QColor{  0, 205,   0}, "38;5;2", "48;5;2"},
-            //DUP {QColor{205, 205,   0}, "38;5;3", "48;5;3"},
-            //DUP {QColor{  0,   0, 205}, "38;5;4", "48;5;4"},
-            //DUP {QColor{205,   0, 205}, "38;5;5", "48;5;5"},
-            //DUP {QColor{  0, 205, 205}, "38;5;6", "48;5;6"},
-            {QColor{229, 229, 229}, "38;5;7", "48;5;7"},
-            {QColor{ 77,  77,  77}, "38;5;8", "48;5;8"},
-            //DUP {QColor{255,   0,   0}, "38;5;9", "48;5;9"},
-            //DUP {QColor{  0, 255,   0}, "38;5;10", "48;5;10"},
-            //DUP {QColor{255, 255,   0}, "38;5;11", "48;5;11"},
-            //DUP {QColor{  0,   0, 255}, "38;5;12", "48;5;12"},
-            //DUP {QColor{255,   0, 255}, "38;5;13", "48;5;13"},
-            //DUP {QColor{  0, 255, 255}, "38;5;14", "48;5;14"},
-            //DUP {QColor{255, 255, 255}, "38;5;15", "48;5;15"},
-            {QColor{  0,   0,   0}, "38;5;16", "48;5;16"},
-            {QColor{  0,   0, 139}, "38;5;17", "48;5;17"},
-            {QColor{  0,   0, 205}, "38;5;18", "48;5;18"},
-            {QColor{  0,   0, 255}, "38;5;19", "48;5;19"},
-            {QColor{  0, 139,   0}, "38;5;20", "48;5;20"},
-            {QColor{  0, 139, 139}, "38;5;21", "48;5;21"},
-            {QColor{  0, 139, 205}, "38;5;22", "48;5;22"},
-            {QColor{  0, 139, 255}, "38;5;23", "48;5;23"},
-            {QColor{  0, 205,   0}, "38;5;24", "48;5;24"},
-            {QColor{  0, 205, 139}, "38;5;25", "48;5;25"},
-            {QColor{  0, 205, 205}, "38;5;26", "48;5;26"},
-            {QColor{  0, 205, 255}, "38;5;27", "48;5;27"},
-            {QColor{  0, 255,   0}, "38;5;28", "48;5;28"},
-            {QColor{  0, 255, 139}, "38;5;29", "48;5;29"},
-            {QColor{  0, 255, 205}, "38;5;30", "48;5;30"},
-            {QColor{  0, 255, 255}, "38;5;31", "48;5;31"},
-            {QColor{139,   0,   0}, "38;5;32", "48;5;32"},
-            {QColor{139,   0, 139}, "38;5;33", "48;5;33"},
-            {QColor{139,   0, 205}, "38;5;34", "48;5;34"},
-            {QColor{139,   0, 255}, "38;5;35", "48;5;35"},
-            {QColor{139, 139,   0}, "38;5;36", "48;5;36"},
-            {QColor{139, 139, 139}, "38;5;37", "48;5;37"},
-            {QColor{139, 139, 205}, "38;5;38", "48;5;38"},
-            {QColor{139, 139, 255}, "38;5;39", "48;5;39"},
-            {QColor{139, 205,   0}, "38;5;40", "48;5;40"},
-            {QColor{139, 205, 139}, "38;5;41", "48;5;41"},
-            {QColor{139, 205, 205}, "38;5;42", "48;5;42"},
-            {QColor{139, 205, 255}, "38;5;43", "48;5;43"},
-            {QColor{139, 255,   0}, "38;5;44", "48;5;44"},
-            {QColor{139, 255, 139}, "38;5;45", "48;5;45"},
-            {QColor{139, 255, 205}, "38;5;46", "48;5;46"},
-            {QColor{139, 255, 255}, "38;5;47", "48;5;47"},
-            {QColor{205,   0,   0}, "38;5;48", "48;5;48"},
-            {QColor{205,   0, 139}, "38;5;49", "48;5;49"},
-            {QColor{205,   0, 205}, "38;5;50", "48;5;50"},
-            {QColor{205,   0, 255}, "38;5;51", "48;5;51"},
-            {QColor{205, 139,   0}, "38;5;52", "48;5;52"},
-            {QColor{205, 139, 139}, "38;5;53", "48;5;53"},
-            {QColor{205, 139, 205}, "38;5;54", "48;5;54"},
-            {QColor{205, 139, 255}, "38;5;55", "48;5;55"},
-            {QColor{205, 205,   0}, "38;5;56", "48;5;56"},
-            {QColor{205, 205, 139}, "38;5;57", "48;5;57"},
-            {QColor{205, 205, 205}, "38;5;58", "48;5;58"},
-            {QColor{205, 205, 255}, "38;5;59", "48;5;59"},
-            {QColor{205, 255,   0}, "38;5;60", "48;5;60"},
-            {QColor{205, 255, 139}, "38;5;61", "48;5;61"},
-            {QColor{205, 255, 205}, "38;5;62", "48;5;62"},
-            {QColor{205, 255, 255}, "38;5;63", "48;5;63"},
-            {QColor{255,   0,   0}, "38;5;64", "48;5;64"},
-            {QColor{255,   0, 139}, "38;5;65", "48;5;65"},
-            {QColor{255,   0, 205}, "38;5;66", "48;5;66"},
-            {QColor{255,   0, 255}, "38;5;67", "48;5;67"},
-            {QColor{255, 139,   0}, "38;5;68", "48;5;68"},
-            {QColor{255, 139, 139}, "38;5;69", "48;5;69"},
-            {QColor{255, 139, 205}, "38;5;70", "48;5;70"},
-            {QColor{255, 139, 255}, "38;5;71", "48;5;71"},
-            {QColor{255, 205,   0}, "38;5;72", "48;5;72"},
-            {QColor{255, 205, 139}, "38;5;73", "48;5;73"},
-            {QColor{255, 205, 205}, "38;5;74", "48;5;74"},
-            {QColor{255, 205, 255}, "38;5;75", "48;5;75"},
-            {QColor{255, 255,   0}, "38;5;76", "48;5;76"},
-            {QColor{255, 255, 139}, "38;5;77", "48;5;77"},
-            {QColor{255, 255, 205}, "38;5;78", "48;5;78"},
-            {QColor{255, 255, 255}, "38;5;79", "48;5;79"},
-            {QColor{ 46,  46,  46}, "38;5;80", "48;5;80"},
-            {QColor{ 92,  92,  92}, "38;5;81", "48;5;81"},
-            {QColor{115, 115, 115}, "38;5;82", "48;5;82"},
-            {QColor{139, 139, 139}, "38;5;83", "48;5;83"},
-            {QColor{162, 162, 162}, "38;5;84", "48;5;84"},
-            {QColor{185, 185, 185}, "38;5;85", "48;5;85"},
-            {QColor{208, 208, 208}, "38;5;86", "48;5;86"},
-            {QColor{231, 231, 231}, "38;5;87", "48;5;87"},
-        };
-        pal.compile(colors);
-    }
-
+    static constexpr ColorCode colors[] = {
+        //DUP make_color(  0,   0,   0, "38;5;0", "48;5;0"),
+        //DUP make_color(205,   0,   0, "38;5;1", "48;5;1"),
+        //DUP make_color(  0, 205,   0, "38;5;2", "48;5;2"),
+        //DUP make_color(205, 205,   0, "38;5;3", "48;5;3"),
+        //DUP make_color(  0,   0, 205, "38;5;4", "48;5;4"),
+        //DUP make_color(205,   0, 205, "38;5;5", "48;5;5"),
+        //DUP make_color(  0, 205, 205, "38;5;6", "48;5;6"),
+        make_color(229, 229, 229, "38;5;7", "48;5;7"),
+        make_color( 77,  77,  77, "38;5;8", "48;5;8"),
+        //DUP make_color(255,   0,   0, "38;5;9", "48;5;9"),
+        //DUP make_color(  0, 255,   0, "38;5;10", "48;5;10"),
+        //DUP make_color(255, 255,   0, "38;5;11", "48;5;11"),
+        //DUP make_color(  0,   0, 255, "38;5;12", "48;5;12"),
+        //DUP make_color(255,   0, 255, "38;5;13", "48;5;13"),
+        //DUP make_color(  0, 255, 255, "38;5;14", "48;5;14"),
+        //DUP make_color(255, 255, 255, "38;5;15", "48;5;15"),
+        make_color(  0,   0,   0, "38;5;16", "48;5;16"),
+        make_color(  0,   0, 139, "38;5;17", "48;5;17"),
+        make_color(  0,   0, 205, "38;5;18", "48;5;18"),
+        make_color(  0,   0, 255, "38;5;19", "48;5;19"),
+        make_color(  0, 139,   0, "38;5;20", "48;5;20"),
+        make_color(  0, 139, 139, "38;5;21", "48;5;21"),
+        make_color(  0, 139, 205, "38;5;22", "48;5;22"),
+        make_color(  0, 139, 255, "38;5;23", "48;5;23"),
+        make_color(  0, 205,   0, "38;5;24", "48;5;24"),
+        make_color(  0, 205, 139, "38;5;25", "48;5;25"),
+        make_color(  0, 205, 205, "38;5;26", "48;5;26"),
+        make_color(  0, 205, 255, "38;5;27", "48;5;27"),
+        make_color(  0, 255,   0, "38;5;28", "48;5;28"),
+        make_color(  0, 255, 139, "38;5;29", "48;5;29"),
+        make_color(  0, 255, 205, "38;5;30", "48;5;30"),
+        make_color(  0, 255, 255, "38;5;31", "48;5;31"),
+        make_color(139,   0,   0, "38;5;32", "48;5;32"),
+        make_color(139,   0, 139, "38;5;33", "48;5;33"),
+        make_color(139,   0, 205, "38;5;34", "48;5;34"),
+        make_color(139,   0, 255, "38;5;35", "48;5;35"),
+        make_color(139, 139,   0, "38;5;36", "48;5;36"),
+        make_color(139, 139, 139, "38;5;37", "48;5;37"),
+        make_color(139, 139, 205, "38;5;38", "48;5;38"),
+        make_color(139, 139, 255, "38;5;39", "48;5;39"),
+        make_color(139, 205,   0, "38;5;40", "48;5;40"),
+        make_color(139, 205, 139, "38;5;41", "48;5;41"),
+        make_color(139, 205, 205, "38;5;42", "48;5;42"),
+        make_color(139, 205, 255, "38;5;43", "48;5;43"),
+        make_color(139, 255,   0, "38;5;44", "48;5;44"),
+        make_color(139, 255, 139, "38;5;45", "48;5;45"),
+        make_color(139, 255, 205, "38;5;46", "48;5;46"),
+        make_color(139, 255, 255, "38;5;47", "48;5;47"),
+        make_color(205,   0,   0, "38;5;48", "48;5;48"),
+        make_color(205,   0, 139, "38;5;49", "48;5;49"),
+        make_color(205,   0, 205, "38;5;50", "48;5;50"),
+        make_color(205,   0, 255, "38;5;51", "48;5;51"),
+        make_color(205, 139,   0, "38;5;52", "48;5;52"),
+        make_color(205, 139, 139, "38;5;53", "48;5;53"),
+        make_color(205, 139, 205, "38;5;54", "48;5;54"),
+        make_color(205, 139, 255, "38;5;55", "48;5;55"),
+        make_color(205, 205,   0, "38;5;56", "48;5;56"),
+        make_color(205, 205, 139, "38;5;57", "48;5;57"),
+        make_color(205, 205, 205, "38;5;58", "48;5;58"),
+        make_color(205, 205, 255, "38;5;59", "48;5;59"),
+        make_color(205, 255,   0, "38;5;60", "48;5;60"),
+        make_color(205, 255, 139, "38;5;61", "48;5;61"),
+        make_color(205, 255, 205, "38;5;62", "48;5;62"),
+        make_color(205, 255, 255, "38;5;63", "48;5;63"),
+        make_color(255,   0,   0, "38;5;64", "48;5;64"),
+        make_color(255,   0, 139, "38;5;65", "48;5;65"),
+        make_color(255,   0, 205, "38;5;66", "48;5;66"),
+        make_color(255,   0, 255, "38;5;67", "48;5;67"),
+        make_color(255, 139,   0, "38;5;68", "48;5;68"),
+        make_color(255, 139, 139, "38;5;69", "48;5;69"),
+        make_color(255, 139, 205, "38;5;70", "48;5;70"),
+        make_color(255, 139, 255, "38;5;71", "48;5;71"),
+        make_color(255, 205,   0, "38;5;72", "48;5;72"),
+        make_color(255, 205, 139, "38;5;73", "48;5;73"),
+        make_color(255, 205, 205, "38;5;74", "48;5;74"),
+        make_color(255, 205, 255, "38;5;75", "48;5;75"),
+        make_color(255, 255,   0, "38;5;76", "48;5;76"),
+        make_color(255, 255, 139, "38;5;77", "48;5;77"),
+        make_color(255, 255, 205, "38;5;78", "48;5;78"),
+        make_color(255, 255, 255, "38;5;79", "48;5;79"),
+        make_color( 46,  46,  46, "38;5;80", "48;5;80"),
+        make_color( 92,  92,  92, "38;5;81", "48;5;81"),
+        make_color(115, 115, 115, "38;5;82", "48;5;82"),
+        make_color(139, 139, 139, "38;5;83", "48;5;83"),
+        make_color(162, 162, 162, "38;5;84", "48;5;84"),
+        make_color(185, 185, 185, "38;5;85", "48;5;85"),
+        make_color(208, 208, 208, "38;5;86", "48;5;86"),
+        make_color(231, 231, 231, "38;5;87", "48;5;87"),
+    };
+    static_assert(array_size(colors) == 74, "Unexpected palette size");
+    static_assert(check_extended(colors), "Mismatched palette codes");
+    static_assert(matches_reference(colors, reference_palette88), "Palette differs from the QColor built one");
+
+    static constexpr EscPalette pal("88", colors, array_size(colors));
     return &pal;
 }
 
 const EscPalette *EscPalette::Palette256()
 {
-    static EscPalette pal;
-    if (!pal.isCompiled()) {
-        QVector<ColorCode> colors {
-            //DUP {QColor{  0,   0,   0}, "38;5;0", "48;5;0"},
-            {QColor{128,   0,   0}, "38;5;1", "48;5;1"},
-            {QColor{  0, 128,   0}, "38;5;2", "48;5;2"},
-            {QColor{128, 128,   0}, "38;5;3", "48;5;3"},
-            {QColor{  0,   0, 128}, "38;5;4", "48;5;4"},
-            {QColor{128,   0, 128}, "38;5;5", "48;5;5"},
-            {QColor{  0, 128, 128}, "38;5;6", "48;5;6"},
-            {QColor{192, 192, 192}, "38;5;7", "48;5;7"},
-            //DUP {QColor{128, 128, 128}, "38;5;8", "48;5;8"},
-            //DUP {QColor{255,   0,   0}, "38;5;9", "48;5;9"},
-            //DUP {QColor{  0, 255,   0}, "38;5;10", "48;5;10"},
-            //DUP {QColor{255, 255,   0}, "38;5;11", "48;5;11"},
-            //DUP {QColor{  0,   0, 255}, "38;5;12", "48;5;12"},
-            //DUP {QColor{255,   0, 255}, "38;5;13", "48;5;13"},
-            //DUP {QColor{  0, 255, 255}, "38;5;14", "48;5;14"},
-            //DUP {QColor{255, 255, 255}, "38;5;15", "48;5;15"},
-            {QColor{  0,   0,   0}, "38;5;16", "48;5;16"},
-            {QColor{  0,   0,  95}, "38;5;17", "48;5;17"},
-            {QColor{  0,   0, 135}, "38;5;18", "48;5;18"},
-            {QColor{  0,   0, 175}, "38;5;19", "48;5;19"},
-            {QColor{  0,   0, 215}, "38;5;20", "48;5;20"},
-            {QColor{  0,   0, 255}, "38;5;21", "48;5;21"},
-            {QColor{  0,  95,   0}, "38;5;22", "48;5;22"},
-            {QColor{  0,  95,  95}, "38;5;23", "48;5;23"},
-            {QColor{  0,  95, 135}, "38;5;24", "48;5;24"},
-            {QColor{  0,  95, 175}, "38;5;25", "48;5;25"},
-            {QColor{  0,  95, 215}, "38;5;26", "48;5;26"},
-            {QColor{  0,  95, 255}, "38;5;27", "48;5;27"},
-            {QColor{  0, 135,   0}, "38;5;28", "48;5;28"},
-            {QColor{  0, 135,  95}, "38;5;29", "48;5;29"},
-            {QColor{  0, 135, 135}, "38;5;30", "48;5;30"},
-            {QColor{  0, 135, 175}, "38;5;31", "48;5;31"},
-            {QColor{  0, 135, 215}, "38;5;32", "48;5;32"},
-            {QColor{  0, 135, 255}, "38;5;33", "48;5;33"},
-            {QColor{  0, 175,   0}, "38;5;34", "48;5;34"},
-            {QColor{  0, 175,  95}, "38;5;35", "48;5;35"},
-            {QColor{  0, 175, 135}, "38;5;36", "48;5;36"},
-            {QColor{  0, 175, 175}, "38;5;37", "48;5;37"},
-            {QColor{  0, 175, 215}, "38;5;38", "48;5;38"},
-            {QColor{  0, 175, 255}, "38;5;39", "48;5;39"},
-            {QColor{  0, 215,   0}, "38;5;40", "48;5;40"},
-            {QColor{  0, 215,  95}, "38;5;41", "48;5;41"},
-            {QColor{  0, 215, 135}, "38;5;42", "48;5;42"},
-            {QColor{  0, 215, 175}, "38;5;43", "48;5;43"},
-            {QColor{  0, 215, 215}, "38;5;44", "48;5;44"},
-            {QColor{  0, 215, 255}, "38;5;45", "48;5;45"},
-            {QColor{  0, 255,   0}, "38;5;46", "48;5;46"},
-            {QColor{  0, 255,  95}, "38;5;47", "48;5;47"},
-            {QColor{  0, 255, 135}, "38;5;48", "48;5;48"},
-            {QColor{  0, 255, 175}, "38;5;49", "48;5;49"},
-            {QColor{  0, 255, 215}, "38;5;50", "48;5;50"},
-            {QColor{  0, 255, 255}, "38;5;51", "48;5;51"},
-            {QColor{ 95,   0,   0}, "38;5;52", "48;5;52"},
-            {QColor{ 95,   0,  95}, "38;5;53", "48;5;53"},
-            {QColor{ 95,   0, 135}, "38;5;54", "48;5;54"},
-            {QColor{ 95,   0, 175}, "38;5;55", "48;5;55"},
-            {QColor{ 95,   0, 215}, "38;5;56", "48;5;56"},
-            {QColor{ 95,   0, 255}, "38;5;57", "48;5;57"},
-            {QColor{ 95,  95,   0}, "38;5;58", "48;5;58"},
-            {QColor{ 95,  95,  95}, "38;5;59", "48;5;59"},
-            {QColor{ 95,  95, 135}, "38;5;60", "48;5;60"},
-            {QColor{ 95,  95, 175}, "38;5;61", "48;5;61"},
-            {QColor{ 95,  95, 215}, "38;5;62", "48;5;62"},
-            {QColor{ 95,  95, 255}, "38;5;63", "48;5;63"},
-            {QColor{ 95, 135,   0}, "38;5;64", "48;5;64"},
-            {QColor{ 95, 135,  95}, "38;5;65", "48;5;65"},
-            {QColor{ 95, 135, 135}, "38;5;66", "48;5;66"},
-            {QColor{ 95, 135, 175}, "38;5;67", "48;5;67"},
-            {QColor{ 95, 135, 215}, "38;5;68", "48;5;68"},
-            {QColor{ 95, 135, 255}, "38;5;69", "48;5;69"},
-            {QColor{ 95, 175,   0}, "38;5;70", "48;5;70"},
-            {QColor{ 95, 175,  95}, "38;5;71", "48;5;71"},
-            {QColor{ 95, 175, 135}, "38;5;72", "48;5;72"},
-            {QColor{ 95, 175, 175}, "38;5;73", "48;5;73"},
-            {QColor{ 95, 175, 215}, "38;5;74", "48;5;74"},
-            {QColor{ 95, 175, 255}, "38;5;75", "48;5;75"},
-            {QColor{ 95, 215,   0}, "38;5;76", "48;5;76"},
-            {QColor{ 95, 215,  95}, "38;5;77", "48;5;77"},
-            {QColor{ 95, 215, 135}, "38;5;78", "48;5;78"},
-            {QColor{ 95, 215, 175}, "38;5;79", "48;5;79"},
-            {QColor{ 95, 215, 215}, "38;5;80", "48;5;80"},
-            {QColor{ 95, 215, 255}, "38;5;81", "48;5;81"},
-            {QColor{ 95, 255,   0}, "38;5;82", "48;5;82"},
-            {QColor{ 95, 255,  95}, "38;5;83", "48;5;83"},
-            {QColor{ 95, 255, 135}, "38;5;84", "48;5;84"},
-            {QColor{ 95, 255, 175}, "38;5;85", "48;5;85"},
-            {QColor{ 95, 255, 215}, "38;5;86", "48;5;86"},
-            {QColor{ 95, 255, 255}, "38;5;87", "48;5;87"},
-            {QColor{135,   0,   0}, "38;5;88", "48;5;88"},
-            {QColor{135,   0,  95}, "38;5;89", "48;5;89"},
-            {QColor{135,   0, 135}, "38;5;90", "48;5;90"},
-            {QColor{135,   0, 175}, "38;5;91", "48;5;91"},
-            {QColor{135,   0, 215}, "38;5;92", "48;5;92"},
-            {QColor{135,   0, 255}, "38;5;93", "48;5;93"},
-            {QColor{135,  95,   0}, "38;5;94", "48;5;94"},
-            {QColor{135,  95,  95}, "38;5;95", "48;5;95"},
-            {QColor{135,  95, 135}, "38;5;96", "48;5;96"},
-            {QColor{135,  95, 175}, "38;5;97", "48;5;97"},
-            {QColor{135,  95, 215}, "38;5;98", "48;5;98"},
-            {QColor{135,  95, 255}, "38;5;99", "48;5;99"},
-            {QColor{135, 135,   0}, "38;5;100", "48;5;100"},
-            {QColor{135, 135,  95}, "38;5;101", "48;5;101"},
-            {QColor{135, 135, 135}, "38;5;102", "48;5;102"},
-            {QColor{135, 135, 175}, "38;5;103", "48;5;103"},
-            {QColor{135, 135, 215}, "38;5;104", "48;5;104"},
-            {QColor{135, 135, 255}, "38;5;105", "48;5;105"},
-            {QColor{135, 175,   0}, "38;5;106", "48;5;106"},
-            {QColor{135, 175,  95}, "38;5;107", "48;5;107"},
-            {QColor{135, 175, 135}, "38;5;108", "48;5;108"},
-            {QColor{135, 175, 175}, "38;5;109", "48;5;109"},
-            {QColor{135, 175, 215}, "38;5;110", "48;5;110"},
-            {QColor{135, 175, 255}, "38;5;111", "48;5;111"},
-            {QColor{135, 215,   0}, "38;5;112", "48;5;112"},
-            {QColor{135, 215,  95}, "38;5;113", "48;5;113"},
-            {QColor{135, 215, 135}, "38;5;114", "48;5;114"},
-            {QColor{135, 215, 175}, "38;5;115", "48;5;115"},
-            {QColor{135, 215, 215}, "38;5;116", "48;5;116"},
-            {QColor{135, 215, 255}, "38;5;117", "48;5;117"},
-            {QColor{135, 255,   0}, "38;5;118", "48;5;118"},
-            {QColor{135, 255,  95}, "38;5;119", "48;5;119"},
-            {QColor{135, 255, 135}, "38;5;120", "48;5;120"},
-            {QColor{135, 255, 175}, "38;5;121", "48;5;121"},
-            {QColor{135, 255, 215}, "38;5;122", "48;5;122"},
-            {QColor{135, 255, 255}, "38;5;123", "48;5;123"},
-            {QColor{175,   0,   0}, "38;5;124", "48;5;124"},
-            {QColor{175,   0,  95}, "38;5;125", "48;5;125"},
-            {QColor{175,   0, 135}, "38;5;126", "48;5;126"},
-            {QColor{175,   0, 175}, "38;5;127", "48;5;127"},
-            {QColor{175,   0, 215}, "38;5;128", "48;5;128"},
-            {QColor{175,   0, 255}, "38;5;129", "48;5;129"},
-            {QColor{175,  95,   0}, "38;5;130", "48;5;130"},
-            {QColor{175,  95,  95}, "38;5;131", "48;5;131"},
-            {QColor{175,  95, 135}, "38;5;132", "48;5;132"},
-            {QColor{175,  95, 175}, "38;5;133", "48;5;133"},
-            {QColor{175,  95, 215}, "38;5;134", "48;5;134"},
-            {QColor{175,  95, 255}, "38;5;135", "48;5;135"},
-            {QColor{175, 135,   0}, "38;5;136", "48;5;136"},
-            {QColor{175, 135,  95}, "38;5;137", "48;5;137"},
-            {QColor{175, 135, 135}, "38;5;138", "48;5;138"},
-            {QColor{175, 135, 175}, "38;5;139", "48;5;139"},
-            {QColor{175, 135, 215}, "38;5;140", "48;5;140"},
-            {QColor{175, 135, 255}, "38;5;141", "48;5;141"},
-            {QColor{175, 175,   0}, "38;5;142", "48;5;142"},
-            {QColor{175, 175,  95}, "38;5;143", "48;5;143"},
-            {QColor{175, 175, 135}, "38;5;144", "48;5;144"},
-            {QColor{175, 175, 175}, "38;5;145", "48;5;145"},
-            {QColor{175, 175, 215}, "38;5;146", "48;5;146"},
-            {QColor{175, 175, 255}, "38;5;147", "48;5;147"},
-            {QColor{175, 215,   0}, "38;5;148", "48;5;148"},
-            {QColor{175, 215,  95}, "38;5;149", "48;5;149"},
-            {QColor{175, 215, 135}, "38;5;150", "48;5;150"},
-            {QColor{175, 215, 175}, "38;5;151", "48;5;151"},
-            {QColor{175, 215, 215}, "38;5;152", "48;5;152"},
-            {QColor{175, 215, 255}, "38;5;153", "48;5;153"},
-            {QColor{175, 255,   0}, "38;5;154", "48;5;154"},
-            {QColor{175, 255,  95}, "38;5;155", "48;5;155"},
-            {QColor{175, 255, 135}, "38;5;156", "48;5;156"},
-            {QColor{175, 255, 175}, "38;5;157", "48;5;157"},
-            {QColor{175, 255, 215}, "38;5;158", "48;5;158"},
-            {QColor{175, 255, 255}, "38;5;159", "48;5;159"},
-            {QColor{215,   0,   0}, "38;5;160", "48;5;160"},
-            {QColor{215,   0,  95}, "38;5;161", "48;5;161"},
-            {QColor{215,   0, 135}, "38;5;162", "48;5;162"},
-            {QColor{215,   0, 175}, "38;5;163", "48;5;163"},
-            {QColor{215,   0, 215}, "38;5;164", "48;5;164"},
-            {QColor{215,   0, 255}, "38;5;165", "48;5;165"},
-            {QColor{215,  95,   0}, "38;5;166", "48;5;166"},
-            {QColor{215,  95,  95}, "38;5;167", "48;5;167"},
-            {QColor{215,  95, 135}, "38;5;168", "48;5;168"},
-            {QColor{215,  95, 175}, "38;5;169", "48;5;169"},
-            {QColor{215,  95, 215}, "38;5;170", "48;5;170"},
-            {QColor{215,  95, 255}, "38;5;171", "48;5;171"},
-            {QColor{215, 135,   0}, "38;5;172", "48;5;172"},
-            {QColor{215, 135,  95}, "38;5;173", "48;5;173"},
-            {QColor{215, 135, 135}, "38;5;174", "48;5;174"},
-            {QColor{215, 135, 175}, "38;5;175", "48;5;175"},
-            {QColor{215, 135, 215}, "38;5;176", "48;5;176"},
-            {QColor{215, 135, 255}, "38;5;177", "48;5;177"},
-            {QColor{215, 175,   0}, "38;5;178", "48;5;178"},
-            {QColor{215, 175,  95}, "38;5;179", "48;5;179"},
-            {QColor{215, 175, 135}, "38;5;180", "48;5;180"},
-            {QColor{215, 175, 175}, "38;5;181", "48;5;181"},
-            {QColor{215, 175, 215}, "38;5;182", "48;5;182"},
-            {QColor{215, 175, 255}, "38;5;183", "48;5;183"},
-            {QColor{215, 215,   0}, "38;5;184", "48;5;184"},
-            {QColor{215, 215,  95}, "38;5;185", "48;5;185"},
-            {QColor{215, 215, 135}, "38;5;186", "48;5;186"},
-            {QColor{215, 215, 175}, "38;5;187", "48;5;187"},
-            {QColor{215, 215, 215}, "38;5;188", "48;5;188"},
-            {QColor{215, 215, 255}, "38;5;189", "48;5;189"},
-            {QColor{215, 255,   0}, "38;5;190", "48;5;190"},
-            {QColor{215, 255,  95}, "38;5;191", "48;5;191"},
-            {QColor{215, 255, 135}, "38;5;192", "48;5;192"},
-            {QColor{215, 255, 175}, "38;5;193", "48;5;193"},
-            {QColor{215, 255, 215}, "38;5;194", "48;5;194"},
-            {QColor{215, 255, 255}, "38;5;195", "48;5;195"},
-            {QColor{255,   0,   0}, "38;5;196", "48;5;196"},
-            {QColor{255,   0,  95}, "38;5;197", "48;5;197"},
-            {QColor{255,   0, 135}, "38;5;198", "48;5;198"},
-            {QColor{255,   0, 175}, "38;5;199", "48;5;199"},
-            {QColor{255,   0, 215}, "38;5;200", "48;5;200"},
-            {QColor{255,   0, 255}, "38;5;201", "48;5;201"},
-            {QColor{255,  95,   0}, "38;5;202", "48;5;202"},
-            {QColor{255,  95,  95}, "38;5;203", "48;5;203"},
-            {QColor{255,  95, 135}, "38;5;204", "48;5;204"},
-            {QColor{255,  95, 175}, "38;5;205", "48;5;205"},
-            {QColor{255,  95, 215}, "38;5;206", "48;5;206"},
-            {QColor{255,  95, 255}, "38;5;207", "48;5;207"},
-            {QColor{255, 135,   0}, "38;5;208", "48;5;208"},
-            {QColor{255, 135,  95}, "38;5;209", "48;5;209"},
-            {QColor{255, 135, 135}, "38;5;210", "48;5;210"},
-            {QColor{255, 135, 175}, "38;5;211", "48;5;211"},
-            {QColor{255, 135, 215}, "38;5;212", "48;5;212"},
-            {QColor{255, 135, 255}, "38;5;213", "48;5;213"},
-            {QColor{255, 175,   0}, "38;5;214", "48;5;214"},
-            {QColor{255, 175,  95}, "38;5;215", "48;5;215"},
-            {QColor{255, 175, 135}, "38;5;216", "48;5;216"},
-            {QColor{255, 175, 175}, "38;5;217", "48;5;217"},
-            {QColor{255, 175, 215}, "38;5;218", "48;5;218"},
-            {QColor{255, 175, 255}, "38;5;219", "48;5;219"},
-            {QColor{255, 215,   0}, "38;5;220", "48;5;220"},
-            {QColor{255, 215,  95}, "38;5;221", "48;5;221"},
-            {QColor{255, 215, 135}, "38;5;222", "48;5;222"},
-            {QColor{255, 215, 175}, "38;5;223", "48;5;223"},
-            {QColor{255, 215, 215}, "38;5;224", "48;5;224"},
-            {QColor{255, 215, 255}, "38;5;225", "48;5;225"},
-            {QColor{255, 255,   0}, "38;5;226", "48;5;226"},
-            {QColor{255, 255,  95}, "38;5;227", "48;5;227"},
-            {QColor{255, 255, 135}, "38;5;228", "48;5;228"},
-            {QColor{255, 255, 175}, "38;5;229", "48;5;229"},
-            {QColor{255, 255, 215}, "38;5;230", "48;5;230"},
-            {QColor{255, 255, 255}, "38;5;231", "48;5;231"},
-            {QColor{  8,   8,   8}, "38;5;232", "48;5;232"},
-            {QColor{ 18,  18,  18}, "38;5;233", "48;5;233"},
-            {QColor{ 28,  28,  28}, "38;5;234", "48;5;234"},
-            {QColor{ 38,  38,  38}, "38;5;235", "48;5;235"},
-            {QColor{ 48,  48,  48}, "38;5;236", "48;5;236"},
-            {QColor{ 58,  58,  58}, "38;5;237", "48;5;237"},
-            {QColor{ 68,  68,  68}, "38;5;238", "48;5;238"},
-            {QColor{ 78,  78,  78}, "38;5;239", "48;5;239"},
-            {QColor{ 88,  88,  88}, "38;5;240", "48;5;240"},
-            {QColor{ 98,  98,  98}, "38;5;241", "48;5;241"},
-            {QColor{108, 108, 108}, "38;5;242", "48;5;242"},
-            {QColor{118, 118, 118}, "38;5;243", "48;5;243"},
-            {QColor{128, 128, 128}, "38;5;244", "48;5;244"},
-            {QColor{138, 138, 138}, "38;5;245", "48;5;245"},
-            {QColor{148, 148, 148}, "38;5;246", "48;5;246"},
-            {QColor{158, 158, 158}, "38;5;247", "48;5;247"},
-            {QColor{168, 168, 168}, "38;5;248", "48;5;248"},
-            {QColor{178, 178, 178}, "38;5;249", "48;5;249"},
-            {QColor{188, 188, 188}, "38;5;250", "48;5;250"},
-            {QColor{198, 198, 198}, "38;5;251", "48;5;251"},
-            {QColor{208, 208, 208}, "38;5;252", "48;5;252"},
-            {QColor{218, 218, 218}, "38;5;253", "48;5;253"},
-            {QColor{228, 228, 228}, "38;5;254", "48;5;254"},
-            {QColor{238, 238, 238}, "38;5;255", "48;5;255"},
-        };
-        pal.compile(colors);
-    }
-
+    static constexpr ColorCode colors[] = {
+        //DUP make_color(  0,   0,   0, "38;5;0", "48;5;0"),
+        make_color(128,   0,   0, "38;5;1", "48;5;1"),
+        make_color(  0, 128,   0, "38;5;2", "48;5;2"),
+        make_color(128, 128,   0, "38;5;3", "48;5;3"),
+        make_color(  0,   0, 128, "38;5;4", "48;5;4"),
+        make_color(128,   0, 128, "38;5;5", "48;5;5"),
+        make_color(  0, 128, 128, "38;5;6", "48;5;6"),
+        make_color(192, 192, 192, "38;5;7", "48;5;7"),
+        //DUP make_color(128, 128, 128, "38;5;8", "48;5;8"),
+        //DUP make_color(255,   0,   0, "38;5;9", "48;5;9"),
+        //DUP make_color(  0, 255,   0, "38;5;10", "48;5;10"),
+        //DUP make_color(255, 255,   0, "38;5;11", "48;5;11"),
+        //DUP make_color(  0,   0, 255, "38;5;12", "48;5;12"),
+        //DUP make_color(255,   0, 255, "38;5;13", "48;5;13"),
+        //DUP make_color(  0, 255, 255, "38;5;14", "48;5;14"),
+        //DUP make_color(255, 255, 255, "38;5;15", "48;5;15"),
+        make_color(  0,   0,   0, "38;5;16", "48;5;16"),
+        make_color(  0,   0,  95, "38;5;17", "48;5;17"),
+        make_color(  0,   0, 135, "38;5;18", "48;5;18"),
+        make_color(  0,   0, 175, "38;5;19", "48;5;19"),
+        make_color(  0,   0, 215, "38;5;20", "48;5;20"),
+        make_color(  0,   0, 255, "38;5;21", "48;5;21"),
+        make_color(  0,  95,   0, "38;5;22", "48;5;22"),
+        make_color(  0,  95,  95, "38;5;23", "48;5;23"),
+        make_color(  0,  95, 135, "38;5;24", "48;5;24"),
+        make_color(  0,  95, 175, "38;5;25", "48;5;25"),
+        make_color(  0,  95, 215, "38;5;26", "48;5;26"),
+        make_color(  0,  95, 255, "38;5;27", "48;5;27"),
+        make_color(  0, 135,   0, "38;5;28", "48;5;28"),
+        make_color(  0, 135,  95, "38;5;29", "48;5;29"),
+        make_color(  0, 135, 135, "38;5;30", "48;5;30"),
+        make_color(  0, 135, 175, "38;5;31", "48;5;31"),
+        make_color(  0, 135, 215, "38;5;32", "48;5;32"),
+        make_color(  0, 135, 255, "38;5;33", "48;5;33"),
+        make_color(  0, 175,   0, "38;5;34", "48;5;34"),
+        make_color(  0, 175,  95, "38;5;35", "48;5;35"),
+        make_color(  0, 175, 135, "38;5;36", "48;5;36"),
+        make_color(  0, 175, 175, "38;5;37", "48;5;37"),
+        make_color(  0, 175, 215, "38;5;38", "48;5;38"),
+        make_color(  0, 175, 255, "38;5;39", "48;5;39"),
+        make_color(  0, 215,   0, "38;5;40", "48;5;40"),
+        make_color(  0, 215,  95, "38;5;41", "48;5;41"),
+        make_color(  0, 215, 135, "38;5;42", "48;5;42"),
+        make_color(  0, 215, 175, "38;5;43", "48;5;43"),
+        make_color(  0, 215, 215, "38;5;44", "48;5;44"),
+        make_color(  0, 215, 255, "38;5;45", "48;5;45"),
+        make_color(  0, 255,   0, "38;5;46", "48;5;46"),
+        make_color(  0, 255,  95, "38;5;47", "48;5;47"),
+        make_color(  0, 255, 135, "38;5;48", "48;5;48"),
+        make_color(  0, 255, 175, "38;5;49", "48;5;49"),
+        make_color(  0, 255, 215, "38;5;50", "48;5;50"),
+        make_color(  0, 255, 255, "38;5;51", "48;5;51"),
+        make_color( 95,   0,   0, "38;5;52", "48;5;52"),
+        make_color( 95,   0,  95, "38;5;53", "48;5;53"),
+        make_color( 95,   0, 135, "38;5;54", "48;5;54"),
+        make_color( 95,   0, 175, "38;5;55", "48;5;55"),
+        make_color( 95,   0, 215, "38;5;56", "48;5;56"),
+        make_color( 95,   0, 255, "38;5;57", "48;5;57"),
+        make_color( 95,  95,   0, "38;5;58", "48;5;58"),
+        make_color( 95,  95,  95, "38;5;59", "48;5;59"),
+        make_color( 95,  95, 135, "38;5;60", "48;5;60"),
+        make_color( 95,  95, 175, "38;5;61", "48;5;61"),
+        make_color( 95,  95, 215, "38;5;62", "48;5;62"),
+        make_color( 95,  95, 255, "38;5;63", "48;5;63"),
+        make_color( 95, 135,   0, "38;5;64", "48;5;64"),
+        make_color( 95, 135,  95, "38;5;65", "48;5;65"),
+        make_color( 95, 135, 135, "38;5;66", "48;5;66"),
+        make_color( 95, 135, 175, "38;5;67", "48;5;67"),
+        make_color( 95, 135, 215, "38;5;68", "48;5;68"),
+        make_color( 95, 135, 255, "38;5;69", "48;5;69"),
+        make_color( 95, 175,   0, "38;5;70", "48;5;70"),
+        make_color( 95, 175,  95, "38;5;71", "48;5;71"),
+        make_color( 95, 175, 135, "38;5;72", "48;5;72"),
+        make_color( 95, 175, 175, "38;5;73", "48;5;73"),
+        make_color( 95, 175, 215, "38;5;74", "48;5;74"),
+        make_color( 95, 175, 255, "38;5;75", "48;5;75"),
+        make_color( 95, 215,   0, "38;5;76", "48;5;76"),
+        make_color( 95, 215,  95, "38;5;77", "48;5;77"),
+        make_color( 95, 215, 135, "38;5;78", "48;5;78"),
+        make_color( 95, 215, 175, "38;5;79", "48;5;79"),
+        make_color( 95, 215, 215, "38;5;80", "48;5;80"),
+        make_color( 95, 215, 255, "38;5;81", "48;5;81"),
+        make_color( 95, 255,   0, "38;5;82", "48;5;82"),
+        make_color( 95, 255,  95, "38;5;83", "48;5;83"),
+        make_color( 95, 255, 135, "38;5;84", "48;5;84"),
+        make_color( 95, 255, 175, "38;5;85", "48;5;85"),
+        make_color( 95, 255, 215, "38;5;86", "48;5;86"),
+        make_color( 95, 255, 255, "38;5;87", "48;5;87"),
+        make_color(135,   0,   0, "38;5;88", "48;5;88"),
+        make_color(135,   0,  95, "38;5;89", "48;5;89"),
+        make_color(135,   0, 135, "38;5;90", "48;5;90"),
+        make_color(135,   0, 175, "38;5;91", "48;5;91"),
+        make_color(135,   0, 215, "38;5;92", "48;5;92"),
+        make_color(135,   0, 255, "38;5;93", "48;5;93"),
+        make_color(135,  95,   0, "38;5;94", "48;5;94"),
+        make_color(135,  95,  95, "38;5;95", "48;5;95"),
+        make_color(135,  95, 135, "38;5;96", "48;5;96"),
+        make_color(135,  95, 175, "38;5;97", "48;5;97"),
+        make_color(135,  95, 215, "38;5;98", "48;5;98"),
+        make_color(135,  95, 255, "38;5;99", "48;5;99"),
+        make_color(135, 135,   0, "38;5;100", "48;5;100"),
+        make_color(135, 135,  95, "38;5;101", "48;5;101"),
+        make_color(135, 135, 135, "38;5;102", "48;5;102"),
+        make_color(135, 135, 175, "38;5;103", "48;5;103"),
+        make_color(135, 135, 215, "38;5;104", "48;5;104"),
+        make_color(135, 135, 255, "38;5;105", "48;5;105"),
+        make_color(135, 175,   0, "38;5;106", "48;5;106"),
+        make_color(135, 175,  95, "38;5;107", "48;5;107"),
+        make_color(135, 175, 135, "38;5;108", "48;5;108"),
+        make_color(135, 175, 175, "38;5;109", "48;5;109"),
+        make_color(135, 175, 215, "38;5;110", "48;5;110"),
+        make_color(135, 175, 255, "38;5;111", "48;5;111"),
+        make_color(135, 215,   0, "38;5;112", "48;5;112"),
+        make_color(135, 215,  95, "38;5;113", "48;5;113"),
+        make_color(135, 215, 135, "38;5;114", "48;5;114"),
+        make_color(135, 215, 175, "38;5;115", "48;5;115"),
+        make_color(135, 215, 215, "38;5;116", "48;5;116"),
+        make_color(135, 215, 255, "38;5;117", "48;5;117"),
+        make_color(135, 255,   0, "38;5;118", "48;5;118"),
+        make_color(135, 255,  95, "38;5;119", "48;5;119"),
+        make_color(135, 255, 135, "38;5;120", "48;5;120"),
+        make_color(135, 255, 175, "38;5;121", "48;5;121"),
+        make_color(135, 255, 215, "38;5;122", "48;5;122"),
+        make_color(135, 255, 255, "38;5;123", "48;5;123"),
+        make_color(175,   0,   0, "38;5;124", "48;5;124"),
+        make_color(175,   0,  95, "38;5;125", "48;5;125"),
+        make_color(175,   0, 135, "38;5;126", "48;5;126"),
+        make_color(175,   0, 175, "38;5;127", "48;5;127"),
+        make_color(175,   0, 215, "38;5;128", "48;5;128"),
+        make_color(175,   0, 255, "38;5;129", "48;5;129"),
+        make_color(175,  95,   0, "38;5;130", "48;5;130"),
+        make_color(175,  95,  95, "38;5;131", "48;5;131"),
+        make_color(175,  95, 135, "38;5;132", "48;5;132"),
+        make_color(175,  95, 175, "38;5;133", "48;5;133"),
+        make_color(175,  95, 215, "38;5;134", "48;5;134"),
+        make_color(175,  95, 255, "38;5;135", "48;5;135"),
+        make_color(175, 135,   0, "38;5;136", "48;5;136"),
+        make_color(175, 135,  95, "38;5;137", "48;5;137"),
+        make_color(175, 135, 135, "38;5;138", "48;5;138"),
+        make_color(175, 135, 175, "38;5;139", "48;5;139"),
+        make_color(175, 135, 215, "38;5;140", "48;5;140"),
+        make_color(175, 135, 255, "38;5;141", "48;5;141"),
+        make_color(175, 175,   0, "38;5;142", "48;5;142"),
+        make_color(175, 175,  95, "38;5;143", "48;5;143"),
+        make_color(175, 175, 135, "38;5;144", "48;5;144"),
+        make_color(175, 175, 175, "38;5;145", "48;5;145"),
+        make_color(175, 175, 215, "38;5;146", "48;5;146"),
+        make_color(175, 175, 255, "38;5;147", "48;5;147"),
+        make_color(175, 215,   0, "38;5;148", "48;5;148"),
+        make_color(175, 215,  95, "38;5;149", "48;5;149"),
+        make_color(175, 215, 135, "38;5;150", "48;5;150"),
+        make_color(175, 215, 175, "38;5;151", "48;5;151"),
+        make_color(175, 215, 215, "38;5;152", "48;5;152"),
+        make_color(175, 215, 255, "38;5;153", "48;5;153"),
+        make_color(175, 255,   0, "38;5;154", "48;5;154"),
+        make_color(175, 255,  95, "38;5;155", "48;5;155"),
+        make_color(175, 255, 135, "38;5;156", "48;5;156"),
+        make_color(175, 255, 175, "38;5;157", "48;5;157"),
+        make_color(175, 255, 215, "38;5;158", "48;5;158"),
+        make_color(175, 255, 255, "38;5;159", "48;5;159"),
+        make_color(215,   0,   0, "38;5;160", "48;5;160"),
+        make_color(215,   0,  95, "38;5;161", "48;5;161"),
+        make_color(215,   0, 135, "38;5;162", "48;5;162"),
+        make_color(215,   0, 175, "38;5;163", "48;5;163"),
+        make_color(215,   0, 215, "38;5;164", "48;5;164"),
+        make_color(215,   0, 255, "38;5;165", "48;5;165"),
+        make_color(215,  95,   0, "38;5;166", "48;5;166"),
+        make_color(215,  95,  95, "38;5;167", "48;5;167"),
+        make_color(215,  95, 135, "38;5;168", "48;5;168"),
+        make_color(215,  95, 175, "38;5;169", "48;5;169"),
+        make_color(215,  95, 215, "38;5;170", "48;5;170"),
+        make_color(215,  95, 255, "38;5;171", "48;5;171"),
+        make_color(215, 135,   0, "38;5;172", "48;5;172"),
+        make_color(215, 135,  95, "38;5;173", "48;5;173"),
+        make_color(215, 135, 135, "38;5;174", "48;5;174"),
+        make_color(215, 135, 175, "38;5;175", "48;5;175"),
+        make_color(215, 135, 215, "38;5;176", "48;5;176"),
+        make_color(215, 135, 255, "38;5;177", "48;5;177"),
+        make_color(215, 175,   0, "38;5;178", "48;5;178"),
+        make_color(215, 175,  95, "38;5;179", "48;5;179"),
+        make_color(215, 175, 135, "38;5;180", "48;5;180"),
+        make_color(215, 175, 175, "38;5;181", "48;5;181"),
+        make_color(215, 175, 215, "38;5;182", "48;5;182"),
+        make_color(215, 175, 255, "38;5;183", "48;5;183"),
+        make_color(215, 215,   0, "38;5;184", "48;5;184"),
+        make_color(215, 215,  95, "38;5;185", "48;5;185"),
+        make_color(215, 215, 135, "38;5;186", "48;5;186"),
+        make_color(215, 215, 175, "38;5;187", "48;5;187"),
+        make_color(215, 215, 215, "38;5;188", "48;5;188"),
+        make_color(215, 215, 255, "38;5;189", "48;5;189"),
+        make_color(215, 255,   0, "38;5;190", "48;5;190"),
+        make_color(215, 255,  95, "38;5;191", "48;5;191"),
+        make_color(215, 255, 135, "38;5;192", "48;5;192"),
+        make_color(215, 255, 175, "38;5;193", "48;5;193"),
+        make_color(215, 255, 215, "38;5;194", "48;5;194"),
+        make_color(215, 255, 255, "38;5;195", "48;5;195"),
+        make_color(255,   0,   0, "38;5;196", "48;5;196"),
+        make_color(255,   0,  95, "38;5;197", "48;5;197"),
+        make_color(255,   0, 135, "38;5;198", "48;5;198"),
+        make_color(255,   0, 175, "38;5;199", "48;5;199"),
+        make_color(255,   0, 215, "38;5;200", "48;5;200"),
+        make_color(255,   0, 255, "38;5;201", "48;5;201"),
+        make_color(255,  95,   0, "38;5;202", "48;5;202"),
+        make_color(255,  95,  95, "38;5;203", "48;5;203"),
+        make_color(255,  95, 135, "38;5;204", "48;5;204"),
+        make_color(255,  95, 175, "38;5;205", "48;5;205"),
+        make_color(255,  95, 215, "38;5;206", "48;5;206"),
+        make_color(255,  95, 255, "38;5;207", "48;5;207"),
+        make_color(255, 135,   0, "38;5;208", "48;5;208"),
+        make_color(255, 135,  95, "38;5;209", "48;5;209"),
+        make_color(255, 135, 135, "38;5;210", "48;5;210"),
+        make_color(255, 135, 175, "38;5;211", "48;5;211"),
+        make_color(255, 135, 215, "38;5;212", "48;5;212"),
+        make_color(255, 135, 255, "38;5;213", "48;5;213"),
+        make_color(255, 175,   0, "38;5;214", "48;5;214"),
+        make_color(255, 175,  95, "38;5;215", "48;5;215"),
+        make_color(255, 175, 135, "38;5;216", "48;5;216"),
+        make_color(255, 175, 175, "38;5;217", "48;5;217"),
+        make_color(255, 175, 215, "38;5;218", "48;5;218"),
+        make_color(255, 175, 255, "38;5;219", "48;5;219"),
+        make_color(255, 215,   0, "38;5;220", "48;5;220"),
+        make_color(255, 215,  95, "38;5;221", "48;5;221"),
+        make_color(255, 215, 135, "38;5;222", "48;5;222"),
+        make_color(255, 215, 175, "38;5;223", "48;5;223"),
+        make_color(255, 215, 215, "38;5;224", "48;5;224"),
+        make_color(255, 215, 255, "38;5;225", "48;5;225"),
+        make_color(255, 255,   0, "38;5;226", "48;5;226"),
+        make_color(255, 255,  95, "38;5;227", "48;5;227"),
+        make_color(255, 255, 135, "38;5;228", "48;5;228"),
+        make_color(255, 255, 175, "38;5;229", "48;5;229"),
+        make_color(255, 255, 215, "38;5;230", "48;5;230"),
+        make_color(255, 255, 255, "38;5;231", "48;5;231"),
+        make_color(  8,   8,   8, "38;5;232", "48;5;232"),
+        make_color( 18,  18,  18, "38;5;233", "48;5;233"),
+        make_color( 28,  28,  28, "38;5;234", "48;5;234"),
+        make_color( 38,  38,  38, "38;5;235", "48;5;235"),
+        make_color( 48,  48,  48, "38;5;236", "48;5;236"),
+        make_color( 58,  58,  58, "38;5;237", "48;5;237"),
+        make_color( 68,  68,  68, "38;5;238", "48;5;238"),
+        make_color( 78,  78,  78, "38;5;239", "48;5;239"),
+        make_color( 88,  88,  88, "38;5;240", "48;5;240"),
+        make_color( 98,  98,  98, "38;5;241", "48;5;241"),
+        make_color(108, 108, 108, "38;5;242", "48;5;242"),
+        make_color(118, 118, 118, "38;5;243", "48;5;243"),
+        make_color(128, 128, 128, "38;5;244", "48;5;244"),
+        make_color(138, 138, 138, "38;5;245", "48;5;245"),
+        make_color(148, 148, 148, "38;5;246", "48;5;246"),
+        make_color(158, 158, 158, "38;5;247", "48;5;247"),
+        make_color(168, 168, 168, "38;5;248", "48;5;248"),
+        make_color(178, 178, 178, "38;5;249", "48;5;249"),
+        make_color(188, 188, 188, "38;5;250", "48;5;250"),
+        make_color(198, 198, 198, "38;5;251", "48;5;251"),
+        make_color(208, 208, 208, "38;5;252", "48;5;252"),
+        make_color(218, 218, 218, "38;5;253", "48;5;253"),
+        make_color(228, 228, 228, "38;5;254", "48;5;254"),
+        make_color(238, 238, 238, "38;5;255", "48;5;255"),
+    };
+    static_assert(array_size(colors) == 247, "Unexpected palette size");
+    static_assert(check_extended(colors), "Mismatched palette codes");
+    static_assert(matches_reference(colors, reference_palette256), "Palette differs from the QColor built one");
+
+    static constexpr EscPalette pal("256", colors, array_size(colors));
     return &pal;
 }
 
 const EscPalette *EscPalette::TrueColor()
 {
-    static EscPalette pal;
-    if (!pal.isCompiled()) {
-        pal.m_state = _TrueColor;
+    static constexpr EscPalette pal("true", Q_NULLPTR, 0);
+    return &pal;
+}
+
+QVector<const EscPalette *> EscPalette::builtins()
+{
+    return { Palette8(), Palette16(), Palette88(), Palette256(), TrueColor() };
+}
+
+const EscPalette *EscPalette::Remapped(const QVector<QColor> &colors,
+                                       QByteArray *setup, QByteArray *restore)
+{
+    // Like the built-in tables, this has to outlive every highlighter using
+    // it, so it is never freed.
+    struct RemapTable
+    {
+        std::vector<QByteArray> m_codes;
+        std::vector<ColorCode> m_colors;
+    };
+    auto table = new RemapTable;
+
+    QVector<QRgb> slotColors;
+    for (const QColor &color : colors) {
+        const QRgb rgb = color.rgb();
+        if (!slotColors.contains(rgb) && slotColors.size() < MaxRemapSlots)
+            slotColors.append(rgb);
     }
 
-    return &pal;
+    // The remapped entries go first, so an exact match always wins over a
+    // standard entry at the same lookup position
+    const int firstSlot = 256 - slotColors.size();
+    table->m_codes.reserve(slotColors.size() * 2);
+    for (int i = 0; i < slotColors.size(); ++i) {
+        const int slot = firstSlot + i;
+        const QRgb rgb = slotColors.at(i);
+        table->m_codes.push_back("38;5;" + QByteArray::number(slot));
+        table->m_codes.push_back("48;5;" + QByteArray::number(slot));
+        table->m_colors.push_back(make_color(qRed(rgb), qGreen(rgb), qBlue(rgb),
+                                             table->m_codes[2 * i].constData(),
+                                             table->m_codes[2 * i + 1].constData()));
+
+        char buffer[48];
+        snprintf(buffer, sizeof(buffer), "\033]4;%d;rgb:%02x/%02x/%02x\033\\",
+                 slot, qRed(rgb), qGreen(rgb), qBlue(rgb));
+        setup->append(buffer);
+        snprintf(buffer, sizeof(buffer), "\033]104;%d\033\\", slot);
+        restore->append(buffer);
+    }
+
+    // Anything outside the theme still gets the rest of the standard palette
+    const EscPalette *standard = Palette256();
+    for (int i = 0; i < standard->m_count; ++i) {
+        if (extended_index(standard->m_colors[i].m_foreFormat) < firstSlot)
+            table->m_colors.push_back(standard->m_colors[i]);
+    }
+
+    return new EscPalette("remap", table->m_colors.data(),
+                          static_cast<int>(table->m_colors.size()));
 }
 
 QByteArray EscPalette::foreground(const QColor &color) const
 {
-    if (m_state == _TrueColor) {
+    if (isTrueColor()) {
         char buffer[24];
         snprintf(buffer, sizeof(buffer), "38;2;%d;%d;%d",
                  color.red(), color.green(), color.blue());
         return buffer;
     }
 
-    ColorCode closestColor = findClosest(color);
-    return closestColor.m_foreFormat;
+    const char *code = m_colors[closestIndex(color)].m_foreFormat;
+    return QByteArray::fromRawData(code, static_cast<int>(strlen(code)));
 }
 
 QByteArray EscPalette::background(const QColor &color) const
 {
-    if (m_state == _TrueColor) {
+    if (isTrueColor()) {
         char buffer[24];
         snprintf(buffer, sizeof(buffer), "48;2;%d;%d;%d",
                  color.red(), color.green(), color.blue());
         return buffer;
     }
 
-    ColorCode closestColor = findClosest(color);
-    return closestColor.m_backFormat;
+    const char *code = m_colors[closestIndex(color)].m_backFormat;
+    return QByteArray::fromRawData(code, static_cast<int>(strlen(code)));
 }
 
-/* HSL space seems to give "good enough" results with minimal performance
- * impact.  However, I left the others in here in case someone wants to
- * experiment with lookups in other color spaces for whatever reason.
- */
-#define lookup_space hsl_space
+QColor EscPalette::color(int index) const
+{
+    const ColorCode &code = m_colors[index];
+    return QColor(code.m_red, code.m_green, code.m_blue);
+}
 
-inline void qcolor_to_hsl(const QColor &color, float &h, float &s, float &l)
+static std::array<float, 3> hsl_space(const QColor &color)
 {
-#if QT_VERSION_MAJOR >= 6
-    color.getHslF(&h, &s, &l);
-#else
-    qreal h_, s_, l_;
-    color.getHslF(&h_, &s_, &l_);
-    h = static_cast<float>(h_);
-    s = static_cast<float>(s_);
-    l = static_cast<float>(l_);
-#endif
+    const auto point = runtime_hsl_point(color);
+    return {point.m_x, point.m_y, point.m_z};
 }
 
 inline void qcolor_to_rgb(const QColor &color, float &r, float &g, float &b)
@@ -517,24 +797,6 @@ inline void qcolor_to_rgb(const QColor &color, float &r, float &g, float &b)
 #endif
 }
 
-static std::array<float, 3> hsl_space(const QColor &color)
-{
-    float h, s, l;
-    qcolor_to_hsl(color, h, s, l);
-    if (h < -0.99) {
-        // Qt returns -1.0 for anything along the grayscale spectrum, and
-        // [0,1) for non-gray values... In order to make grayish colors less
-        // likely to show up as random reds and browns, we move it closer to
-        // the rest of the color space.
-        h = 0;
-    }
-
-    const auto x = s * std::cos(2.0f * h * float(M_PI));
-    const auto y = s * std::sin(2.0f * h * float(M_PI));
-    const auto z = (2.0f * l) - 1.0f;
-    return {x, y, z};
-}
-
 static std::array<float, 3> rgb_space(const QColor &color)
 {
     float r, g, b;
@@ -577,30 +839,71 @@ static std::array<float, 3> lab_space(const QColor &color)
              200.0f * (xyz[1] - xyz[2]) };
 }
 
-void EscPalette::compile(const QVector<ColorCode> &colors)
+static float space_dist(const std::array<float, 3> &src_pt,
+                        const std::array<float, 3> &dest_pt)
 {
-    m_colors = colors;
-    m_state = _Compiled;
+    return std::hypot(std::hypot(src_pt[0] - dest_pt[0], src_pt[1] - dest_pt[1]),
+                      src_pt[2] - dest_pt[2]);
 }
 
-static float color_dist(const QColor &src, const QColor &dest)
+float EscPalette::distance(const QColor &src, const QColor &dest, ColorSpace space)
 {
-    const auto src_pt = lookup_space(src);
-    const auto dest_pt = lookup_space(dest);
-    return std::hypot(std::hypot(src_pt[0] - dest_pt[0], src_pt[1] - dest_pt[1]),
-                      src_pt[2] - dest_pt[2]);
+    switch (space) {
+    case HslSpace:
+        return space_dist(hsl_space(src), hsl_space(dest));
+    case RgbSpace:
+        return space_dist(rgb_space(src), rgb_space(dest));
+    case LabSpace:
+        return space_dist(lab_space(src), lab_space(dest));
+    }
+    return std::numeric_limits<float>::infinity();
 }
 
-EscPalette::ColorCode EscPalette::findClosest(const QColor &ref) const
+int EscPalette::closestIndex(const QColor &ref) const
 {
-    float closestDist = std::numeric_limits<float>::infinity();
+    // The palette entries' positions are precomputed, so only the reference
+    // color needs converting.  Comparing squared distances is enough to
+    // find the closest one, except for near-ties: those are settled with
+    // the same single precision hypot() the QColor based lookups used, so
+    // the choice doesn't depend on rounding in the faster comparison.
+    const LookupPoint refPoint = runtime_hsl_point(ref);
+    auto squaredDist = [&refPoint](const LookupPoint &point) {
+        const float dx = refPoint.m_x - point.m_x;
+        const float dy = refPoint.m_y - point.m_y;
+        const float dz = refPoint.m_z - point.m_z;
+        return (dx * dx) + (dy * dy) + (dz * dz);
+    };
+
+    float closestSquared = std::numeric_limits<float>::infinity();
+    float runnerUpSquared = closestSquared;
     int closest = -1;
-    for (int i = 0; i < m_colors.size(); ++i) {
-        float dist = color_dist(ref, m_colors[i].m_color);
-        if (dist < closestDist) {
+    for (int i = 0; i < m_count; ++i) {
+        const float dist = squaredDist(m_colors[i].m_point);
+        if (dist < closestSquared) {
             closest = i;
-            closestDist = dist;
+            runnerUpSquared = closestSquared;
+            closestSquared = dist;
+        } else if (dist < runnerUpSquared) {
+            runnerUpSquared = dist;
+        }
+    }
+
+    const float limit = closestSquared * 1.0001f;
+    if (runnerUpSquared <= limit) {
+        float closestDist = std::numeric_limits<float>::infinity();
+        for (int i = 0; i < m_count; ++i) {
+            const LookupPoint &point = m_colors[i].m_point;
+            if (squaredDist(point) > limit)
+                continue;
+            const float dist = std::hypot(std::hypot(refPoint.m_x - point.m_x,
+                                                     refPoint.m_y - point.m_y),
+                                          refPoint.m_z - point.m_z);
+            if (dist < closestDist) {
+                closest = i;
+                closestDist = dist;
+            }
         }
     }
-    return m_colors[closest];
+    SRCCAT_PROBE(palette_lookup, ref.rgb() & 0xffffff, closest);
+    return closest;
 }
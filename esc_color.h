@@ -31,32 +31,59 @@ public:
     static const EscPalette *Palette256();
     static const EscPalette *TrueColor();
 
+    // All of the above, from the fewest colors to true color
+    static QVector<const EscPalette *> builtins();
+
+    /* A 256 color palette with its top slots reassigned to exactly the given
+     * colors (up to MaxRemapSlots of them).  setup receives the OSC 4
+     * sequences that program those slots into the terminal, and restore the
+     * OSC 104 sequences that reset them to the terminal's defaults. */
+    static const EscPalette *Remapped(const QVector<QColor> &colors,
+                                      QByteArray *setup, QByteArray *restore);
+    enum { MaxRemapSlots = 64 };
+
     QByteArray foreground(const QColor &color) const;
     QByteArray background(const QColor &color) const;
 
-private:
-    EscPalette() : m_state(_Initializing) { }
+    // Introspection, mainly for checking the quality of the quantization
+    enum ColorSpace
+    {
+        HslSpace,
+        RgbSpace,
+        LabSpace,
+    };
 
-    enum _PaletteState
+    // The --colors value that selects this palette
+    const char *name() const { return m_name; }
+
+    bool isTrueColor() const { return m_colors == Q_NULLPTR; }
+    int colorCount() const { return m_count; }
+    QColor color(int index) const;
+    int closestIndex(const QColor &ref) const;
+
+    static float distance(const QColor &src, const QColor &dest, ColorSpace space);
+
+    // Palette tables are generated at compile time; see esc_color.cpp
+    struct LookupPoint
     {
-        _Initializing,
-        _Compiled,
-        _TrueColor,
+        float m_x, m_y, m_z;
     };
-    _PaletteState m_state;
 
     struct ColorCode
     {
-        QColor m_color;
-        QByteArray m_foreFormat;
-        QByteArray m_backFormat;
+        unsigned char m_red, m_green, m_blue;
+        const char *m_foreFormat;
+        const char *m_backFormat;
+        LookupPoint m_point;
     };
-    QVector<ColorCode> m_colors;
 
-    bool isCompiled() const { return m_state != _Initializing; }
-    void compile(const QVector<ColorCode> &colors);
+private:
+    constexpr EscPalette(const char *name, const ColorCode *colors, int count)
+        : m_name(name), m_colors(colors), m_count(count) { }
 
-    ColorCode findClosest(const QColor &ref) const;
+    const char *m_name;
+    const ColorCode *m_colors;
+    int m_count;
 };
 
 #endif
@@ -0,0 +1,402 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ESC_COLOR_REFERENCE_H
+#define _ESC_COLOR_REFERENCE_H
+
+/* The palettes as they were built at runtime through QColor, before the
+ * tables in esc_color.cpp were generated at compile time.  Only used by
+ * the static_asserts there, which check that the generated colors, codes
+ * and lookup positions still match these.
+ *
+ * The positions are EscPalette's old hsl_space() of each color, i.e.
+ * QColor::getHslF() followed by std::cos() and std::sin() in float. */
+
+struct ReferenceColor
+{
+    int m_red, m_green, m_blue;
+    const char *m_foreFormat;
+    const char *m_backFormat;
+    float m_x, m_y, m_z;
+};
+
+static constexpr ReferenceColor reference_palette8[] = {
+    {   0,   0,   0, "30",       "40",       0.0f,            0.0f,            -1.0f },
+    { 128,   0,   0, "31",       "41",       1.0f,            0.0f,            -0.498039186f },
+    {   0, 128,   0, "32",       "42",       -0.50000006f,    0.866025388f,    -0.498039186f },
+    { 128, 128,   0, "33",       "43",       0.49999997f,     0.866025448f,    -0.498039186f },
+    {   0,   0, 128, "34",       "44",       -0.499999911f,   -0.866025448f,   -0.498039186f },
+    { 128,   0, 128, "35",       "45",       0.499999911f,    -0.866025448f,   -0.498039186f },
+    {   0, 128, 128, "36",       "46",       -1.0f,           -8.74227766e-08f, -0.498039186f },
+    { 192, 192, 192, "37",       "47",       0.0f,            0.0f,            0.505882382f },
+    { 128, 128, 128, "1;30",     "",         0.0f,            0.0f,            0.003921628f },
+    { 255,   0,   0, "1;31",     "",         1.0f,            0.0f,            1.52587891e-05f },
+    {   0, 255,   0, "1;32",     "",         -0.50000006f,    0.866025388f,    1.52587891e-05f },
+    { 255, 255,   0, "1;33",     "",         0.49999997f,     0.866025448f,    1.52587891e-05f },
+    {   0,   0, 255, "1;34",     "",         -0.499999911f,   -0.866025448f,   1.52587891e-05f },
+    { 255,   0, 255, "1;35",     "",         0.499999911f,    -0.866025448f,   1.52587891e-05f },
+    {   0, 255, 255, "1;36",     "",         -1.0f,           -8.74227766e-08f, 1.52587891e-05f },
+    { 255, 255, 255, "1;37",     "",         0.0f,            0.0f,            1.0f },
+};
+
+static constexpr ReferenceColor reference_palette16[] = {
+    {   0,   0,   0, "30",       "40",       0.0f,            0.0f,            -1.0f },
+    { 205,   0,   0, "31",       "41",       1.0f,            0.0f,            -0.196063161f },
+    {   0, 205,   0, "32",       "42",       -0.50000006f,    0.866025388f,    -0.196063161f },
+    { 205, 205,   0, "33",       "43",       0.49999997f,     0.866025448f,    -0.196063161f },
+    {   0,   0, 238, "34",       "44",       -0.499999911f,   -0.866025448f,   -0.0666666627f },
+    { 205,   0, 205, "35",       "45",       0.499999911f,    -0.866025448f,   -0.196063161f },
+    {   0, 205, 205, "36",       "46",       -1.0f,           -8.74227766e-08f, -0.196063161f },
+    { 229, 229, 229, "37",       "47",       0.0f,            0.0f,            0.796078444f },
+    { 127, 127, 127, "90",       "100",      0.0f,            0.0f,            -0.00392156839f },
+    { 255,   0,   0, "91",       "101",      1.0f,            0.0f,            1.52587891e-05f },
+    {   0, 255,   0, "92",       "102",      -0.50000006f,    0.866025388f,    1.52587891e-05f },
+    { 255, 255,   0, "93",       "103",      0.49999997f,     0.866025448f,    1.52587891e-05f },
+    {  92,  92, 255, "94",       "104",      -0.499999911f,   -0.866025448f,   0.360799551f },
+    { 255,   0, 255, "95",       "105",      0.499999911f,    -0.866025448f,   1.52587891e-05f },
+    {   0, 255, 255, "96",       "106",      -1.0f,           -8.74227766e-08f, 1.52587891e-05f },
+    { 255, 255, 255, "97",       "107",      0.0f,            0.0f,            1.0f },
+};
+
+static constexpr ReferenceColor reference_palette88[] = {
+    { 229, 229, 229, "38;5;7",   "48;5;7",   0.0f,            0.0f,            0.796078444f },
+    {  77,  77,  77, "38;5;8",   "48;5;8",   0.0f,            0.0f,            -0.396078408f },
+    {   0,   0,   0, "38;5;16",  "48;5;16",  0.0f,            0.0f,            -1.0f },
+    {   0,   0, 139, "38;5;17",  "48;5;17",  -0.499999911f,   -0.866025448f,   -0.454886675f },
+    {   0,   0, 205, "38;5;18",  "48;5;18",  -0.499999911f,   -0.866025448f,   -0.196063161f },
+    {   0,   0, 255, "38;5;19",  "48;5;19",  -0.499999911f,   -0.866025448f,   1.52587891e-05f },
+    {   0, 139,   0, "38;5;20",  "48;5;20",  -0.50000006f,    0.866025388f,    -0.454886675f },
+    {   0, 139, 139, "38;5;21",  "48;5;21",  -1.0f,           -8.74227766e-08f, -0.454886675f },
+    {   0, 139, 205, "38;5;22",  "48;5;22",  -0.943685532f,   -0.330843836f,   -0.196063161f },
+    {   0, 139, 255, "38;5;23",  "48;5;23",  -0.888697267f,   -0.458494425f,   1.52587891e-05f },
+    {   0, 205,   0, "38;5;24",  "48;5;24",  -0.50000006f,    0.866025388f,    -0.196063161f },
+    {   0, 205, 139, "38;5;25",  "48;5;25",  -0.943685472f,   0.330843896f,    -0.196063161f },
+    {   0, 205, 205, "38;5;26",  "48;5;26",  -1.0f,           -8.74227766e-08f, -0.196063161f },
+    {   0, 205, 255, "38;5;27",  "48;5;27",  -0.979009867f,   -0.203812733f,   1.52587891e-05f },
+    {   0, 255,   0, "38;5;28",  "48;5;28",  -0.50000006f,    0.866025388f,    1.52587891e-05f },
+    {   0, 255, 139, "38;5;29",  "48;5;29",  -0.888697386f,   0.458494276f,    1.52587891e-05f },
+    {   0, 255, 205, "38;5;30",  "48;5;30",  -0.979009926f,   0.203812554f,    1.52587891e-05f },
+    {   0, 255, 255, "38;5;31",  "48;5;31",  -1.0f,           -8.74227766e-08f, 1.52587891e-05f },
+    { 139,   0,   0, "38;5;32",  "48;5;32",  1.0f,            0.0f,            -0.454886675f },
+    { 139,   0, 139, "38;5;33",  "48;5;33",  0.499999911f,    -0.866025448f,   -0.454886675f },
+    { 139,   0, 205, "38;5;34",  "48;5;34",  0.18532382f,     -0.982677519f,   -0.196063161f },
+    { 139,   0, 255, "38;5;35",  "48;5;35",  0.0472808108f,   -0.998881638f,   1.52587891e-05f },
+    { 139, 139,   0, "38;5;36",  "48;5;36",  0.49999997f,     0.866025448f,    -0.454886675f },
+    { 139, 139, 139, "38;5;37",  "48;5;37",  0.0f,            0.0f,            0.0901961327f },
+    { 139, 139, 205, "38;5;38",  "48;5;38",  -0.198794514f,   -0.344322264f,   0.349019647f },
+    { 139, 139, 255, "38;5;39",  "48;5;39",  -0.499999911f,   -0.866025448f,   0.545098066f },
+    { 139, 205,   0, "38;5;40",  "48;5;40",  0.185323536f,    0.982677579f,    -0.196063161f },
+    { 139, 205, 139, "38;5;41",  "48;5;41",  -0.198794574f,   0.344322234f,    0.349019647f },
+    { 139, 205, 205, "38;5;42",  "48;5;42",  -0.397589087f,   -3.47583402e-08f, 0.349019647f },
+    { 139, 205, 255, "38;5;43",  "48;5;43",  -0.899862468f,   -0.436173707f,   0.545098066f },
+    { 139, 255,   0, "38;5;44",  "48;5;44",  0.0472807549f,   0.998881638f,    1.52587891e-05f },
+    { 139, 255, 139, "38;5;45",  "48;5;45",  -0.50000006f,    0.866025388f,    0.545098066f },
+    { 139, 255, 205, "38;5;46",  "48;5;46",  -0.899862587f,   0.436173558f,    0.545098066f },
+    { 139, 255, 255, "38;5;47",  "48;5;47",  -1.0f,           -8.74227766e-08f, 0.545098066f },
+    { 205,   0,   0, "38;5;48",  "48;5;48",  1.0f,            0.0f,            -0.196063161f },
+    { 205,   0, 139, "38;5;49",  "48;5;49",  0.758361936f,    -0.651833653f,   -0.196063161f },
+    { 205,   0, 205, "38;5;50",  "48;5;50",  0.499999911f,    -0.866025448f,   -0.196063161f },
+    { 205,   0, 255, "38;5;51",  "48;5;51",  0.312998384f,    -0.949753642f,   1.52587891e-05f },
+    { 205, 139,   0, "38;5;52",  "48;5;52",  0.758361936f,    0.651833713f,    -0.196063161f },
+    { 205, 139, 139, "38;5;53",  "48;5;53",  0.397589087f,    0.0f,            0.349019647f },
+    { 205, 139, 205, "38;5;54",  "48;5;54",  0.198794514f,    -0.344322264f,   0.349019647f },
+    { 205, 139, 255, "38;5;55",  "48;5;55",  0.0721937194f,   -0.997390628f,   0.545098066f },
+    { 205, 205,   0, "38;5;56",  "48;5;56",  0.49999997f,     0.866025448f,    -0.196063161f },
+    { 205, 205, 139, "38;5;57",  "48;5;57",  0.198794529f,    0.344322264f,    0.349019647f },
+    { 205, 205, 205, "38;5;58",  "48;5;58",  0.0f,            0.0f,            0.607843161f },
+    { 205, 205, 255, "38;5;59",  "48;5;59",  -0.499999911f,   -0.866025448f,   0.80392158f },
+    { 205, 255,   0, "38;5;60",  "48;5;60",  0.312997997f,    0.949753761f,    1.52587891e-05f },
+    { 205, 255, 139, "38;5;61",  "48;5;61",  0.0721937791f,   0.997390628f,    0.545098066f },
+    { 205, 255, 205, "38;5;62",  "48;5;62",  -0.50000006f,    0.866025388f,    0.80392158f },
+    { 205, 255, 255, "38;5;63",  "48;5;63",  -1.0f,           -8.74227766e-08f, 0.80392158f },
+    { 255,   0,   0, "38;5;64",  "48;5;64",  1.0f,            0.0f,            1.52587891e-05f },
+    { 255,   0, 139, "38;5;65",  "48;5;65",  0.841416597f,    -0.540386975f,   1.52587891e-05f },
+    { 255,   0, 205, "38;5;66",  "48;5;66",  0.66601181f,     -0.745941222f,   1.52587891e-05f },
+    { 255,   0, 255, "38;5;67",  "48;5;67",  0.499999911f,    -0.866025448f,   1.52587891e-05f },
+    { 255, 139,   0, "38;5;68",  "48;5;68",  0.841416478f,    0.540387213f,    1.52587891e-05f },
+    { 255, 139, 139, "38;5;69",  "48;5;69",  1.0f,            0.0f,            0.545098066f },
+    { 255, 139, 205, "38;5;70",  "48;5;70",  0.827668905f,    -0.561216652f,   0.545098066f },
+    { 255, 139, 255, "38;5;71",  "48;5;71",  0.499999911f,    -0.866025448f,   0.545098066f },
+    { 255, 205,   0, "38;5;72",  "48;5;72",  0.66601181f,     0.745941162f,    1.52587891e-05f },
+    { 255, 205, 139, "38;5;73",  "48;5;73",  0.827668667f,    0.56121701f,     0.545098066f },
+    { 255, 205, 205, "38;5;74",  "48;5;74",  1.0f,            0.0f,            0.80392158f },
+    { 255, 205, 255, "38;5;75",  "48;5;75",  0.499999911f,    -0.866025448f,   0.80392158f },
+    { 255, 255,   0, "38;5;76",  "48;5;76",  0.49999997f,     0.866025448f,    1.52587891e-05f },
+    { 255, 255, 139, "38;5;77",  "48;5;77",  0.49999997f,     0.866025448f,    0.545098066f },
+    { 255, 255, 205, "38;5;78",  "48;5;78",  0.49999997f,     0.866025448f,    0.80392158f },
+    { 255, 255, 255, "38;5;79",  "48;5;79",  0.0f,            0.0f,            1.0f },
+    {  46,  46,  46, "38;5;80",  "48;5;80",  0.0f,            0.0f,            -0.639215708f },
+    {  92,  92,  92, "38;5;81",  "48;5;81",  0.0f,            0.0f,            -0.278431356f },
+    { 115, 115, 115, "38;5;82",  "48;5;82",  0.0f,            0.0f,            -0.0980392098f },
+    { 139, 139, 139, "38;5;83",  "48;5;83",  0.0f,            0.0f,            0.0901961327f },
+    { 162, 162, 162, "38;5;84",  "48;5;84",  0.0f,            0.0f,            0.270588279f },
+    { 185, 185, 185, "38;5;85",  "48;5;85",  0.0f,            0.0f,            0.450980425f },
+    { 208, 208, 208, "38;5;86",  "48;5;86",  0.0f,            0.0f,            0.631372571f },
+    { 231, 231, 231, "38;5;87",  "48;5;87",  0.0f,            0.0f,            0.811764717f },
+};
+
+static constexpr ReferenceColor reference_palette256[] = {
+    { 128,   0,   0, "38;5;1",   "48;5;1",   1.0f,            0.0f,            -0.498039186f },
+    {   0, 128,   0, "38;5;2",   "48;5;2",   -0.50000006f,    0.866025388f,    -0.498039186f },
+    { 128, 128,   0, "38;5;3",   "48;5;3",   0.49999997f,     0.866025448f,    -0.498039186f },
+    {   0,   0, 128, "38;5;4",   "48;5;4",   -0.499999911f,   -0.866025448f,   -0.498039186f },
+    { 128,   0, 128, "38;5;5",   "48;5;5",   0.499999911f,    -0.866025448f,   -0.498039186f },
+    {   0, 128, 128, "38;5;6",   "48;5;6",   -1.0f,           -8.74227766e-08f, -0.498039186f },
+    { 192, 192, 192, "38;5;7",   "48;5;7",   0.0f,            0.0f,            0.505882382f },
+    {   0,   0,   0, "38;5;16",  "48;5;16",  0.0f,            0.0f,            -1.0f },
+    {   0,   0,  95, "38;5;17",  "48;5;17",  -0.499999911f,   -0.866025448f,   -0.627435684f },
+    {   0,   0, 135, "38;5;18",  "48;5;18",  -0.499999911f,   -0.866025448f,   -0.470572948f },
+    {   0,   0, 175, "38;5;19",  "48;5;19",  -0.499999911f,   -0.866025448f,   -0.313710213f },
+    {   0,   0, 215, "38;5;20",  "48;5;20",  -0.499999911f,   -0.866025448f,   -0.156847477f },
+    {   0,   0, 255, "38;5;21",  "48;5;21",  -0.499999911f,   -0.866025448f,   1.52587891e-05f },
+    {   0,  95,   0, "38;5;22",  "48;5;22",  -0.50000006f,    0.866025388f,    -0.627435684f },
+    {   0,  95,  95, "38;5;23",  "48;5;23",  -1.0f,           -8.74227766e-08f, -0.627435684f },
+    {   0,  95, 135, "38;5;24",  "48;5;24",  -0.952236056f,   -0.30536291f,    -0.470572948f },
+    {   0,  95, 175, "38;5;25",  "48;5;25",  -0.887574136f,   -0.460664839f,   -0.313710213f },
+    {   0,  95, 215, "38;5;26",  "48;5;26",  -0.83398205f,    -0.551791549f,   -0.156847477f },
+    {   0,  95, 255, "38;5;27",  "48;5;27",  -0.791756868f,   -0.610836387f,   1.52587891e-05f },
+    {   0, 135,   0, "38;5;28",  "48;5;28",  -0.50000006f,    0.866025388f,    -0.470572948f },
+    {   0, 135,  95, "38;5;29",  "48;5;29",  -0.952236116f,   0.305362731f,    -0.470572948f },
+    {   0, 135, 135, "38;5;30",  "48;5;30",  -1.0f,           -8.74227766e-08f, -0.470572948f },
+    {   0, 135, 175, "38;5;31",  "48;5;31",  -0.971507788f,   -0.237007678f,   -0.313710213f },
+    {   0, 135, 215, "38;5;32",  "48;5;32",  -0.92501092f,    -0.37994051f,    -0.156847477f },
+    {   0, 135, 255, "38;5;33",  "48;5;33",  -0.880973339f,   -0.47316584f,    1.52587891e-05f },
+    {   0, 175,   0, "38;5;34",  "48;5;34",  -0.50000006f,    0.866025388f,    -0.313710213f },
+    {   0, 175,  95, "38;5;35",  "48;5;35",  -0.887574375f,   0.460664481f,    -0.313710213f },
+    {   0, 175, 135, "38;5;36",  "48;5;36",  -0.971507788f,   0.237007737f,    -0.313710213f },
+    {   0, 175, 175, "38;5;37",  "48;5;37",  -1.0f,           -8.74227766e-08f, -0.313710213f },
+    {   0, 175, 215, "38;5;38",  "48;5;38",  -0.981090486f,   -0.193549722f,   -0.156847477f },
+    {   0, 175, 255, "38;5;39",  "48;5;39",  -0.946536601f,   -0.322596401f,   1.52587891e-05f },
+    {   0, 215,   0, "38;5;40",  "48;5;40",  -0.50000006f,    0.866025388f,    -0.156847477f },
+    {   0, 215,  95, "38;5;41",  "48;5;41",  -0.83398217f,    0.55179137f,     -0.156847477f },
+    {   0, 215, 135, "38;5;42",  "48;5;42",  -0.92501092f,    0.379940569f,    -0.156847477f },
+    {   0, 215, 175, "38;5;43",  "48;5;43",  -0.981090546f,   0.19354932f,     -0.156847477f },
+    {   0, 215, 215, "38;5;44",  "48;5;44",  -1.0f,           -8.74227766e-08f, -0.156847477f },
+    {   0, 215, 255, "38;5;45",  "48;5;45",  -0.986543596f,   -0.163498342f,   1.52587891e-05f },
+    {   0, 255,   0, "38;5;46",  "48;5;46",  -0.50000006f,    0.866025388f,    1.52587891e-05f },
+    {   0, 255,  95, "38;5;47",  "48;5;47",  -0.791756988f,   0.610836208f,    1.52587891e-05f },
+    {   0, 255, 135, "38;5;48",  "48;5;48",  -0.880973339f,   0.4731659f,      1.52587891e-05f },
+    {   0, 255, 175, "38;5;49",  "48;5;49",  -0.94653672f,    0.322596014f,    1.52587891e-05f },
+    {   0, 255, 215, "38;5;50",  "48;5;50",  -0.986543655f,   0.163498178f,    1.52587891e-05f },
+    {   0, 255, 255, "38;5;51",  "48;5;51",  -1.0f,           -8.74227766e-08f, 1.52587891e-05f },
+    {  95,   0,   0, "38;5;52",  "48;5;52",  1.0f,            0.0f,            -0.627435684f },
+    {  95,   0,  95, "38;5;53",  "48;5;53",  0.499999911f,    -0.866025448f,   -0.627435684f },
+    {  95,   0, 135, "38;5;54",  "48;5;54",  0.211665988f,    -0.977342069f,   -0.470572948f },
+    {  95,   0, 175, "38;5;55",  "48;5;55",  0.04484009f,     -0.998994172f,   -0.313710213f },
+    {  95,   0, 215, "38;5;56",  "48;5;56",  -0.0608744621f,  -0.998145401f,   -0.156847477f },
+    {  95,   0, 255, "38;5;57",  "48;5;57",  -0.133121386f,   -0.991099715f,   1.52587891e-05f },
+    {  95,  95,   0, "38;5;58",  "48;5;58",  0.49999997f,     0.866025448f,    -0.627435684f },
+    {  95,  95,  95, "38;5;59",  "48;5;59",  0.0f,            0.0f,            -0.254901946f },
+    {  95,  95, 135, "38;5;60",  "48;5;60",  -0.0869535208f,  -0.150607944f,   -0.0980392098f },
+    {  95,  95, 175, "38;5;61",  "48;5;61",  -0.166666642f,   -0.288675159f,   0.0588235855f },
+    {  95,  95, 215, "38;5;62",  "48;5;62",  -0.299999952f,   -0.519615293f,   0.215686321f },
+    {  95,  95, 255, "38;5;63",  "48;5;63",  -0.499999911f,   -0.866025448f,   0.372549057f },
+    {  95, 135,   0, "38;5;64",  "48;5;64",  0.211665943f,    0.977342069f,    -0.470572948f },
+    {  95, 135,  95, "38;5;65",  "48;5;65",  -0.0869535431f,  0.150607944f,    -0.0980392098f },
+    {  95, 135, 135, "38;5;66",  "48;5;66",  -0.173907071f,   -1.52034385e-08f, -0.0980392098f },
+    {  95, 135, 175, "38;5;67",  "48;5;67",  -0.288675129f,   -0.166666657f,   0.0588235855f },
+    {  95, 135, 215, "38;5;68",  "48;5;68",  -0.459626704f,   -0.385672569f,   0.215686321f },
+    {  95, 135, 255, "38;5;69",  "48;5;69",  -0.70710665f,    -0.707106888f,   0.372549057f },
+    {  95, 175,   0, "38;5;70",  "48;5;70",  0.0448399149f,   0.998994172f,    -0.313710213f },
+    {  95, 175,  95, "38;5;71",  "48;5;71",  -0.166666687f,   0.288675129f,    0.0588235855f },
+    {  95, 175, 135, "38;5;72",  "48;5;72",  -0.288675129f,   0.166666687f,    0.0588235855f },
+    {  95, 175, 175, "38;5;73",  "48;5;73",  -0.333333343f,   -2.91409261e-08f, 0.0588235855f },
+    {  95, 175, 215, "38;5;74",  "48;5;74",  -0.563815534f,   -0.20521225f,    0.215686321f },
+    {  95, 175, 255, "38;5;75",  "48;5;75",  -0.866025388f,   -0.49999997f,    0.372549057f },
+    {  95, 215,   0, "38;5;76",  "48;5;76",  -0.0608743988f,  0.998145461f,    -0.156847477f },
+    {  95, 215,  95, "38;5;77",  "48;5;77",  -0.300000042f,   0.519615233f,    0.215686321f },
+    {  95, 215, 135, "38;5;78",  "48;5;78",  -0.459626794f,   0.38567248f,     0.215686321f },
+    {  95, 215, 175, "38;5;79",  "48;5;79",  -0.563815653f,   0.205212012f,    0.215686321f },
+    {  95, 215, 215, "38;5;80",  "48;5;80",  -0.600000024f,   -5.24536681e-08f, 0.215686321f },
+    {  95, 215, 255, "38;5;81",  "48;5;81",  -0.965925753f,   -0.258819312f,   0.372549057f },
+    {  95, 255,   0, "38;5;82",  "48;5;82",  -0.133121431f,   0.991099715f,    1.52587891e-05f },
+    {  95, 255,  95, "38;5;83",  "48;5;83",  -0.50000006f,    0.866025388f,    0.372549057f },
+    {  95, 255, 135, "38;5;84",  "48;5;84",  -0.707106769f,   0.707106769f,    0.372549057f },
+    {  95, 255, 175, "38;5;85",  "48;5;85",  -0.866025388f,   0.50000006f,     0.372549057f },
+    {  95, 255, 215, "38;5;86",  "48;5;86",  -0.965925872f,   0.258818924f,    0.372549057f },
+    {  95, 255, 255, "38;5;87",  "48;5;87",  -1.0f,           -8.74227766e-08f, 0.372549057f },
+    { 135,   0,   0, "38;5;88",  "48;5;88",  1.0f,            0.0f,            -0.470572948f },
+    { 135,   0,  95, "38;5;89",  "48;5;89",  0.740569949f,    -0.671979308f,   -0.470572948f },
+    { 135,   0, 135, "38;5;90",  "48;5;90",  0.499999911f,    -0.866025448f,   -0.470572948f },
+    { 135,   0, 175, "38;5;91",  "48;5;91",  0.28049922f,     -0.959854245f,   -0.313710213f },
+    { 135,   0, 215, "38;5;92",  "48;5;92",  0.133467332f,    -0.991053224f,   -0.156847477f },
+    { 135,   0, 255, "38;5;93",  "48;5;93",  0.0307130311f,   -0.999528229f,   1.52587891e-05f },
+    { 135,  95,   0, "38;5;94",  "48;5;94",  0.740570068f,    0.671979189f,    -0.470572948f },
+    { 135,  95,  95, "38;5;95",  "48;5;95",  0.173907071f,    0.0f,            -0.0980392098f },
+    { 135,  95, 135, "38;5;96",  "48;5;96",  0.0869535208f,   -0.150607944f,   -0.0980392098f },
+    { 135,  95, 175, "38;5;97",  "48;5;97",  3.97496036e-09f, -0.333333343f,   0.0588235855f },
+    { 135,  95, 215, "38;5;98",  "48;5;98",  -0.104188882f,   -0.590884686f,   0.215686321f },
+    { 135,  95, 255, "38;5;99",  "48;5;99",  -0.258818984f,   -0.965925872f,   0.372549057f },
+    { 135, 135,   0, "38;5;100", "48;5;100", 0.49999997f,     0.866025448f,    -0.470572948f },
+    { 135, 135,  95, "38;5;101", "48;5;101", 0.0869535282f,   0.150607944f,    -0.0980392098f },
+    { 135, 135, 135, "38;5;102", "48;5;102", 0.0f,            0.0f,            0.0588235855f },
+    { 135, 135, 175, "38;5;103", "48;5;103", -0.0999999866f,  -0.173205093f,   0.215686321f },
+    { 135, 135, 215, "38;5;104", "48;5;104", -0.250003755f,   -0.43301934f,    0.372549057f },
+    { 135, 135, 255, "38;5;105", "48;5;105", -0.499999911f,   -0.866025448f,   0.529411793f },
+    { 135, 175,   0, "38;5;106", "48;5;106", 0.28049916f,     0.959854245f,    -0.313710213f },
+    { 135, 175,  95, "38;5;107", "48;5;107", -1.45704631e-08f, 0.333333343f,    0.0588235855f },
+    { 135, 175, 135, "38;5;108", "48;5;108", -0.100000016f,   0.173205078f,    0.215686321f },
+    { 135, 175, 175, "38;5;109", "48;5;109", -0.200000003f,   -1.7484556e-08f, 0.215686321f },
+    { 135, 175, 215, "38;5;110", "48;5;110", -0.43301931f,    -0.250003785f,   0.372549057f },
+    { 135, 175, 255, "38;5;111", "48;5;111", -0.766044497f,   -0.642787576f,   0.529411793f },
+    { 135, 215,   0, "38;5;112", "48;5;112", 0.133467287f,    0.991053224f,    -0.156847477f },
+    { 135, 215,  95, "38;5;113", "48;5;113", -0.104188986f,   0.590884686f,    0.215686321f },
+    { 135, 215, 135, "38;5;114", "48;5;114", -0.250003844f,   0.43301931f,     0.372549057f },
+    { 135, 215, 175, "38;5;115", "48;5;115", -0.43301931f,    0.250003844f,    0.372549057f },
+    { 135, 215, 215, "38;5;116", "48;5;116", -0.500007629f,   -4.37120562e-08f, 0.372549057f },
+    { 135, 215, 255, "38;5;117", "48;5;117", -0.939692557f,   -0.342020392f,   0.529411793f },
+    { 135, 255,   0, "38;5;118", "48;5;118", 0.0307129752f,   0.999528229f,    1.52587891e-05f },
+    { 135, 255,  95, "38;5;119", "48;5;119", -0.258819044f,   0.965925813f,    0.372549057f },
+    { 135, 255, 135, "38;5;120", "48;5;120", -0.50000006f,    0.866025388f,    0.529411793f },
+    { 135, 255, 175, "38;5;121", "48;5;121", -0.766044617f,   0.642787457f,    0.529411793f },
+    { 135, 255, 215, "38;5;122", "48;5;122", -0.939692676f,   0.342020005f,    0.529411793f },
+    { 135, 255, 255, "38;5;123", "48;5;123", -1.0f,           -8.74227766e-08f, 0.529411793f },
+    { 175,   0,   0, "38;5;124", "48;5;124", 1.0f,            0.0f,            -0.313710213f },
+    { 175,   0,  95, "38;5;125", "48;5;125", 0.842734456f,    -0.538329482f,   -0.313710213f },
+    { 175,   0, 135, "38;5;126", "48;5;126", 0.691008747f,    -0.722846389f,   -0.313710213f },
+    { 175,   0, 175, "38;5;127", "48;5;127", 0.499999911f,    -0.866025448f,   -0.313710213f },
+    { 175,   0, 215, "38;5;128", "48;5;128", 0.3229267f,      -0.946424007f,   -0.156847477f },
+    { 175,   0, 255, "38;5;129", "48;5;129", 0.193892092f,    -0.981022835f,   1.52587891e-05f },
+    { 175,  95,   0, "38;5;130", "48;5;130", 0.842734396f,    0.538329601f,    -0.313710213f },
+    { 175,  95,  95, "38;5;131", "48;5;131", 0.333333343f,    0.0f,            0.0588235855f },
+    { 175,  95, 135, "38;5;132", "48;5;132", 0.288675189f,    -0.166666597f,   0.0588235855f },
+    { 175,  95, 175, "38;5;133", "48;5;133", 0.166666642f,    -0.288675159f,   0.0588235855f },
+    { 175,  95, 215, "38;5;134", "48;5;134", 0.10418918f,     -0.590884626f,   0.215686321f },
+    { 175,  95, 255, "38;5;135", "48;5;135", 1.19248806e-08f, -1.0f,           0.372549057f },
+    { 175, 135,   0, "38;5;136", "48;5;136", 0.691008627f,    0.722846508f,    -0.313710213f },
+    { 175, 135,  95, "38;5;137", "48;5;137", 0.288675129f,    0.166666672f,    0.0588235855f },
+    { 175, 135, 135, "38;5;138", "48;5;138", 0.200000003f,    0.0f,            0.215686321f },
+    { 175, 135, 175, "38;5;139", "48;5;139", 0.0999999866f,   -0.173205093f,   0.215686321f },
+    { 175, 135, 215, "38;5;140", "48;5;140", 5.96253136e-09f, -0.500007629f,   0.372549057f },
+    { 175, 135, 255, "38;5;141", "48;5;141", -0.173648134f,   -0.984807789f,   0.529411793f },
+    { 175, 175,   0, "38;5;142", "48;5;142", 0.49999997f,     0.866025448f,    -0.313710213f },
+    { 175, 175,  95, "38;5;143", "48;5;143", 0.166666657f,    0.288675159f,    0.0588235855f },
+    { 175, 175, 135, "38;5;144", "48;5;144", 0.099999994f,    0.173205093f,    0.215686321f },
+    { 175, 175, 175, "38;5;145", "48;5;145", 0.0f,            0.0f,            0.372549057f },
+    { 175, 175, 215, "38;5;146", "48;5;146", -0.166666642f,   -0.288675159f,   0.529411793f },
+    { 175, 175, 255, "38;5;147", "48;5;147", -0.499999911f,   -0.866025448f,   0.686274529f },
+    { 175, 215,   0, "38;5;148", "48;5;148", 0.322926521f,    0.946424007f,    -0.156847477f },
+    { 175, 215,  95, "38;5;149", "48;5;149", 0.104188867f,    0.590884686f,    0.215686321f },
+    { 175, 215, 135, "38;5;150", "48;5;150", -2.18560281e-08f, 0.500007629f,    0.372549057f },
+    { 175, 215, 175, "38;5;151", "48;5;151", -0.166666687f,   0.288675129f,    0.529411793f },
+    { 175, 215, 215, "38;5;152", "48;5;152", -0.333333343f,   -2.91409261e-08f, 0.529411793f },
+    { 175, 215, 255, "38;5;153", "48;5;153", -0.866025388f,   -0.49999997f,    0.686274529f },
+    { 175, 255,   0, "38;5;154", "48;5;154", 0.193891913f,    0.981022894f,    1.52587891e-05f },
+    { 175, 255,  95, "38;5;155", "48;5;155", -4.37113883e-08f, 1.0f,            0.372549057f },
+    { 175, 255, 135, "38;5;156", "48;5;156", -0.173648298f,   0.98480773f,     0.529411793f },
+    { 175, 255, 175, "38;5;157", "48;5;157", -0.50000006f,    0.866025388f,    0.686274529f },
+    { 175, 255, 215, "38;5;158", "48;5;158", -0.866025388f,   0.50000006f,     0.686274529f },
+    { 175, 255, 255, "38;5;159", "48;5;159", -1.0f,           -8.74227766e-08f, 0.686274529f },
+    { 215,   0,   0, "38;5;160", "48;5;160", 1.0f,            0.0f,            -0.156847477f },
+    { 215,   0,  95, "38;5;161", "48;5;161", 0.894856453f,    -0.446354061f,   -0.156847477f },
+    { 215,   0, 135, "38;5;162", "48;5;162", 0.791543782f,    -0.611112475f,   -0.156847477f },
+    { 215,   0, 175, "38;5;163", "48;5;163", 0.658164084f,    -0.752874553f,   -0.156847477f },
+    { 215,   0, 215, "38;5;164", "48;5;164", 0.499999911f,    -0.866025448f,   -0.156847477f },
+    { 215,   0, 255, "38;5;165", "48;5;165", 0.35167852f,     -0.936120808f,   1.52587891e-05f },
+    { 215,  95,   0, "38;5;166", "48;5;166", 0.894856453f,    0.446354002f,    -0.156847477f },
+    { 215,  95,  95, "38;5;167", "48;5;167", 0.600000024f,    0.0f,            0.215686321f },
+    { 215,  95, 135, "38;5;168", "48;5;168", 0.563815534f,    -0.205212221f,   0.215686321f },
+    { 215,  95, 175, "38;5;169", "48;5;169", 0.459626794f,    -0.38567245f,    0.215686321f },
+    { 215,  95, 215, "38;5;170", "48;5;170", 0.299999952f,    -0.519615293f,   0.215686321f },
+    { 215,  95, 255, "38;5;171", "48;5;171", 0.258819461f,    -0.965925694f,   0.372549057f },
+    { 215, 135,   0, "38;5;172", "48;5;172", 0.791543603f,    0.611112714f,    -0.156847477f },
+    { 215, 135,  95, "38;5;173", "48;5;173", 0.563815594f,    0.205212101f,    0.215686321f },
+    { 215, 135, 135, "38;5;174", "48;5;174", 0.500007629f,    0.0f,            0.372549057f },
+    { 215, 135, 175, "38;5;175", "48;5;175", 0.4330194f,      -0.250003695f,   0.372549057f },
+    { 215, 135, 215, "38;5;176", "48;5;176", 0.250003755f,    -0.43301934f,    0.372549057f },
+    { 215, 135, 255, "38;5;177", "48;5;177", 0.173648626f,    -0.98480767f,    0.529411793f },
+    { 215, 175,   0, "38;5;178", "48;5;178", 0.658163965f,    0.752874613f,    -0.156847477f },
+    { 215, 175,  95, "38;5;179", "48;5;179", 0.459626675f,    0.385672599f,    0.215686321f },
+    { 215, 175, 135, "38;5;180", "48;5;180", 0.43301931f,     0.250003815f,    0.372549057f },
+    { 215, 175, 175, "38;5;181", "48;5;181", 0.333333343f,    0.0f,            0.529411793f },
+    { 215, 175, 215, "38;5;182", "48;5;182", 0.166666642f,    -0.288675159f,   0.529411793f },
+    { 215, 175, 255, "38;5;183", "48;5;183", 1.19248806e-08f, -1.0f,           0.686274529f },
+    { 215, 215,   0, "38;5;184", "48;5;184", 0.49999997f,     0.866025448f,    -0.156847477f },
+    { 215, 215,  95, "38;5;185", "48;5;185", 0.299999982f,    0.519615293f,    0.215686321f },
+    { 215, 215, 135, "38;5;186", "48;5;186", 0.250003785f,    0.43301934f,     0.372549057f },
+    { 215, 215, 175, "38;5;187", "48;5;187", 0.166666657f,    0.288675159f,    0.529411793f },
+    { 215, 215, 215, "38;5;188", "48;5;188", 0.0f,            0.0f,            0.686274529f },
+    { 215, 215, 255, "38;5;189", "48;5;189", -0.499999911f,   -0.866025448f,   0.843137264f },
+    { 215, 255,   0, "38;5;190", "48;5;190", 0.351678252f,    0.936120927f,    1.52587891e-05f },
+    { 215, 255,  95, "38;5;191", "48;5;191", 0.258819073f,    0.965925813f,    0.372549057f },
+    { 215, 255, 135, "38;5;192", "48;5;192", 0.173648104f,    0.984807789f,    0.529411793f },
+    { 215, 255, 175, "38;5;193", "48;5;193", -4.37113883e-08f, 1.0f,            0.686274529f },
+    { 215, 255, 215, "38;5;194", "48;5;194", -0.50000006f,    0.866025388f,    0.843137264f },
+    { 215, 255, 255, "38;5;195", "48;5;195", -1.0f,           -8.74227766e-08f, 0.843137264f },
+    { 255,   0,   0, "38;5;196", "48;5;196", 1.0f,            0.0f,            1.52587891e-05f },
+    { 255,   0,  95, "38;5;197", "48;5;197", 0.924878359f,    -0.38026309f,    1.52587891e-05f },
+    { 255,   0, 135, "38;5;198", "48;5;198", 0.850260496f,    -0.526362121f,   1.52587891e-05f },
+    { 255,   0, 175, "38;5;199", "48;5;199", 0.752644897f,    -0.658426702f,   1.52587891e-05f },
+    { 255,   0, 215, "38;5;200", "48;5;200", 0.634865403f,    -0.772622764f,   1.52587891e-05f },
+    { 255,   0, 255, "38;5;201", "48;5;201", 0.499999911f,    -0.866025448f,   1.52587891e-05f },
+    { 255,  95,   0, "38;5;202", "48;5;202", 0.92487824f,     0.380263418f,    1.52587891e-05f },
+    { 255,  95,  95, "38;5;203", "48;5;203", 1.0f,            0.0f,            0.372549057f },
+    { 255,  95, 135, "38;5;204", "48;5;204", 0.965925872f,    -0.258818835f,   0.372549057f },
+    { 255,  95, 175, "38;5;205", "48;5;205", 0.866025567f,    -0.499999762f,   0.372549057f },
+    { 255,  95, 215, "38;5;206", "48;5;206", 0.707107008f,    -0.707106531f,   0.372549057f },
+    { 255,  95, 255, "38;5;207", "48;5;207", 0.499999911f,    -0.866025448f,   0.372549057f },
+    { 255, 135,   0, "38;5;208", "48;5;208", 0.850260377f,    0.52636236f,     1.52587891e-05f },
+    { 255, 135,  95, "38;5;209", "48;5;209", 0.965925813f,    0.258819044f,    0.372549057f },
+    { 255, 135, 135, "38;5;210", "48;5;210", 1.0f,            0.0f,            0.529411793f },
+    { 255, 135, 175, "38;5;211", "48;5;211", 0.939692557f,    -0.342020363f,   0.529411793f },
+    { 255, 135, 215, "38;5;212", "48;5;212", 0.766044617f,    -0.642787397f,   0.529411793f },
+    { 255, 135, 255, "38;5;213", "48;5;213", 0.499999911f,    -0.866025448f,   0.529411793f },
+    { 255, 175,   0, "38;5;214", "48;5;214", 0.752644777f,    0.658426821f,    1.52587891e-05f },
+    { 255, 175,  95, "38;5;215", "48;5;215", 0.866025388f,    0.5f,            0.372549057f },
+    { 255, 175, 135, "38;5;216", "48;5;216", 0.939692616f,    0.342020154f,    0.529411793f },
+    { 255, 175, 175, "38;5;217", "48;5;217", 1.0f,            0.0f,            0.686274529f },
+    { 255, 175, 215, "38;5;218", "48;5;218", 0.866025567f,    -0.499999762f,   0.686274529f },
+    { 255, 175, 255, "38;5;219", "48;5;219", 0.499999911f,    -0.866025448f,   0.686274529f },
+    { 255, 215,   0, "38;5;220", "48;5;220", 0.634865344f,    0.772622824f,    1.52587891e-05f },
+    { 255, 215,  95, "38;5;221", "48;5;221", 0.707106769f,    0.707106769f,    0.372549057f },
+    { 255, 215, 135, "38;5;222", "48;5;222", 0.766044438f,    0.642787635f,    0.529411793f },
+    { 255, 215, 175, "38;5;223", "48;5;223", 0.866025388f,    0.5f,            0.686274529f },
+    { 255, 215, 215, "38;5;224", "48;5;224", 1.0f,            0.0f,            0.843137264f },
+    { 255, 215, 255, "38;5;225", "48;5;225", 0.499999911f,    -0.866025448f,   0.843137264f },
+    { 255, 255,   0, "38;5;226", "48;5;226", 0.49999997f,     0.866025448f,    1.52587891e-05f },
+    { 255, 255,  95, "38;5;227", "48;5;227", 0.49999997f,     0.866025448f,    0.372549057f },
+    { 255, 255, 135, "38;5;228", "48;5;228", 0.49999997f,     0.866025448f,    0.529411793f },
+    { 255, 255, 175, "38;5;229", "48;5;229", 0.49999997f,     0.866025448f,    0.686274529f },
+    { 255, 255, 215, "38;5;230", "48;5;230", 0.49999997f,     0.866025448f,    0.843137264f },
+    { 255, 255, 255, "38;5;231", "48;5;231", 0.0f,            0.0f,            1.0f },
+    {   8,   8,   8, "38;5;232", "48;5;232", 0.0f,            0.0f,            -0.937254906f },
+    {  18,  18,  18, "38;5;233", "48;5;233", 0.0f,            0.0f,            -0.858823538f },
+    {  28,  28,  28, "38;5;234", "48;5;234", 0.0f,            0.0f,            -0.78039217f },
+    {  38,  38,  38, "38;5;235", "48;5;235", 0.0f,            0.0f,            -0.701960802f },
+    {  48,  48,  48, "38;5;236", "48;5;236", 0.0f,            0.0f,            -0.623529434f },
+    {  58,  58,  58, "38;5;237", "48;5;237", 0.0f,            0.0f,            -0.545098066f },
+    {  68,  68,  68, "38;5;238", "48;5;238", 0.0f,            0.0f,            -0.466666639f },
+    {  78,  78,  78, "38;5;239", "48;5;239", 0.0f,            0.0f,            -0.388235271f },
+    {  88,  88,  88, "38;5;240", "48;5;240", 0.0f,            0.0f,            -0.309803903f },
+    {  98,  98,  98, "38;5;241", "48;5;241", 0.0f,            0.0f,            -0.231372535f },
+    { 108, 108, 108, "38;5;242", "48;5;242", 0.0f,            0.0f,            -0.152941167f },
+    { 118, 118, 118, "38;5;243", "48;5;243", 0.0f,            0.0f,            -0.0745097995f },
+    { 128, 128, 128, "38;5;244", "48;5;244", 0.0f,            0.0f,            0.003921628f },
+    { 138, 138, 138, "38;5;245", "48;5;245", 0.0f,            0.0f,            0.0823529959f },
+    { 148, 148, 148, "38;5;246", "48;5;246", 0.0f,            0.0f,            0.160784364f },
+    { 158, 158, 158, "38;5;247", "48;5;247", 0.0f,            0.0f,            0.239215732f },
+    { 168, 168, 168, "38;5;248", "48;5;248", 0.0f,            0.0f,            0.317647099f },
+    { 178, 178, 178, "38;5;249", "48;5;249", 0.0f,            0.0f,            0.396078467f },
+    { 188, 188, 188, "38;5;250", "48;5;250", 0.0f,            0.0f,            0.474509835f },
+    { 198, 198, 198, "38;5;251", "48;5;251", 0.0f,            0.0f,            0.552941203f },
+    { 208, 208, 208, "38;5;252", "48;5;252", 0.0f,            0.0f,            0.631372571f },
+    { 218, 218, 218, "38;5;253", "48;5;253", 0.0f,            0.0f,            0.709803939f },
+    { 228, 228, 228, "38;5;254", "48;5;254", 0.0f,            0.0f,            0.788235307f },
+    { 238, 238, 238, "38;5;255", "48;5;255", 0.0f,            0.0f,            0.866666675f },
+};
+
+#endif
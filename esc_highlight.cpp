@@ -16,13 +16,36 @@
  */
 
 #include "esc_highlight.h"
+#include "line_filter.h"
+#include "highlight_cache.h"
+#include "trace.h"
+#include "token_stream.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "syntax_profile.h"
+#include "probes.h"
+#include "adaptive.h"
 
 #include <KSyntaxHighlighting/Format>
 #include <KSyntaxHighlighting/Theme>
 #include <KSyntaxHighlighting/State>
 
+#include <QCoreApplication>
+#include <QFile>
+#include <QQueue>
+
+#include <cstdio>
+
 EscCodeHighlighter::EscCodeHighlighter(QTextStream &output)
-    : m_palette(), m_output(output)
+    : m_palette(), m_basePalette(), m_output(output), m_suppressOutput(),
+      m_countRemapSavings(), m_remapSavings(),
+      m_filter(), m_contextBefore(), m_contextAfter(), m_cache(), m_tokens(),
+      m_ansiMode(HighlightAnsi), m_adaptive(), m_outputLevel(FullOutput), m_profile(),
+      m_memoBudget(), m_memoBytes(), m_memoHits(), m_diffLookup(),
+      m_previewLines(), m_previewColumns(), m_pipelineDepth(), m_pipelineSpans(),
+      m_tailLines(), m_tailSettle(),
+      m_lineBudget(), m_fileBudget(), m_fileNsecs(), m_lineNumber(), m_overruns(),
+      m_passthrough()
 {
 }
 
@@ -35,15 +58,13 @@ static void add_code(QByteArray &fmtStart, const char *code)
     }
 }
 
-void EscCodeHighlighter::applyFormat(int offset, int length,
-                                     const KSyntaxHighlighting::Format &format)
+void EscCodeHighlighter::formatSpan(QString &out, const QString &text, int offset, int length,
+                                    const KSyntaxHighlighting::Format &format,
+                                    const KSyntaxHighlighting::Theme &theme,
+                                    const EscPalette *palette)
 {
-    if (length == 0)
-        return;
-
-    const KSyntaxHighlighting::Theme currentTheme = theme();
-    if (format.isDefaultTextStyle(currentTheme)) {
-        m_output << m_line.mid(offset, length);
+    if (format.isDefaultTextStyle(theme)) {
+        out.append(text.constData() + offset, length);
         return;
     }
 
@@ -51,41 +72,707 @@ void EscCodeHighlighter::applyFormat(int offset, int length,
     fmtStart.reserve(32);
     fmtStart.append("\033[");
 
-    if (format.isBold(currentTheme))
+    if (format.isBold(theme))
         add_code(fmtStart, "1");
-    if (format.isItalic(currentTheme))
+    if (format.isItalic(theme))
         add_code(fmtStart, "3");
-    if (format.isUnderline(currentTheme))
+    if (format.isUnderline(theme))
         add_code(fmtStart, "4");
-    if (format.isStrikeThrough(currentTheme))
+    if (format.isStrikeThrough(theme))
         add_code(fmtStart, "9");
 
-    if (format.hasBackgroundColor(currentTheme))
-        add_code(fmtStart, m_palette->background(format.backgroundColor(currentTheme)));
-    if (format.hasTextColor(currentTheme))
-        add_code(fmtStart, m_palette->foreground(format.textColor(currentTheme)));
+    if (format.hasBackgroundColor(theme))
+        add_code(fmtStart, palette->background(format.backgroundColor(theme)));
+    if (format.hasTextColor(theme))
+        add_code(fmtStart, palette->foreground(format.textColor(theme)));
 
     fmtStart.append('m');
 
-    m_output << fmtStart;
-    m_output << m_line.mid(offset, length);
-    m_output << "\033[0m";
+    out += QLatin1String(fmtStart);
+    out.append(text.constData() + offset, length);
+    out += QLatin1String("\033[0m");
+}
+
+static qint64 remap_savings(const KSyntaxHighlighting::Format &format,
+                            const KSyntaxHighlighting::Theme &theme,
+                            const EscPalette *palette)
+{
+    const EscPalette *trueColor = EscPalette::TrueColor();
+    if (format.isDefaultTextStyle(theme))
+        return 0;
+
+    qint64 saved = 0;
+    if (format.hasBackgroundColor(theme)) {
+        const QColor color = format.backgroundColor(theme);
+        saved += trueColor->background(color).size() - palette->background(color).size();
+    }
+    if (format.hasTextColor(theme)) {
+        const QColor color = format.textColor(theme);
+        saved += trueColor->foreground(color).size() - palette->foreground(color).size();
+    }
+    return saved;
+}
+
+struct EscCodeHighlighter::PipelineSpan
+{
+    int m_offset;
+    int m_length;
+    KSyntaxHighlighting::Format m_format;
+};
+
+void EscCodeHighlighter::applyFormat(int offset, int length,
+                                     const KSyntaxHighlighting::Format &format)
+{
+    if (length == 0)
+        return;
+    SRCCAT_PROBE(span, offset, length, format.id());
+    if (m_profile)
+        m_profile->addSpan(format, length);
+    if (m_suppressOutput)
+        return;
+    if (m_countRemapSavings)
+        m_remapSavings += remap_savings(format, theme(), m_palette);
+    if (m_pipelineSpans) {
+        m_pipelineSpans->append(PipelineSpan{offset, length, format});
+        return;
+    }
+    if (m_tokens) {
+        m_tokens->addSpan(offset, length, format, theme());
+        return;
+    }
+
+    if (m_outputLevel >= NoAttributes)
+        formatReduced(offset, length, format);
+    else
+        formatSpan(m_rendered, m_line, offset, length, format, theme(), m_palette);
+
+    // The syntax pass is shared, only the formatting is repeated
+    for (auto &output : m_extraOutputs) {
+        formatSpan(output.m_rendered, m_line, offset, length, format,
+                   output.m_theme, output.m_palette);
+    }
+}
+
+void EscCodeHighlighter::setOutputLevel(OutputLevel level)
+{
+    if (level == m_outputLevel)
+        return;
+    m_outputLevel = level;
+    m_openCodes.clear();
+
+    m_palette = m_basePalette;
+    if (level >= Reduced16 && (m_basePalette->isTrueColor() || m_basePalette->colorCount() > 16))
+        m_palette = EscPalette::Palette16();
+    else if (level >= Reduced256 && m_basePalette->isTrueColor())
+        m_palette = EscPalette::Palette256();
+}
+
+void EscCodeHighlighter::formatReduced(int offset, int length,
+                                       const KSyntaxHighlighting::Format &format)
+{
+    // Like formatSpan(), but keeping only bold and the colors
+    QByteArray fmtStart;
+    if (!format.isDefaultTextStyle(theme())) {
+        fmtStart.reserve(32);
+        fmtStart.append("\033[");
+        if (format.isBold(theme()))
+            add_code(fmtStart, "1");
+        if (format.hasBackgroundColor(theme()))
+            add_code(fmtStart, m_palette->background(format.backgroundColor(theme())));
+        if (format.hasTextColor(theme()))
+            add_code(fmtStart, m_palette->foreground(format.textColor(theme())));
+        if (fmtStart.endsWith('['))
+            fmtStart.clear();
+        else
+            fmtStart.append('m');
+    }
+
+    if (!fmtStart.isEmpty()) {
+        if (m_outputLevel >= MergedSpans && fmtStart == m_openCodes
+                && m_rendered.endsWith(QLatin1String("\033[0m"))) {
+            // Same look as the span before, so just carry on with it
+            m_rendered.chop(4);
+        } else {
+            m_rendered += QLatin1String(fmtStart);
+        }
+    }
+    m_rendered.append(m_line.constData() + offset, length);
+    if (!fmtStart.isEmpty())
+        m_rendered += QLatin1String("\033[0m");
+    m_openCodes = fmtStart;
+}
+
+void EscCodeHighlighter::addOutput(QTextStream &output,
+                                   const KSyntaxHighlighting::Theme &theme,
+                                   const EscPalette *palette)
+{
+    ExtraOutput extra;
+    extra.m_stream = &output;
+    extra.m_theme = theme;
+    extra.m_palette = palette;
+    m_extraOutputs.append(extra);
+}
+
+/* Removes CSI, OSC and other escape sequences.  Lines without any escapes
+ * (the vast majority) only cost the indexOf() scan, which Qt vectorizes,
+ * and are returned without copying. */
+static QString strip_ansi(const QString &text)
+{
+    int esc = text.indexOf(QLatin1Char('\033'));
+    if (esc < 0)
+        return text;
+
+    const int size = text.size();
+    QString stripped;
+    stripped.reserve(size);
+    int pos = 0;
+    while (esc >= 0) {
+        stripped.append(text.constData() + pos, esc - pos);
+
+        int i = esc + 1;
+        const ushort kind = (i < size) ? text.at(i).unicode() : 0;
+        if (kind == '[') {
+            // Parameter and intermediate bytes, then a final byte
+            ++i;
+            while (i < size && (text.at(i).unicode() < 0x40 || text.at(i).unicode() > 0x7e))
+                ++i;
+            ++i;
+        } else if (kind == ']' || kind == 'P' || kind == 'X' || kind == '^' || kind == '_') {
+            // Strings like OSC end with BEL or ST (ESC \), or the line
+            ++i;
+            while (i < size) {
+                const ushort ch = text.at(i).unicode();
+                ++i;
+                if (ch == 0x07)
+                    break;
+                if (ch == 0x1b && i < size && text.at(i) == QLatin1Char('\\')) {
+                    ++i;
+                    break;
+                }
+            }
+        } else {
+            // Anything else is intermediate bytes and a final byte
+            while (i < size && text.at(i).unicode() >= 0x20 && text.at(i).unicode() <= 0x2f)
+                ++i;
+            ++i;
+        }
+
+        pos = qMin(i, size);
+        esc = text.indexOf(QLatin1Char('\033'), pos);
+    }
+    stripped.append(text.constData() + pos, size - pos);
+    return stripped;
+}
+
+QString EscCodeHighlighter::filterInput(const QString &text) const
+{
+    return (m_ansiMode == StripAnsi) ? strip_ansi(text) : text;
+}
+
+QString EscCodeHighlighter::readLine(QTextStream &in) const
+{
+    return filterInput(in.readLine());
+}
+
+void EscCodeHighlighter::writeLineNumber(int line, bool match)
+{
+    if (m_tokens)
+        return;
+
+    QString nu = (line != UnknownLineNumber) ? QString::number(line) : QStringLiteral("?");
+    m_output << (match ? "\033[7;33m" : "\033[7;37m") << nu.rightJustified(7) << " \033[0m";
+    for (const auto &output : m_extraOutputs)
+        *output.m_stream << "\033[7;37m" << nu.rightJustified(7) << " \033[0m";
+}
+
+void EscCodeHighlighter::startBudget()
+{
+    m_fileNsecs = 0;
+    m_lineNumber = 0;
+    m_overruns = 0;
+    m_passthrough = false;
+}
+
+void EscCodeHighlighter::checkBudget(qint64 lineNsecs)
+{
+    // There's no way to interrupt highlightLine(), so a pathological line
+    // still runs to completion once; this only keeps it from happening again
+    static const int MaxOverruns = 3;
+    auto sourceName = [this]() {
+        return m_sourcePath.isEmpty() ? QObject::tr("(stdin)") : m_sourcePath;
+    };
+
+    if (m_lineBudget > 0 && lineNsecs > m_lineBudget) {
+        fputs(qPrintable(QObject::tr("%1:%2: Highlighting took %3 ms, writing the line without colors\n")
+                         .arg(sourceName()).arg(m_lineNumber).arg(lineNsecs / 1000000)), stderr);
+        setPlainLine(m_line);
+        if (++m_overruns >= MaxOverruns)
+            m_passthrough = true;
+    }
+    m_fileNsecs += lineNsecs;
+    if (!m_passthrough && m_fileBudget > 0 && m_fileNsecs > m_fileBudget)
+        m_passthrough = true;
+
+    if (m_passthrough) {
+        fputs(qPrintable(QObject::tr("%1:%2: Over the time budget, writing the rest of the file without colors\n")
+                         .arg(sourceName()).arg(m_lineNumber)), stderr);
+    }
+}
+
+void EscCodeHighlighter::setPlainLine(const QString &text)
+{
+    if (m_tokens)
+        m_tokens->clearSpans();
+    m_rendered = text;
+    for (auto &output : m_extraOutputs)
+        output.m_rendered = text;
+}
+
+KSyntaxHighlighting::State EscCodeHighlighter::formatLine(const QString &text,
+        const KSyntaxHighlighting::State &state)
+{
+    // Every mode formats its lines here, so this is the line boundary where
+    // --adaptive changes take effect
+    if (m_adaptive)
+        setOutputLevel(m_adaptive->level());
+
+    m_line = text;
+    if (m_passthrough) {
+        // The state is left alone, since every later line is plain anyway
+        setPlainLine(text);
+        return state;
+    }
+    if (m_ansiMode == KeepAnsi && text.contains(QLatin1Char('\033'))) {
+        // Already colored by whatever wrote it
+        setPlainLine(text);
+        return state;
+    }
+
+    m_rendered.clear();
+    for (auto &output : m_extraOutputs)
+        output.m_rendered.clear();
+    return highlightTimed(state);
+}
+
+KSyntaxHighlighting::State EscCodeHighlighter::highlightTimed(
+        const KSyntaxHighlighting::State &state)
+{
+    if (m_lineBudget <= 0 && m_fileBudget <= 0 && !m_profile)
+        return highlightLine(m_line, state);
+
+    if (m_profile)
+        m_profile->beginLine();
+    QElapsedTimer timer;
+    timer.start();
+    const auto nextState = highlightLine(m_line, state);
+    const qint64 nsecs = timer.nsecsElapsed();
+    if (m_profile)
+        m_profile->endLine(definition(), nsecs);
+    checkBudget(nsecs);
+    return nextState;
+}
+
+KSyntaxHighlighting::State EscCodeHighlighter::renderLine(const QString &text,
+        const KSyntaxHighlighting::State &state)
+{
+    const auto nextState = formatLine(text, state);
+    if (m_tokens) {
+        m_tokens->writeLine(m_line);
+        return nextState;
+    }
+    m_output << m_rendered << "\n";
+    for (const auto &output : m_extraOutputs)
+        *output.m_stream << output.m_rendered << "\n";
+    return nextState;
+}
+
+KSyntaxHighlighting::State EscCodeHighlighter::skipLine(const QString &text,
+        const KSyntaxHighlighting::State &state)
+{
+    if (m_passthrough || (m_ansiMode == KeepAnsi && text.contains(QLatin1Char('\033'))))
+        return state;
+
+    m_suppressOutput = true;
+    m_line = text;
+    const auto nextState = highlightTimed(state);
+    m_suppressOutput = false;
+    return nextState;
 }
 
 void EscCodeHighlighter::highlightFile(QTextStream &in, bool numberLines)
 {
+    SRCCAT_PROBE(file_start, QFile::encodeName(m_sourcePath).constData());
+    highlightContent(in, numberLines);
+    SRCCAT_PROBE(file_end, QFile::encodeName(m_sourcePath).constData(), m_lineNumber);
+}
+
+void EscCodeHighlighter::highlightContent(QTextStream &in, bool numberLines)
+{
+    if (m_diffLookup) {
+        highlightDiff(in, numberLines);
+        return;
+    }
+    if (m_previewLines > 0) {
+        highlightPreview(in, numberLines);
+        return;
+    }
+    if (m_filter) {
+        startBudget();
+        highlightMatches(in);
+        return;
+    }
+    if (m_tailLines > 0) {
+        highlightTail(in, numberLines);
+        return;
+    }
+    if (m_cache && !m_sourcePath.isEmpty()) {
+        highlightCached(in, numberLines);
+        return;
+    }
+    if (m_pipelineDepth > 0) {
+        highlightPipelined(in, numberLines);
+        return;
+    }
+    startBudget();
+    if (m_tokens)
+        m_tokens->beginFile();
+
+    // The rendered lines only stay valid for the same definition
+    const bool memoize = m_memoBudget > 0;
+    if (memoize && definition() != m_memoDefinition) {
+        m_memo.clear();
+        m_memoBytes = 0;
+        m_memoDefinition = definition();
+    }
+    if (memoize)
+        m_memoHits = RunStats::counter("memo hits");
+
+    KSyntaxHighlighting::State state;
+    int line = 0;
+    const bool tracing = TraceLog::isEnabled();
+
+    while (!in.atEnd()) {
+        const QString text = readLine(in);
+        ++line;
+        if (numberLines)
+            writeLineNumber(line);
+        const qint64 lineStart = tracing ? TraceLog::now() : 0;
+        m_lineNumber = line;
+        SRCCAT_PROBE(line_start, line);
+        state = memoize ? renderMemoized(text, state) : renderLine(text, state);
+        SRCCAT_PROBE(line_end, line, m_rendered.size());
+        if (tracing)
+            TraceLog::addLineSpan(line, lineStart);
+    }
+    RunStats::count("highlighted lines", line);
+
+    TraceSpan span("flush", "file");
+    if (m_tokens)
+        m_tokens->flush();
+    m_output.flush();
+    for (const auto &output : m_extraOutputs)
+        output.m_stream->flush();
+}
+
+void EscCodeHighlighter::highlightMatches(QTextStream &in)
+{
+    // Every line still has to go through the highlighter to keep the state
+    // correct, but only matches and their context are formatted and written.
+    // Lines that may become leading context are kept along with the state
+    // they started in, so they can be rendered again once a match shows up.
+    struct PendingLine
+    {
+        int m_number;
+        QString m_text;
+        KSyntaxHighlighting::State m_state;
+    };
+    QQueue<PendingLine> pending;
+
     KSyntaxHighlighting::State state;
     int line = 0;
+    int lastWritten = 0;
+    int afterRemaining = 0;
 
     while (!in.atEnd()) {
-        m_line = in.readLine();
-        if (numberLines) {
-            QString nu = QString::number(++line);
-            m_output << "\033[7;37m" << nu.rightJustified(7) << " \033[0m";
+        const QString text = readLine(in);
+        ++line;
+        m_lineNumber = line;
+
+        if (m_filter->matches(text)) {
+            const int firstLine = pending.isEmpty() ? line : pending.head().m_number;
+            if (lastWritten > 0 && firstLine > lastWritten + 1)
+                m_output << "\033[36m--\033[0m\n";
+
+            while (!pending.isEmpty()) {
+                const PendingLine context = pending.dequeue();
+                writeLineNumber(context.m_number);
+                m_lineNumber = context.m_number;
+                renderLine(context.m_text, context.m_state);
+            }
+            writeLineNumber(line, true);
+            m_lineNumber = line;
+            state = renderLine(text, state);
+            lastWritten = line;
+            afterRemaining = m_contextAfter;
+        } else if (afterRemaining > 0) {
+            writeLineNumber(line);
+            state = renderLine(text, state);
+            lastWritten = line;
+            --afterRemaining;
+        } else {
+            if (m_contextBefore > 0) {
+                pending.enqueue(PendingLine{line, text, state});
+                if (pending.size() > m_contextBefore)
+                    pending.dequeue();
+            }
+            state = skipLine(text, state);
         }
-        state = highlightLine(m_line, state);
-        m_output << "\n";
     }
 
+    TraceSpan span("flush", "file");
     m_output.flush();
 }
+
+void EscCodeHighlighter::highlightPipelined(QTextStream &in, bool numberLines)
+{
+    static const int BatchLines = 256;
+
+    // A batch without any lines marks the end of the input
+    struct LineBatch
+    {
+        QVector<QString> m_lines;
+    };
+    struct SpanBatch
+    {
+        QVector<QString> m_lines;
+        QVector<PipelineSpan> m_spans;
+        QVector<int> m_spanEnds;
+    };
+
+    SpscQueue<LineBatch> readQueue(m_pipelineDepth);
+    SpscQueue<SpanBatch> spanQueue(m_pipelineDepth);
+    SpscQueue<QString> textQueue(m_pipelineDepth);
+
+    // Only the reader sees every line go by, so it keeps the count
+    int readLines = 0;
+    PipelineThread reader("read", [&]() {
+        TraceSpan span("read", "pipeline");
+        bool done = false;
+        while (!done) {
+            LineBatch batch;
+            batch.m_lines.reserve(BatchLines);
+            while (batch.m_lines.size() < BatchLines && !in.atEnd())
+                batch.m_lines.append(readLine(in));
+            readLines += batch.m_lines.size();
+            done = batch.m_lines.isEmpty();
+            readQueue.push(std::move(batch));
+        }
+    });
+
+    // The theme and palette are only read, so they can be shared
+    const KSyntaxHighlighting::Theme currentTheme = theme();
+    PipelineThread formatter("format", [&]() {
+        TraceSpan span("format", "pipeline");
+        int line = 0;
+        for ( ;; ) {
+            const SpanBatch batch = spanQueue.pop();
+            if (batch.m_lines.isEmpty()) {
+                textQueue.push(QString());
+                break;
+            }
+
+            // Every line ends with a newline, so text is never empty here
+            QString text;
+            int spanIndex = 0;
+            for (int i = 0; i < batch.m_lines.size(); ++i) {
+                if (numberLines) {
+                    text += QLatin1String("\033[7;37m");
+                    text += QString::number(++line).rightJustified(7);
+                    text += QLatin1String(" \033[0m");
+                }
+                const QString &lineText = batch.m_lines.at(i);
+                for ( ; spanIndex < batch.m_spanEnds.at(i); ++spanIndex) {
+                    const PipelineSpan &fmt = batch.m_spans.at(spanIndex);
+                    formatSpan(text, lineText, fmt.m_offset, fmt.m_length, fmt.m_format,
+                               currentTheme, m_palette);
+                }
+                text += QLatin1Char('\n');
+            }
+            textQueue.push(std::move(text));
+        }
+    });
+
+    PipelineThread writer("write", [&]() {
+        TraceSpan span("write", "pipeline");
+        for ( ;; ) {
+            const QString text = textQueue.pop();
+            if (text.isEmpty())
+                break;
+            m_output << text;
+        }
+        m_output.flush();
+    });
+
+    reader.start();
+    formatter.start();
+    writer.start();
+
+    // The highlighter itself stays on this thread
+    {
+        TraceSpan span("highlight", "pipeline");
+        KSyntaxHighlighting::State state;
+        bool done = false;
+        while (!done) {
+            LineBatch lines = readQueue.pop();
+            SpanBatch batch;
+            batch.m_spanEnds.reserve(lines.m_lines.size());
+            m_pipelineSpans = &batch.m_spans;
+            for (const QString &text : lines.m_lines) {
+                state = highlightLine(text, state);
+                batch.m_spanEnds.append(batch.m_spans.size());
+            }
+            m_pipelineSpans = Q_NULLPTR;
+            batch.m_lines = std::move(lines.m_lines);
+            done = batch.m_lines.isEmpty();
+            spanQueue.push(std::move(batch));
+        }
+    }
+
+    reader.wait();
+    formatter.wait();
+    writer.wait();
+
+    m_lineNumber = readLines;
+    RunStats::count("highlighted lines", readLines);
+}
+
+QString EscCodeHighlighter::cacheStyle() const
+{
+    // Everything besides the text that affects the rendered output
+    return definition().name() + QLatin1Char('\n') + theme().name()
+            + QLatin1Char('\n') + QLatin1String(m_palette->name())
+            + QLatin1Char('\n') + QString::number(m_ansiMode);
+}
+
+void EscCodeHighlighter::highlightCached(QTextStream &in, bool numberLines)
+{
+    QStringList lines;
+    while (!in.atEnd())
+        lines.append(readLine(in));
+
+    const QString style = cacheStyle();
+    const HighlightCache::Entry *previous = m_cache->find(m_sourcePath, style);
+    const int previousCount = previous ? previous->m_lines.size() : 0;
+
+    QVector<quint64> hashes;
+    hashes.reserve(lines.size());
+    for (const QString &text : lines)
+        hashes.append(HighlightCache::hashLine(text));
+
+    // Line up the old and new lines by their common prefix and suffix, so
+    // an inserted or deleted line only shifts the cached lines after it
+    // instead of invalidating them
+    int commonPrefix = 0;
+    while (commonPrefix < lines.size() && commonPrefix < previousCount
+            && previous->m_lines.at(commonPrefix).m_hash == hashes.at(commonPrefix))
+        ++commonPrefix;
+    int commonSuffix = 0;
+    while (commonSuffix < lines.size() - commonPrefix && commonSuffix < previousCount - commonPrefix
+            && previous->m_lines.at(previousCount - 1 - commonSuffix).m_hash
+               == hashes.at(lines.size() - 1 - commonSuffix))
+        ++commonSuffix;
+
+    // Entries loaded from disk have no highlighter states, since those can't
+    // be serialized.  The unchanged prefix can still be copied from them, but
+    // the state at the first changed line has to be rebuilt by running the
+    // prefix through the highlighter (without formatting it).  Without the
+    // states, nothing after a change is known to render the same way.
+    const bool hasStates = previous && previous->m_hasStates;
+    if (previous && !hasStates) {
+        const bool fullOutput = !m_adaptive || m_adaptive->level() == FullOutput;
+        if (commonPrefix == lines.size() && commonPrefix == previousCount && fullOutput) {
+            for (int i = 0; i < previousCount; ++i) {
+                if (numberLines)
+                    writeLineNumber(i + 1);
+                m_output << previous->m_lines.at(i).m_rendered << "\n";
+            }
+            TraceSpan span("flush", "file");
+            m_output.flush();
+            return;
+        }
+        commonSuffix = 0;
+    }
+
+    auto previousLine = [&](int line) -> const HighlightCache::Line * {
+        if (line < commonPrefix)
+            return &previous->m_lines.at(line);
+        if (line >= lines.size() - commonSuffix)
+            return &previous->m_lines.at(line - lines.size() + previousCount);
+        return Q_NULLPTR;
+    };
+
+    HighlightCache::Entry current;
+    current.m_style = style;
+    current.m_hasStates = true;
+    current.m_lines.reserve(lines.size());
+
+    startBudget();
+    KSyntaxHighlighting::State state;
+    bool reduced = false;
+    for (int i = 0; i < lines.size(); ++i) {
+        if (numberLines)
+            writeLineNumber(i + 1);
+        m_lineNumber = i + 1;
+
+        // The cache only holds full output, so it isn't used while
+        // --adaptive has the output reduced
+        if (m_adaptive)
+            setOutputLevel(m_adaptive->level());
+        if (m_outputLevel != FullOutput)
+            reduced = true;
+
+        HighlightCache::Line cached;
+        cached.m_hash = hashes.at(i);
+        cached.m_startState = state;
+
+        const HighlightCache::Line *old = (m_outputLevel == FullOutput) ? previousLine(i)
+                                                                        : Q_NULLPTR;
+        if (old && hasStates && old->m_startState == state) {
+            // Same text starting in the same state renders the same way, so
+            // this also picks the cached output back up after an edit once
+            // the highlighter has resynchronized
+            cached.m_rendered = old->m_rendered;
+            state = old->m_endState;
+        } else if (old && !hasStates) {
+            // Only the prefix, which starts in the same state it did before
+            cached.m_rendered = old->m_rendered;
+            state = skipLine(lines.at(i), state);
+        } else {
+            state = formatLine(lines.at(i), state);
+            cached.m_rendered = m_rendered;
+        }
+        cached.m_endState = state;
+
+        m_output << cached.m_rendered << "\n";
+        current.m_lines.append(cached);
+    }
+
+    // Lines written without colors or with reduced output shouldn't
+    // outlive this run
+    if (!m_passthrough && m_overruns == 0 && !reduced)
+        m_cache->store(m_sourcePath, current);
+
+    TraceSpan span("flush", "file");
+    m_output.flush();
+}
+
+void EscCodeHighlighter::writeHeader(const QString &title)
+{
+    if (m_tokens) {
+        m_tokens->writeHeader(title);
+        return;
+    }
+    m_output << "\033[1m==> " << title << " <==\033[0m\n";
+    for (const auto &output : m_extraOutputs)
+        *output.m_stream << "\033[1m==> " << title << " <==\033[0m\n";
+}
@@ -21,23 +21,241 @@
 #include "esc_color.h"
 
 #include <KSyntaxHighlighting/AbstractHighlighter>
+#include <KSyntaxHighlighting/Definition>
+#include <KSyntaxHighlighting/Theme>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QTextStream>
+#include <QVector>
+
+class LineFilter;
+class HighlightCache;
+class TokenWriter;
+class SyntaxProfile;
+class AdaptiveOutput;
 
 class EscCodeHighlighter : public KSyntaxHighlighting::AbstractHighlighter
 {
 public:
     explicit EscCodeHighlighter(QTextStream &output);
 
-    void setPalette(const EscPalette *pal) { m_palette = pal; }
+    void setPalette(const EscPalette *pal) { m_palette = pal; m_basePalette = pal; }
+
+    // Cheaper ways to write the same output for --adaptive, each level
+    // keeping the reductions of the ones before it
+    enum OutputLevel
+    {
+        FullOutput,
+        Reduced256,
+        Reduced16,
+        NoAttributes,
+        MergedSpans,
+    };
+
+    // Take the output level from the adaptive output at each line boundary
+    void setAdaptiveOutput(AdaptiveOutput *adaptive) { m_adaptive = adaptive; }
+
+    // Bytes the palette's codes saved over truecolor since the last take
+    void setCountRemapSavings(bool count) { m_countRemapSavings = count; }
+    qint64 takeRemapSavings()
+    {
+        const qint64 saved = m_remapSavings;
+        m_remapSavings = 0;
+        return saved;
+    }
+
+    // Only output lines accepted by the filter, plus the requested context
+    void setLineFilter(const LineFilter *filter, int before, int after)
+    {
+        m_filter = filter;
+        m_contextBefore = before;
+        m_contextAfter = after;
+    }
+
+    // Also render plain highlighting with another theme and palette
+    void addOutput(QTextStream &output, const KSyntaxHighlighting::Theme &theme,
+                   const EscPalette *palette);
+    bool hasExtraOutputs() const { return !m_extraOutputs.isEmpty(); }
+
+    // Reuse (and update) previously rendered lines from the cache
+    void setCache(HighlightCache *cache) { m_cache = cache; }
+
+    // Path of the file being highlighted, used as the cache key.  Files
+    // without a path (i.e. stdin) are never cached.
+    void setSourcePath(const QString &path) { m_sourcePath = path; }
+
+    // Only output the last lines of each file, after highlighting settle
+    // lines before them (or the whole file, if settle is negative)
+    void setTail(int lines, int settle)
+    {
+        m_tailLines = lines;
+        m_tailSettle = settle;
+    }
+
+    // Time every highlightLine() call and credit it to the formats it applied
+    void setProfile(SyntaxProfile *profile) { m_profile = profile; }
+
+    // What to do with escape sequences already in the input
+    enum AnsiMode
+    {
+        HighlightAnsi,
+        StripAnsi,
+        KeepAnsi,
+    };
+    void setAnsiMode(AnsiMode mode) { m_ansiMode = mode; }
+
+    // Reuse the output of repeated lines, keeping up to bytes (0 = disabled)
+    void setMemoBudget(qint64 bytes) { m_memoBudget = bytes; }
+
+    // Only output the first lines of each file, clipped to columns (0 = all)
+    void setPreview(int lines, int columns)
+    {
+        m_previewLines = lines;
+        m_previewColumns = columns;
+    }
+
+    // Treat the input as a unified diff, looking up each file's definition
+    typedef KSyntaxHighlighting::Definition (*DefinitionLookup)(const QString &path);
+    void setDiffMode(DefinitionLookup lookup) { m_diffLookup = lookup; }
+
+    // Highlight on separate threads, queueing up to depth batches (0 = off)
+    void setPipelineDepth(int depth) { m_pipelineDepth = depth; }
+
+    // Write lines (or the rest of the file) without colors once they take
+    // longer than these milliseconds to highlight (0 = no limit)
+    void setTimeBudget(qint64 lineMsecs, qint64 fileMsecs)
+    {
+        m_lineBudget = lineMsecs * 1000000;
+        m_fileBudget = fileMsecs * 1000000;
+    }
+
+    // Record the syntax pass to a token stream instead of writing escapes
+    void setTokenWriter(TokenWriter *writer) { m_tokens = writer; }
 
     void applyFormat(int offset, int length, const KSyntaxHighlighting::Format &format) Q_DECL_OVERRIDE;
 
+    // Appends text[offset, offset + length) to out, with the format's escapes
+    static void formatSpan(QString &out, const QString &text, int offset, int length,
+                           const KSyntaxHighlighting::Format &format,
+                           const KSyntaxHighlighting::Theme &theme,
+                           const EscPalette *palette);
+
+    // Where text has to be cut to fit in the given number of columns
+    static int clipColumns(const QString &text, int columns);
+
     void highlightFile(QTextStream &in, bool numberLines);
+    void writeHeader(const QString &title);
 
 private:
     const EscPalette *m_palette;
+    const EscPalette *m_basePalette;
     QTextStream &m_output;
     QString m_line;
+    QString m_rendered;
+    bool m_suppressOutput;
+    bool m_countRemapSavings;
+    qint64 m_remapSavings;
+    QString m_sourcePath;
+
+    struct ExtraOutput
+    {
+        QTextStream *m_stream;
+        KSyntaxHighlighting::Theme m_theme;
+        const EscPalette *m_palette;
+        QString m_rendered;
+    };
+    QVector<ExtraOutput> m_extraOutputs;
+
+    const LineFilter *m_filter;
+    int m_contextBefore;
+    int m_contextAfter;
+
+    HighlightCache *m_cache;
+    TokenWriter *m_tokens;
+
+    AnsiMode m_ansiMode;
+
+    AdaptiveOutput *m_adaptive;
+    OutputLevel m_outputLevel;
+    QByteArray m_openCodes;
+    void setOutputLevel(OutputLevel level);
+    void formatReduced(int offset, int length, const KSyntaxHighlighting::Format &format);
+    SyntaxProfile *m_profile;
+
+    struct MemoLine
+    {
+        QString m_text;
+        KSyntaxHighlighting::State m_startState;
+        KSyntaxHighlighting::State m_endState;
+        QString m_rendered;
+        int m_uses;
+    };
+    QHash<quint64, QVector<MemoLine>> m_memo;
+    KSyntaxHighlighting::Definition m_memoDefinition;
+    qint64 m_memoBudget;
+    qint64 m_memoBytes;
+    qint64 *m_memoHits;
+
+    DefinitionLookup m_diffLookup;
+    int m_previewLines;
+    int m_previewColumns;
+
+    struct PipelineSpan;
+    int m_pipelineDepth;
+    QVector<PipelineSpan> *m_pipelineSpans;
+
+    int m_tailLines;
+    int m_tailSettle;
+
+    qint64 m_lineBudget;
+    qint64 m_fileBudget;
+    qint64 m_fileNsecs;
+    int m_lineNumber;
+    int m_overruns;
+    bool m_passthrough;
+
+    // Highlights m_line, keeping track of the time budget and profile
+    KSyntaxHighlighting::State highlightTimed(const KSyntaxHighlighting::State &state);
+
+    void startBudget();
+    void checkBudget(qint64 lineNsecs);
+    void setPlainLine(const QString &text);
+
+    // For lines whose number isn't known, e.g. in a --tail of a big file
+    enum { UnknownLineNumber = -1 };
+    void writeLineNumber(int line, bool match = false);
+
+    // Reads the next input line, stripping escapes when asked to
+    QString filterInput(const QString &text) const;
+    QString readLine(QTextStream &in) const;
+
+    /* Highlight one line into m_rendered, then (optionally) write it out.
+     * These are subject to the time budget, so m_lineNumber should be set
+     * to the line being highlighted for reporting overruns. */
+    KSyntaxHighlighting::State formatLine(const QString &text,
+                                          const KSyntaxHighlighting::State &state);
+    KSyntaxHighlighting::State renderLine(const QString &text,
+                                          const KSyntaxHighlighting::State &state);
+
+    KSyntaxHighlighting::State renderMemoized(const QString &text,
+                                              const KSyntaxHighlighting::State &state);
+    void trimMemo();
+
+    // Advance the highlighter state without formatting anything
+    KSyntaxHighlighting::State skipLine(const QString &text,
+                                        const KSyntaxHighlighting::State &state);
+
+    void highlightContent(QTextStream &in, bool numberLines);
+    void highlightMatches(QTextStream &in);
+    void highlightCached(QTextStream &in, bool numberLines);
+    void highlightTail(QTextStream &in, bool numberLines);
+    void highlightPipelined(QTextStream &in, bool numberLines);
+    void highlightDiff(QTextStream &in, bool numberLines);
+    void highlightPreview(QTextStream &in, bool numberLines);
+    KSyntaxHighlighting::State renderDiffLine(const QString &text,
+                                              const KSyntaxHighlighting::State &state,
+                                              char marker, const QString &background);
+    QString cacheStyle() const;
 };
 
 #endif
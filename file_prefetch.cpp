@@ -0,0 +1,138 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "file_prefetch.h"
+#include "trace.h"
+
+#include <QFile>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+FilePrefetcher::FilePrefetcher(const QStringList &files, int window)
+    : m_files(files), m_entries(files.size()), m_window(window),
+      m_consumed(), m_stop()
+{
+    setObjectName(QStringLiteral("prefetch"));
+}
+
+FilePrefetcher::~FilePrefetcher()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_cond.wakeAll();
+    }
+    wait();
+
+    // Close anything that was prefetched but never consumed
+    for (const auto &entry : m_entries) {
+        if (entry.m_fd >= 0)
+            ::close(entry.m_fd);
+    }
+}
+
+int FilePrefetcher::take(int index, int *error)
+{
+    QMutexLocker lock(&m_mutex);
+
+    // The caller may skip entries it handles itself (stdin), so asking for
+    // this one already means everything before it is done with.  Otherwise
+    // the window could stay full of skipped entries and never reach it.
+    if (index > m_consumed) {
+        m_consumed = index;
+        m_cond.wakeAll();
+    }
+    while (!m_entries[index].m_ready)
+        m_cond.wait(&m_mutex);
+
+    Entry &entry = m_entries[index];
+    const int fd = entry.m_fd;
+    *error = entry.m_error;
+    entry.m_fd = -1;
+
+    m_consumed = index + 1;
+    m_cond.wakeAll();
+    return fd;
+}
+
+static int open_prefetched(const QString &filename, int *error)
+{
+    const QByteArray path = QFile::encodeName(filename);
+    int fd;
+    while ((fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC)) < 0 && errno == EINTR) {
+        /* try again */
+    }
+    if (fd < 0) {
+        *error = errno;
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        *error = errno;
+        ::close(fd);
+        return -1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        // QFile refuses to open directories; keep the same behavior here
+        *error = EISDIR;
+        ::close(fd);
+        return -1;
+    }
+
+#if defined(POSIX_FADV_WILLNEED)
+    if (S_ISREG(st.st_mode)) {
+        // Start pulling the whole file into the page cache.  This is only a
+        // hint, so failures (e.g. on filesystems that ignore it) are harmless.
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    }
+#endif
+
+    *error = 0;
+    return fd;
+}
+
+void FilePrefetcher::run()
+{
+    for (int index = 0; index < m_files.size(); ++index) {
+        {
+            QMutexLocker lock(&m_mutex);
+            while (!m_stop && index >= m_consumed + m_window)
+                m_cond.wait(&m_mutex);
+            if (m_stop)
+                return;
+        }
+
+        // stdin is handled directly by the caller
+        int fd = -1, error = 0;
+        if (m_files[index] != QLatin1String("-")) {
+            TraceSpan span("prefetch", "io", m_files[index]);
+            fd = open_prefetched(m_files[index], &error);
+        }
+
+        QMutexLocker lock(&m_mutex);
+        m_entries[index].m_fd = fd;
+        m_entries[index].m_error = error;
+        m_entries[index].m_ready = true;
+        m_cond.wakeAll();
+    }
+}
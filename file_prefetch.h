@@ -0,0 +1,66 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FILE_PREFETCH_H
+#define _FILE_PREFETCH_H
+
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+/* Opens and prefetches upcoming input files on a background thread while
+ * the current file is being highlighted, so that runs over many small files
+ * don't sit idle waiting on open() and cold page cache reads.  At most
+ * `window` files beyond the one currently being consumed are kept open. */
+class FilePrefetcher : public QThread
+{
+public:
+    FilePrefetcher(const QStringList &files, int window);
+    ~FilePrefetcher();
+
+    /* Waits for files[index] to be opened, and returns its file descriptor.
+     * Ownership of the descriptor passes to the caller.  On failure, returns
+     * -1 and stores the errno value in *error.  Indices that are never
+     * taken (such as "-") are skipped over by taking a later one. */
+    int take(int index, int *error);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    struct Entry
+    {
+        Entry() : m_fd(-1), m_error(), m_ready() { }
+
+        int m_fd;
+        int m_error;
+        bool m_ready;
+    };
+
+    QStringList m_files;
+    QVector<Entry> m_entries;
+    int m_window;
+    int m_consumed;
+    bool m_stop;
+
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+};
+
+#endif // _FILE_PREFETCH_H
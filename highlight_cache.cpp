@@ -0,0 +1,119 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "highlight_cache.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+
+static const quint32 CACHE_MAGIC = 0x53434331;  // "SCC1"
+
+HighlightCache::HighlightCache(const QString &directory)
+    : m_directory(directory)
+{
+    if (!m_directory.isEmpty())
+        QDir().mkpath(m_directory);
+}
+
+const HighlightCache::Entry *HighlightCache::find(const QString &path, const QString &style)
+{
+    auto iter = m_entries.find(path);
+    if (iter == m_entries.end()) {
+        Entry entry;
+        if (m_directory.isEmpty() || !load(path, &entry))
+            return Q_NULLPTR;
+        iter = m_entries.insert(path, entry);
+    }
+
+    if (iter->m_style != style)
+        return Q_NULLPTR;
+    return &iter.value();
+}
+
+void HighlightCache::store(const QString &path, const Entry &entry)
+{
+    m_entries.insert(path, entry);
+    if (!m_directory.isEmpty())
+        save(path, entry);
+}
+
+quint64 HighlightCache::hashLine(const QString &text)
+{
+    // FNV-1a, so the hashes stay valid across runs (unlike qHash, which
+    // may be seeded differently or change between Qt versions)
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    const QChar *data = text.constData();
+    for (int i = 0; i < text.size(); ++i) {
+        hash ^= data[i].unicode();
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+QString HighlightCache::diskPath(const QString &path) const
+{
+    const QByteArray key = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1);
+    return m_directory + QLatin1Char('/') + QString::fromLatin1(key.toHex());
+}
+
+bool HighlightCache::load(const QString &path, Entry *entry) const
+{
+    QFile file(diskPath(path));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic;
+    QString storedPath;
+    qint32 count;
+    stream >> magic;
+    if (magic != CACHE_MAGIC)
+        return false;
+    stream >> storedPath >> entry->m_style >> count;
+    if (storedPath != path || count < 0 || count > (1 << 26))
+        return false;
+
+    entry->m_hasStates = false;
+    entry->m_lines.resize(count);
+    for (auto &line : entry->m_lines)
+        stream >> line.m_hash >> line.m_rendered;
+    return stream.status() == QDataStream::Ok;
+}
+
+void HighlightCache::save(const QString &path, const Entry &entry) const
+{
+    QSaveFile file(diskPath(path));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << CACHE_MAGIC << path << entry.m_style << qint32(entry.m_lines.size());
+    for (const auto &line : entry.m_lines)
+        stream << line.m_hash << line.m_rendered;
+
+    // A failed cache write just means we'll re-highlight next time
+    if (stream.status() == QDataStream::Ok)
+        file.commit();
+    else
+        file.cancelWriting();
+}
@@ -0,0 +1,69 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HIGHLIGHT_CACHE_H
+#define _HIGHLIGHT_CACHE_H
+
+#include <KSyntaxHighlighting/State>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/* Remembers the rendered output of each line of previously highlighted
+ * files, so that highlighting the same file again only has to redo the
+ * lines that changed.  Entries are always kept in memory, and when a cache
+ * directory is given they are also saved there for later runs.  Highlighter
+ * states can't be serialized, so entries loaded from disk only carry the
+ * line hashes and rendered text. */
+class HighlightCache
+{
+public:
+    struct Line
+    {
+        quint64 m_hash;
+        QString m_rendered;
+        KSyntaxHighlighting::State m_startState;
+        KSyntaxHighlighting::State m_endState;
+    };
+
+    struct Entry
+    {
+        Entry() : m_hasStates() { }
+
+        QString m_style;
+        bool m_hasStates;
+        QVector<Line> m_lines;
+    };
+
+    explicit HighlightCache(const QString &directory = QString());
+
+    // Returns Q_NULLPTR if there's no entry for path rendered with style
+    const Entry *find(const QString &path, const QString &style);
+    void store(const QString &path, const Entry &entry);
+
+    static quint64 hashLine(const QString &text);
+
+private:
+    QString m_directory;
+    QHash<QString, Entry> m_entries;
+
+    QString diskPath(const QString &path) const;
+    bool load(const QString &path, Entry *entry) const;
+    void save(const QString &path, const Entry &entry) const;
+};
+
+#endif // _HIGHLIGHT_CACHE_H
@@ -0,0 +1,476 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esc_highlight.h"
+#include "highlight_cache.h"
+#include "trace.h"
+#include "token_stream.h"
+#include "stats.h"
+#include "probes.h"
+
+#include <KSyntaxHighlighting/Theme>
+#include <KSyntaxHighlighting/State>
+
+#include <QQueue>
+#include <QRegularExpression>
+
+#include <limits>
+
+// Rough memory used by a memoized line, including the container overhead
+static qint64 memo_size(const QString &text, const QString &rendered)
+{
+    return (text.size() + rendered.size()) * qint64(sizeof(QChar)) + 64;
+}
+
+KSyntaxHighlighting::State EscCodeHighlighter::renderMemoized(const QString &text,
+        const KSyntaxHighlighting::State &state)
+{
+    // A line can start in many different states, but only the few most
+    // common ones are worth keeping
+    static const int MaxStates = 8;
+
+    const quint64 hash = HighlightCache::hashLine(text);
+    auto bucket = m_memo.find(hash);
+    if (bucket != m_memo.end()) {
+        for (MemoLine &memo : bucket.value()) {
+            if (memo.m_startState == state && memo.m_text == text) {
+                ++memo.m_uses;
+                if (m_memoHits)
+                    ++*m_memoHits;
+                m_output << memo.m_rendered << "\n";
+                return memo.m_endState;
+            }
+        }
+    }
+
+    const int overruns = m_overruns;
+    const auto nextState = renderLine(text, state);
+
+    // Lines written without colors because of the time budget aren't kept
+    if (m_overruns != overruns || m_passthrough)
+        return nextState;
+
+    QVector<MemoLine> &states = m_memo[hash];
+    if (states.size() < MaxStates) {
+        states.append(MemoLine{text, state, nextState, m_rendered, 0});
+        m_memoBytes += memo_size(text, m_rendered);
+        if (m_memoBytes > m_memoBudget)
+            trimMemo();
+    }
+    return nextState;
+}
+
+void EscCodeHighlighter::trimMemo()
+{
+    // Drop the lines that weren't reused since the last trim, and age the
+    // rest so that lines which stop repeating are eventually dropped too.
+    // If that doesn't free enough, start over with an empty table.
+    for (auto bucket = m_memo.begin(); bucket != m_memo.end(); ) {
+        QVector<MemoLine> &states = bucket.value();
+        for (int i = states.size() - 1; i >= 0; --i) {
+            MemoLine &memo = states[i];
+            if (memo.m_uses == 0) {
+                m_memoBytes -= memo_size(memo.m_text, memo.m_rendered);
+                states.remove(i);
+            } else {
+                memo.m_uses /= 2;
+            }
+        }
+        if (states.isEmpty())
+            bucket = m_memo.erase(bucket);
+        else
+            ++bucket;
+    }
+
+    if (m_memoBytes > m_memoBudget * 3 / 4) {
+        m_memo.clear();
+        m_memoBytes = 0;
+    }
+    RunStats::count("memo trims", 1);
+}
+
+int EscCodeHighlighter::clipColumns(const QString &text, int columns)
+{
+    int column = 0;
+    for (int i = 0; i < text.size(); ++i) {
+        const QChar ch = text.at(i);
+        if (ch == QLatin1Char('\t'))
+            column = (column / 8 + 1) * 8;
+        else if (!ch.isLowSurrogate())
+            ++column;
+        if (column > columns)
+            return i;
+    }
+    return text.size();
+}
+
+void EscCodeHighlighter::highlightPreview(QTextStream &in, bool numberLines)
+{
+    static const qint64 MaxSkip = 1024 * 1024;
+
+    // A UTF-8 character is at most 4 bytes, so this is always enough to fill
+    // the columns.  Without a width, a preview has no use for more than 64K.
+    const int textColumns = (m_previewColumns > 0)
+                          ? qMax(1, m_previewColumns - (numberLines ? 9 : 0)) : 0;
+    const qint64 maxBytes = (textColumns > 0) ? textColumns * 4 : 64 * 1024;
+
+    QIODevice *device = in.device();
+    startBudget();
+    if (m_tokens)
+        m_tokens->beginFile();
+
+    KSyntaxHighlighting::State state;
+    int line = 0;
+    bool lastLine = false;
+    while (line < m_previewLines && !lastLine) {
+        QByteArray bytes = device->readLine(maxBytes);
+        if (bytes.isEmpty())
+            break;
+
+        if (bytes.endsWith('\n')) {
+            bytes.chop(1);
+            if (bytes.endsWith('\r'))
+                bytes.chop(1);
+        } else {
+            // Skip the rest of the line, but give up on the file if it
+            // doesn't end within a reasonable distance
+            qint64 skipped = 0;
+            for ( ;; ) {
+                const QByteArray rest = device->readLine(64 * 1024);
+                if (rest.isEmpty() || rest.endsWith('\n'))
+                    break;
+                skipped += rest.size();
+                if (skipped >= MaxSkip) {
+                    lastLine = true;
+                    break;
+                }
+            }
+        }
+
+        QString text = filterInput(QString::fromUtf8(bytes));
+        if (textColumns > 0)
+            text.truncate(clipColumns(text, textColumns));
+
+        ++line;
+        if (numberLines)
+            writeLineNumber(line);
+        m_lineNumber = line;
+        state = renderLine(text, state);
+    }
+
+    TraceSpan span("flush", "file");
+    if (m_tokens)
+        m_tokens->flush();
+    m_output.flush();
+    for (const auto &output : m_extraOutputs)
+        output.m_stream->flush();
+}
+
+// The path from a "--- " or "+++ " line, or empty for /dev/null
+static QString diff_path(const QString &header)
+{
+    QString path = header.mid(4).section(QLatin1Char('\t'), 0, 0);
+    if (path.size() >= 2 && path.startsWith(QLatin1Char('"')) && path.endsWith(QLatin1Char('"')))
+        path = path.mid(1, path.size() - 2);
+    if (path == QLatin1String("/dev/null"))
+        return QString();
+    if (path.startsWith(QLatin1String("a/")) || path.startsWith(QLatin1String("b/")))
+        path = path.mid(2);
+    return path;
+}
+
+static bool parse_hunk_header(const QString &header, int *oldStart, int *oldLines,
+                              int *newStart, int *newLines)
+{
+    static const QRegularExpression hunkRe(
+            QStringLiteral("^@@ -(\\d+)(?:,(\\d+))? \\+(\\d+)(?:,(\\d+))? @@"));
+    const auto match = hunkRe.match(header);
+    if (!match.hasMatch())
+        return false;
+
+    // A missing count means a single line
+    *oldStart = match.captured(1).toInt();
+    *oldLines = match.capturedLength(2) ? match.captured(2).toInt() : 1;
+    *newStart = match.captured(3).toInt();
+    *newLines = match.capturedLength(4) ? match.captured(4).toInt() : 1;
+    return true;
+}
+
+// The closest background the palette can show.  The bright half of the 8
+// color palette only exists as foregrounds, so it's passed over.
+static QString diff_background(const EscPalette *palette, const QColor &color)
+{
+    QByteArray code = palette->background(color);
+    if (code.isEmpty()) {
+        float closest = std::numeric_limits<float>::infinity();
+        for (int i = 0; i < palette->colorCount(); ++i) {
+            const QColor entry = palette->color(i);
+            const QByteArray entryCode = palette->background(entry);
+            const float dist = EscPalette::distance(color, entry, EscPalette::HslSpace);
+            if (!entryCode.isEmpty() && dist < closest) {
+                code = entryCode;
+                closest = dist;
+            }
+        }
+    }
+    return QLatin1String("\033[") + QLatin1String(code) + QLatin1Char('m');
+}
+
+KSyntaxHighlighting::State EscCodeHighlighter::renderDiffLine(const QString &text,
+        const KSyntaxHighlighting::State &state, char marker, const QString &background)
+{
+    const auto nextState = formatLine(text, state);
+    if (background.isEmpty()) {
+        m_output << marker << m_rendered << "\n";
+    } else {
+        // Each span resets all attributes when it ends, so the background
+        // has to be brought back after every one of them
+        m_rendered.replace(QLatin1String("\033[0m"), QLatin1String("\033[0m") + background);
+        m_output << background << marker << m_rendered << "\033[K\033[0m\n";
+    }
+    return nextState;
+}
+
+void EscCodeHighlighter::highlightDiff(QTextStream &in, bool numberLines)
+{
+    // Removed and added lines can leave the highlighter in different
+    // contexts, so each side of the diff keeps its own state.  Lines between
+    // hunks aren't part of the diff, so both start over at each hunk.
+    using KSyntaxHighlighting::Theme;
+    const bool darkTheme = QColor(theme().backgroundColor(Theme::Normal)).lightness() < 128;
+    const QString addBackground = diff_background(m_palette,
+            darkTheme ? QColor(0x1e, 0x3c, 0x1e) : QColor(0xdc, 0xfa, 0xdc));
+    const QString removeBackground = diff_background(m_palette,
+            darkTheme ? QColor(0x46, 0x1e, 0x1e) : QColor(0xfa, 0xdc, 0xdc));
+
+    KSyntaxHighlighting::State oldState;
+    KSyntaxHighlighting::State newState;
+    int oldRemaining = 0;
+    int newRemaining = 0;
+    QString oldPath;
+
+    // Code lines are numbered as in the file they come from: removed lines
+    // by the old one, everything else by the new one
+    int oldLine = 0;
+    int newLine = 0;
+    auto writeGutter = [this, numberLines]() {
+        if (numberLines)
+            m_output << QString(8, QLatin1Char(' '));
+    };
+
+    startBudget();
+    while (!in.atEnd()) {
+        const QString text = readLine(in);
+        ++m_lineNumber;
+
+        if (oldRemaining > 0 || newRemaining > 0) {
+            const QChar marker = text.isEmpty() ? QLatin1Char(' ') : text.at(0);
+            const QString code = text.mid(1);
+            if (marker == QLatin1Char('+') && newRemaining > 0) {
+                if (numberLines)
+                    writeLineNumber(newLine);
+                newState = renderDiffLine(code, newState, '+', addBackground);
+                ++newLine;
+                --newRemaining;
+                continue;
+            } else if (marker == QLatin1Char('-') && oldRemaining > 0) {
+                if (numberLines)
+                    writeLineNumber(oldLine);
+                oldState = renderDiffLine(code, oldState, '-', removeBackground);
+                ++oldLine;
+                --oldRemaining;
+                continue;
+            } else if (marker == QLatin1Char(' ')) {
+                // Only highlight context twice when the sides disagree
+                const bool sameState = (oldState == newState);
+                if (numberLines)
+                    writeLineNumber(newLine);
+                newState = renderDiffLine(code, newState, ' ', QString());
+                oldState = sameState ? newState : skipLine(code, oldState);
+                ++oldLine;
+                ++newLine;
+                --oldRemaining;
+                --newRemaining;
+                continue;
+            } else if (marker == QLatin1Char('\\')) {
+                // "\ No newline at end of file"
+                writeGutter();
+                m_output << "\033[2m" << text << "\033[0m\n";
+                continue;
+            }
+            oldRemaining = newRemaining = 0;
+        }
+
+        writeGutter();
+        if (text.startsWith(QLatin1String("@@"))
+                && parse_hunk_header(text, &oldLine, &oldRemaining, &newLine, &newRemaining)) {
+            oldState = newState = KSyntaxHighlighting::State();
+            m_output << "\033[36m" << text << "\033[0m\n";
+            continue;
+        }
+
+        if (text.startsWith(QLatin1String("--- "))) {
+            oldPath = diff_path(text);
+        } else if (text.startsWith(QLatin1String("+++ "))) {
+            // Deleted files only have a path on the old side
+            QString path = diff_path(text);
+            if (path.isEmpty())
+                path = oldPath;
+            setDefinition(m_diffLookup(path));
+        } else if (!text.startsWith(QLatin1String("diff "))) {
+            m_output << text << "\n";
+            continue;
+        }
+        m_output << "\033[1m" << text << "\033[0m\n";
+    }
+
+    TraceSpan span("flush", "file");
+    m_output.flush();
+}
+
+// Returns where the last lines of the device start
+static qint64 tail_start(QIODevice *device, int lines)
+{
+    static const qint64 BlockSize = 64 * 1024;
+    const qint64 size = device->size();
+
+    int found = 0;
+    qint64 end = size;
+    while (end > 0) {
+        const qint64 start = qMax<qint64>(0, end - BlockSize);
+        if (!device->seek(start))
+            return 0;
+        const QByteArray block = device->read(end - start);
+        if (block.size() != end - start)
+            return 0;
+
+        for (int i = block.size() - 1; i >= 0; --i) {
+            // The newline at the very end doesn't start another line
+            if (block.at(i) == '\n' && start + i != size - 1 && ++found == lines)
+                return start + i + 1;
+        }
+        end = start;
+    }
+    return 0;
+}
+
+/* Numbering the --tail lines means counting every line before them, which
+ * reads the whole file.  Like the viewer's quick index, that's only done
+ * when the part before the tail is small; otherwise the numbers show "?". */
+static const qint64 TailCountBytes = 1024 * 1024;
+
+static int count_lines(QIODevice *device, qint64 end)
+{
+    static const qint64 BlockSize = 1024 * 1024;
+
+    int lines = 0;
+    if (!device->seek(0))
+        return 0;
+    for (qint64 pos = 0; pos < end; ) {
+        const QByteArray block = device->read(qMin(BlockSize, end - pos));
+        if (block.isEmpty())
+            break;
+        lines += block.count('\n');
+        pos += block.size();
+    }
+    return lines;
+}
+
+void EscCodeHighlighter::highlightTail(QTextStream &in, bool numberLines)
+{
+    startBudget();
+    if (m_tokens)
+        m_tokens->beginFile();
+
+    struct TailLine
+    {
+        QString m_text;
+        KSyntaxHighlighting::State m_state;
+    };
+    QQueue<TailLine> tail;
+
+    KSyntaxHighlighting::State state;
+    int line = 0;
+    bool lineKnown = true;
+
+    if (m_tailSettle < 0) {
+        // Every line goes through the highlighter, but only the tail gets
+        // formatted, starting from the exact state of its first line
+        while (!in.atEnd()) {
+            const QString text = readLine(in);
+            ++line;
+            tail.enqueue(TailLine{text, state});
+            if (tail.size() > m_tailLines)
+                tail.dequeue();
+            m_lineNumber = line;
+            state = skipLine(text, state);
+        }
+        if (!tail.isEmpty())
+            state = tail.head().m_state;
+    } else {
+        // Files that can seek skip straight to the lines we need.  Anything
+        // else has to be read through, but only the last lines are kept.
+        const int window = m_tailLines + m_tailSettle;
+        QIODevice *device = in.device();
+        if (device && !device->isSequential()) {
+            TraceSpan span("seek tail", "file");
+            const qint64 start = tail_start(device, window);
+            if (numberLines && start <= TailCountBytes)
+                line = count_lines(device, start);
+            else if (start > 0)
+                lineKnown = false;
+            in.seek(start);
+        }
+        while (!in.atEnd()) {
+            tail.enqueue(TailLine{readLine(in), state});
+            ++line;
+            if (tail.size() > window)
+                tail.dequeue();
+        }
+
+        // The state can't be known without highlighting everything before,
+        // so the settle lines start from the default one and are dropped
+        const int tailCount = qMin(tail.size(), m_tailLines);
+        while (tail.size() > tailCount) {
+            m_lineNumber = line - tail.size() + 1;
+            state = skipLine(tail.dequeue().m_text, state);
+        }
+    }
+
+    const bool tracing = TraceLog::isEnabled();
+    line -= tail.size();
+    while (!tail.isEmpty()) {
+        const TailLine next = tail.dequeue();
+        ++line;
+        if (numberLines)
+            writeLineNumber(lineKnown ? line : UnknownLineNumber);
+        const qint64 lineStart = tracing ? TraceLog::now() : 0;
+        m_lineNumber = line;
+        SRCCAT_PROBE(line_start, line);
+        state = renderLine(next.m_text, state);
+        SRCCAT_PROBE(line_end, line, m_rendered.size());
+        if (tracing)
+            TraceLog::addLineSpan(line, lineStart);
+    }
+
+    TraceSpan span("flush", "file");
+    if (m_tokens)
+        m_tokens->flush();
+    m_output.flush();
+    for (const auto &output : m_extraOutputs)
+        output.m_stream->flush();
+}
@@ -0,0 +1,140 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "line_filter.h"
+
+#include <cstring>
+
+// Escapes that are complete after a single letter
+static const char SingleEscapes[] = "abBdDeAfGhHKnrRsStvVwWXzZ";
+
+/* Find the longest run of literal characters that every match of the
+ * pattern must contain.  This is deliberately conservative: anything inside
+ * a group is ignored, and a top-level alternation disables the prefilter
+ * since no single literal is required. */
+
+static QString required_literal(const QString &pattern, bool *literalOnly)
+{
+    QString best, run;
+    int depth = 0;
+    *literalOnly = true;
+
+    auto endRun = [&]() {
+        if (run.size() > best.size())
+            best = run;
+        run.clear();
+    };
+
+    for (int i = 0; i < pattern.size(); ++i) {
+        const QChar ch = pattern.at(i);
+        switch (ch.unicode()) {
+        case '\\':
+            if (i + 1 < pattern.size() && !pattern.at(i + 1).isLetterOrNumber()) {
+                // Escaped punctuation is just a literal character
+                if (depth == 0)
+                    run += pattern.at(i + 1);
+                ++i;
+                *literalOnly = false;
+                continue;
+            }
+            if (i + 1 < pattern.size() && (pattern.at(i + 1).unicode() > 0x7f
+                    || !strchr(SingleEscapes, pattern.at(i + 1).toLatin1()))) {
+                // Hex, octal and named characters, back references, \Q...\E
+                // and properties all run on past the next character, and
+                // what they match isn't worth working out here
+                *literalOnly = false;
+                return QString();
+            }
+            // Character classes, anchors and the like
+            ++i;
+            break;
+        case '[':
+            {
+                int end = i + 1;
+                if (end < pattern.size() && pattern.at(end) == QLatin1Char('^'))
+                    ++end;
+                if (end < pattern.size() && pattern.at(end) == QLatin1Char(']'))
+                    ++end;
+                while (end < pattern.size() && pattern.at(end) != QLatin1Char(']')) {
+                    if (pattern.at(end) == QLatin1Char('\\'))
+                        ++end;
+                    ++end;
+                }
+                i = end;
+            }
+            break;
+        case '*':
+        case '?':
+            // The previous character is optional
+            if (depth == 0)
+                run.chop(1);
+            break;
+        case '{':
+            if (depth == 0)
+                run.chop(1);
+            while (i + 1 < pattern.size() && pattern.at(i) != QLatin1Char('}'))
+                ++i;
+            break;
+        case '(':
+            if (i + 2 < pattern.size() && pattern.at(i + 1) == QLatin1Char('?')
+                    && (pattern.at(i + 2).isLetter() || pattern.at(i + 2) == QLatin1Char('-'))) {
+                // Inline options like (?i) can change what a literal matches
+                *literalOnly = false;
+                return QString();
+            }
+            ++depth;
+            break;
+        case ')':
+            --depth;
+            break;
+        case '|':
+            if (depth == 0) {
+                *literalOnly = false;
+                return QString();
+            }
+            break;
+        case '.':
+        case '^':
+        case '$':
+        case '+':
+            break;
+        default:
+            if (depth == 0)
+                run += ch;
+            continue;
+        }
+
+        // Anything that reached here was not a plain literal character
+        *literalOnly = false;
+        endRun();
+    }
+
+    endRun();
+    return best;
+}
+
+LineFilter::LineFilter(const QString &pattern)
+    : m_regex(pattern), m_hasLiteral(), m_literalOnly()
+{
+    const QString literal = required_literal(pattern, &m_literalOnly);
+    if (!literal.isEmpty()) {
+        m_literal.setPattern(literal);
+        m_hasLiteral = true;
+    }
+    if (!m_literalOnly)
+        m_regex.optimize();
+}
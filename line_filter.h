@@ -0,0 +1,50 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LINE_FILTER_H
+#define _LINE_FILTER_H
+
+#include <QRegularExpression>
+#include <QStringMatcher>
+
+/* Selects lines matching a regular expression.  Before running the regex,
+ * each line is checked for the longest literal substring that any match
+ * must contain, which rejects most non-matching lines without touching the
+ * regex engine at all.  Plain literal patterns skip the regex entirely. */
+class LineFilter
+{
+public:
+    explicit LineFilter(const QString &pattern);
+
+    bool isValid() const { return m_regex.isValid(); }
+    QString errorString() const { return m_regex.errorString(); }
+
+    bool matches(const QString &line) const
+    {
+        if (m_hasLiteral && m_literal.indexIn(line) < 0)
+            return false;
+        return m_literalOnly || m_regex.match(line).hasMatch();
+    }
+
+private:
+    QRegularExpression m_regex;
+    QStringMatcher m_literal;
+    bool m_hasLiteral;
+    bool m_literalOnly;
+};
+
+#endif // _LINE_FILTER_H
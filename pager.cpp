@@ -16,6 +16,7 @@
  */
 
 #include "pager.h"
+#include "probes.h"
 
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -118,6 +119,8 @@ qint64 PagerProcess::writeData(const char *data, qint64 maxSize)
         /* try again */
     }
 
+    SRCCAT_PROBE(pager_write, maxSize, bytes);
+
     if (bytes < 0) {
         perror("PagerProcess::writeData");
 
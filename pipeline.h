@@ -0,0 +1,83 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include <QSemaphore>
+#include <QString>
+#include <QThread>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+/* A bounded queue passing items from exactly one producer thread to exactly
+ * one consumer thread.  The producer blocks while all `depth` slots are
+ * full, and the consumer blocks while they are all empty.  Since the two
+ * sides never touch the same slot at once, the semaphores are the only
+ * synchronization needed. */
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int depth)
+        : m_slots(depth), m_free(depth), m_used(0), m_head(0), m_tail(0) { }
+
+    void push(T &&item)
+    {
+        m_free.acquire();
+        m_slots[m_tail] = std::move(item);
+        m_tail = (m_tail + 1) % int(m_slots.size());
+        m_used.release();
+    }
+
+    T pop()
+    {
+        m_used.acquire();
+        T item = std::move(m_slots[m_head]);
+        m_head = (m_head + 1) % int(m_slots.size());
+        m_free.release();
+        return item;
+    }
+
+private:
+    std::vector<T> m_slots;
+    QSemaphore m_free;
+    QSemaphore m_used;
+    int m_head;
+    int m_tail;
+};
+
+// Runs one stage of a pipeline on its own (named) thread
+class PipelineThread : public QThread
+{
+public:
+    PipelineThread(const char *name, std::function<void()> stage)
+        : m_stage(std::move(stage))
+    {
+        setObjectName(QLatin1String(name));
+    }
+
+protected:
+    void run() Q_DECL_OVERRIDE { m_stage(); }
+
+private:
+    std::function<void()> m_stage;
+};
+
+#endif // _PIPELINE_H
@@ -0,0 +1,44 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PROBES_H
+#define _PROBES_H
+
+/* USDT probes in the "srccat" provider, for bpftrace and perf.  They are
+ * only compiled in when configured with -DSRCCAT_USDT=ON (which needs
+ * <sys/sdt.h>, e.g. from systemtap-sdt-dev); otherwise the macro expands to
+ * nothing and its arguments are never evaluated.  When compiled in, each
+ * probe is a single nop until a tracer attaches to it.
+ *
+ *   file_start(path)                   path is a C string, "" for stdin
+ *   file_end(path, lines)
+ *   line_start(line)                   1-based line number
+ *   line_end(line, rendered_length)    length in UTF-16 units
+ *   span(offset, length, format_id)
+ *   palette_lookup(rgb, index)         rgb as 0xRRGGBB
+ *   pager_write(requested, written)    written is -1 on errors
+ *
+ * See tools/usdt/ for example bpftrace scripts. */
+
+#ifdef SRCCAT_USDT
+#include <sys/sdt.h>
+#define SRCCAT_PROBE(name, ...) STAP_PROBEV(srccat, name, ##__VA_ARGS__)
+#else
+#define SRCCAT_PROBE(name, ...) do { } while (0)
+#endif
+
+#endif // _PROBES_H
@@ -16,9 +16,26 @@
  */
 
 #include "esc_highlight.h"
+#include "dir_walker.h"
+#include "line_filter.h"
+#include "trace.h"
+#include "highlight_cache.h"
+#include "content_detect.h"
+#include "token_stream.h"
+#include "stats.h"
+#include "syntax_profile.h"
+#include "transcode.h"
+#include "theme_colors.h"
 
 #ifndef Q_OS_WIN
 #include "pager.h"
+#include "file_prefetch.h"
+#include "viewer.h"
+#include "adaptive.h"
+
+#include <unistd.h>
+#include <csignal>
+#include <cstring>
 #endif
 
 #include <KSyntaxHighlighting/Repository>
@@ -33,6 +50,12 @@
 #include <QTranslator>
 #include <QLibraryInfo>
 #include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <vector>
 
 static KSyntaxHighlighting::Repository *syntax_repo()
 {
@@ -66,11 +89,145 @@ static const EscPalette *detect_palette()
     }
 }
 
+static const EscPalette *palette_for_name(const QString &colorType)
+{
+    if (colorType == "auto")
+        return detect_palette();
+    for (const EscPalette *palette : EscPalette::builtins()) {
+        if (colorType == QLatin1String(palette->name()))
+            return palette;
+    }
+    return Q_NULLPTR;
+}
+
+#ifndef Q_OS_WIN
+static bool remap_supported(const EscPalette *detected)
+{
+    // OSC 4 only makes sense when writing straight to a terminal that has a
+    // 256 color palette to change.  The Linux console ignores it, and
+    // there's no way to ask without waiting for a reply that may never come.
+    if (!isatty(STDOUT_FILENO))
+        return false;
+    const QByteArray term = qgetenv("TERM");
+    if (term.isEmpty() || term == "dumb" || term == "linux")
+        return false;
+    return detected == EscPalette::Palette256() || detected->isTrueColor();
+}
+
+/* Lets --watch finish like any other run on SIGINT or SIGTERM.  The
+ * handler only writes to a pipe, and the event loop quits when that
+ * becomes readable. */
+static int s_quitPipe[2] = { -1, -1 };
+
+static void on_quit_signal(int)
+{
+    const char byte = 0;
+    const ssize_t written = ::write(s_quitPipe[1], &byte, 1);
+    (void)written;
+}
+
+static void quit_on_signals(QCoreApplication *app)
+{
+    if (::pipe(s_quitPipe) < 0)
+        return;
+    auto notifier = new QSocketNotifier(s_quitPipe[0], QSocketNotifier::Read, app);
+    QObject::connect(notifier, &QSocketNotifier::activated, app, &QCoreApplication::quit);
+
+    struct sigaction quitAction;
+    memset(&quitAction, 0, sizeof(quitAction));
+    quitAction.sa_handler = on_quit_signal;
+    sigemptyset(&quitAction.sa_mask);
+    sigaction(SIGINT, &quitAction, Q_NULLPTR);
+    sigaction(SIGTERM, &quitAction, Q_NULLPTR);
+}
+#endif
+
+/* Programs the --colors remap slots into the terminal once output actually
+ * starts, so errors in the remaining options never leave it remapped, and
+ * resets them on any return from main() after that.  Apart from SIGINT and
+ * SIGTERM in --watch, a signal still leaves the terminal remapped. */
+class PaletteRemap
+{
+public:
+    PaletteRemap() : m_output(), m_applied() { }
+    ~PaletteRemap() { restore(); }
+
+    void set(QTextStream *output, const QByteArray &setup, const QByteArray &restore)
+    {
+        m_output = output;
+        m_setup = setup;
+        m_restore = restore;
+    }
+    bool isSet() const { return !m_setup.isEmpty(); }
+
+    void apply()
+    {
+        if (isSet() && !m_applied) {
+            write(m_setup);
+            m_applied = true;
+        }
+    }
+
+    void restore()
+    {
+        if (m_applied) {
+            write(m_restore);
+            m_applied = false;
+        }
+    }
+
+private:
+    QTextStream *m_output;
+    QByteArray m_setup;
+    QByteArray m_restore;
+    bool m_applied;
+
+    void write(const QByteArray &sequence)
+    {
+        m_output->flush();
+        fwrite(sequence.constData(), 1, sequence.size(), stdout);
+        fflush(stdout);
+    }
+};
+
+/* Passes the output through to where it actually goes, noting when the
+ * first bytes got there for --startup-budget and --stats. */
+class FirstWriteClock : public QIODevice
+{
+public:
+    explicit FirstWriteClock(QIODevice *target) : m_target(target), m_firstWrite(-1)
+    {
+        QIODevice::open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+    }
+
+    // TraceLog time of the first write, or -1 if nothing was written
+    qint64 firstWrite() const { return m_firstWrite; }
+
+protected:
+    qint64 readData(char *, qint64) Q_DECL_OVERRIDE { return -1; }
+
+    qint64 writeData(const char *data, qint64 maxSize) Q_DECL_OVERRIDE
+    {
+        const qint64 written = m_target->write(data, maxSize);
+
+        // QTextStream only flushes files itself, and it can't see this one
+        if (QFileDevice *file = qobject_cast<QFileDevice *>(m_target))
+            file->flush();
+        if (m_firstWrite < 0 && written > 0)
+            m_firstWrite = TraceLog::now();
+        return written;
+    }
+
+private:
+    QIODevice *m_target;
+    qint64 m_firstWrite;
+};
+
 static KSyntaxHighlighting::Definition detect_highlighter_mime(const QString &filename)
 {
     using KSyntaxHighlighting::Definition;
 
-    QMimeDatabase mimeDb;
+    static QMimeDatabase mimeDb;
     const auto &mime = mimeDb.mimeTypeForFile(filename);
     if (mime.isDefault() || mime.name() == QStringLiteral("text/plain"))
         return Definition();
@@ -93,14 +250,36 @@ static KSyntaxHighlighting::Definition detect_highlighter_mime(const QString &fi
     return matchDef;
 }
 
-static KSyntaxHighlighting::Definition detect_highlighter(const QString &filename)
+static ContentDetector *content_detector()
+{
+    static ContentDetector s_detector(syntax_repo());
+    return &s_detector;
+}
+
+static KSyntaxHighlighting::Definition detect_highlighter(const QString &filename,
+                                                          QIODevice *content = Q_NULLPTR)
 {
     auto definition = syntax_repo()->definitionForFileName(filename);
     if (definition.isValid())
         return definition;
+
+    // Peeking leaves the data in the device's buffer, so for stdin only the
+    // prefix is held back before the rest is streamed as usual
+    if (content) {
+        definition = content_detector()->detect(content->peek(ContentDetector::PrefixSize));
+        if (definition.isValid())
+            return definition;
+    }
     return detect_highlighter_mime(filename);
 }
 
+// Records a startup phase for both the --trace timeline and --stats
+static void end_phase(const char *name, qint64 start, const QString &detail = QString())
+{
+    TraceLog::addSpan(name, "startup", start, detail);
+    RunStats::addTime(name, TraceLog::now() - start);
+}
+
 static bool environ_to_bool(const char *varName)
 {
     if (qEnvironmentVariableIsEmpty(varName))
@@ -114,10 +293,15 @@ static bool environ_to_bool(const char *varName)
 
 int main(int argc, char *argv[])
 {
+    TraceLog::begin();
+    qint64 phaseStart = TraceLog::now();
+
     QCoreApplication app(argc, argv);
     QCoreApplication::setApplicationName(QStringLiteral("srccat"));
     QCoreApplication::setApplicationVersion(QStringLiteral("1.0"));
+    end_phase("create application", phaseStart);
 
+    phaseStart = TraceLog::now();
     QLocale defaultLocale;
     QTranslator qt_translator;
     if (qt_translator.load(defaultLocale, QStringLiteral("qt"), QStringLiteral("_"),
@@ -134,7 +318,9 @@ int main(int argc, char *argv[])
     QTranslator translator;
     if (translator.load(defaultLocale, QStringLiteral(":/srccat"), QStringLiteral("_")))
         QCoreApplication::installTranslator(&translator);
+    end_phase("load translations", phaseStart);
 
+    phaseStart = TraceLog::now();
     QCommandLineParser parser;
     parser.setApplicationDescription(QObject::tr("Syntax highlighting cat tool"));
     auto optHelp = parser.addHelpOption();
@@ -144,9 +330,26 @@ int main(int argc, char *argv[])
 #ifndef Q_OS_WIN
     QCommandLineOption optPager(QStringList{"p", "pager"},
             QObject::tr("Pipe output through $PAGER (or \"less\" if unset)"));
+    QCommandLineOption optView("view",
+            QObject::tr("Page through a file with the built-in viewer, which\n"
+                        "only highlights the lines on screen (q quits, / searches)"));
+    QCommandLineOption optAdaptive("adaptive",
+            QObject::tr("Write cheaper escape codes while the terminal can't keep\n"
+                        "up with the output, such as over slow ssh links"));
+    QCommandLineOption optReadAhead("read-ahead",
+            QObject::tr("Number of upcoming files to open and prefetch while\n"
+                        "highlighting (default = 4, 0 = disabled)"),
+            QObject::tr("files"));
 #endif
     QCommandLineOption optNumberLines(QStringList{"n", "number"},
             QObject::tr("Number source lines"));
+    QCommandLineOption optRecursive(QStringList{"r", "recursive"},
+            QObject::tr("Output all source files below the given directories,\n"
+                        "skipping paths listed in .gitignore or .ignore files"));
+    QCommandLineOption optMaxSize("max-size",
+            QObject::tr("Skip files larger than this in recursive mode\n"
+                        "(default = 1024)"),
+            QObject::tr("KiB"));
     QCommandLineOption optDark(QStringList{"k", "dark"},
             QObject::tr("Use default dark theme"));
     QCommandLineOption optLight(QStringList{"L", "light"},
@@ -158,23 +361,148 @@ int main(int argc, char *argv[])
             QObject::tr("Set syntax defition (default = auto detect)"),
             QObject::tr("lang"));
     QCommandLineOption optColors(QStringList{"C", "colors"},
-            QObject::tr("Supported colors (8, 16, 88, 256, true, auto)"),
+            QObject::tr("Supported colors (8, 16, 88, 256, true, auto, remap)"),
             QObject::tr("colors"));
+    QCommandLineOption optGrep("grep",
+            QObject::tr("Only output lines matching the regular expression"),
+            QObject::tr("pattern"));
+    QCommandLineOption optAfter(QStringList{"A", "after-context"},
+            QObject::tr("Lines of context to show after each --grep match"),
+            QObject::tr("lines"));
+    QCommandLineOption optBefore(QStringList{"B", "before-context"},
+            QObject::tr("Lines of context to show before each --grep match"),
+            QObject::tr("lines"));
+    QCommandLineOption optContext("context",
+            QObject::tr("Lines of context to show around each --grep match"),
+            QObject::tr("lines"));
+    QCommandLineOption optRenderTo("render-to",
+            QObject::tr("Also write the output rendered with another color\n"
+                        "setting and theme to a file, sharing the syntax pass.\n"
+                        "Empty fields use the main settings.  May be repeated."),
+            QObject::tr("colors:theme:file"));
+    QCommandLineOption optCache("cache",
+            QObject::tr("Keep rendered lines in a cache directory, and only\n"
+                        "re-highlight what changed on later runs"),
+            QObject::tr("dir"));
+    QCommandLineOption optWatch("watch",
+            QObject::tr("Keep running until interrupted, and redraw the output\n"
+                        "whenever one of the files changes"));
+    QCommandLineOption optProfileSyntax("profile-syntax",
+            QObject::tr("Print the time spent on each syntax definition and\n"
+                        "format to stderr when done"));
+    QCommandLineOption optStripAnsi("strip-ansi",
+            QObject::tr("Remove escape sequences already in the input before\n"
+                        "highlighting it"));
+    QCommandLineOption optKeepAnsi("keep-ansi",
+            QObject::tr("Pass input lines that already contain escape sequences\n"
+                        "through without highlighting them"));
+    QCommandLineOption optMemo("memo",
+            QObject::tr("Reuse the output of repeated lines, keeping up to this\n"
+                        "much memory of recent lines (default = 0, disabled)"),
+            QObject::tr("MiB"));
+    QCommandLineOption optStats("stats",
+            QObject::tr("Print statistics about the run to stderr when done"));
+    QCommandLineOption optPreview("preview",
+            QObject::tr("Only read and output the first lines of each file,\n"
+                        "clipped to the given width, for file manager and\n"
+                        "fuzzy finder previews (implies no pager)"),
+            QObject::tr("lines[,cols]"));
+    QCommandLineOption optDiff("diff",
+            QObject::tr("Read unified diffs, highlighting the code in each hunk\n"
+                        "using the syntax of the file it belongs to (with -n,\n"
+                        "lines are numbered as in the old or new file)"));
+    QCommandLineOption optPipeline("pipeline",
+            QObject::tr("Read, highlight, format and write output on separate\n"
+                        "threads (plain highlighting only)"));
+    QCommandLineOption optQueueDepth("queue-depth",
+            QObject::tr("Batches of lines buffered between --pipeline stages\n"
+                        "(default = 8)"),
+            QObject::tr("batches"));
+    QCommandLineOption optTail("tail",
+            QObject::tr("Only output the last lines of each file, without\n"
+                        "highlighting everything before them.  With -n, the\n"
+                        "tail of a file over about 1 MB is numbered \"?\""),
+            QObject::tr("lines"));
+    QCommandLineOption optTailSettle("tail-settle",
+            QObject::tr("Lines before the --tail output to highlight first so\n"
+                        "the syntax state can settle, or \"all\" to highlight\n"
+                        "the whole file for exact output (default = 100)"),
+            QObject::tr("lines"));
+    QCommandLineOption optLineBudget("line-budget",
+            QObject::tr("Write lines that take longer than this to highlight\n"
+                        "without colors (default = 0, no limit)"),
+            QObject::tr("msec"));
+    QCommandLineOption optFileBudget("file-budget",
+            QObject::tr("Write the rest of a file without colors once\n"
+                        "highlighting it has taken this long (default = 0)"),
+            QObject::tr("msec"));
+    QCommandLineOption optEmitTokens("emit-tokens",
+            QObject::tr("Write a binary token stream of the syntax pass instead\n"
+                        "of escape codes, to render later with --from-tokens"));
+    QCommandLineOption optFromTokens("from-tokens",
+            QObject::tr("Render token streams written by --emit-tokens, using\n"
+                        "the current theme and color settings"));
+    QCommandLineOption optTranscode("transcode-colors",
+            QObject::tr("Rewrite the truecolor escape codes in already colored\n"
+                        "input for the given colors, without highlighting again"),
+            QObject::tr("colors"));
+    QCommandLineOption optTrace("trace",
+            QObject::tr("Write a Chrome trace-event timeline of the run to a file"),
+            QObject::tr("file"));
+    QCommandLineOption optTraceLines("trace-lines",
+            QObject::tr("Include a span in the --trace timeline for each line\n"
+                        "taking at least this long to highlight"),
+            QObject::tr("usec"));
     QCommandLineOption optListThemes("theme-list",
             QObject::tr("List all supported themes"));
     QCommandLineOption optListSyntax("syntax-list",
             QObject::tr("List all supported syntax definitions"));
+    QCommandLineOption optStartupBudget("startup-budget",
+            QObject::tr("Exit with an error if the first output takes longer than this"),
+            QObject::tr("msec"));
+    optStartupBudget.setFlags(QCommandLineOption::HiddenFromHelp);
 #ifndef Q_OS_WIN
     parser.addOption(optPager);
+    parser.addOption(optView);
+    parser.addOption(optAdaptive);
+    parser.addOption(optReadAhead);
 #endif
     parser.addOption(optNumberLines);
+    parser.addOption(optRecursive);
+    parser.addOption(optMaxSize);
     parser.addOption(optDark);
     parser.addOption(optLight);
     parser.addOption(optTheme);
     parser.addOption(optSyntax);
     parser.addOption(optColors);
+    parser.addOption(optGrep);
+    parser.addOption(optAfter);
+    parser.addOption(optBefore);
+    parser.addOption(optContext);
+    parser.addOption(optRenderTo);
+    parser.addOption(optCache);
+    parser.addOption(optWatch);
+    parser.addOption(optProfileSyntax);
+    parser.addOption(optStripAnsi);
+    parser.addOption(optKeepAnsi);
+    parser.addOption(optMemo);
+    parser.addOption(optStats);
+    parser.addOption(optPreview);
+    parser.addOption(optDiff);
+    parser.addOption(optPipeline);
+    parser.addOption(optQueueDepth);
+    parser.addOption(optTail);
+    parser.addOption(optTailSettle);
+    parser.addOption(optLineBudget);
+    parser.addOption(optFileBudget);
+    parser.addOption(optEmitTokens);
+    parser.addOption(optFromTokens);
+    parser.addOption(optTranscode);
+    parser.addOption(optTrace);
+    parser.addOption(optTraceLines);
     parser.addOption(optListThemes);
     parser.addOption(optListSyntax);
+    parser.addOption(optStartupBudget);
 
     if (!parser.parse(QCoreApplication::arguments())) {
         fprintf(stderr, "%s\n", qPrintable(parser.errorText()));
@@ -193,7 +521,39 @@ int main(int argc, char *argv[])
         ::exit(0);
     }
 
-    const QStringList files = parser.positionalArguments();
+    if (parser.isSet(optTrace)) {
+        TraceLog::setOutput(parser.value(optTrace));
+        if (parser.isSet(optTraceLines)) {
+            bool ok;
+            const qint64 threshold = parser.value(optTraceLines).toLongLong(&ok);
+            if (!ok || threshold < 0) {
+                fputs(qPrintable(QObject::tr("Invalid trace threshold: %1\n")
+                                 .arg(parser.value(optTraceLines))), stderr);
+                return 1;
+            }
+            TraceLog::setLineThreshold(threshold * 1000);
+        }
+    } else {
+        TraceLog::discard();
+    }
+
+    qint64 startupBudget = -1;
+    if (parser.isSet(optStartupBudget)) {
+        bool ok;
+        startupBudget = parser.value(optStartupBudget).toLongLong(&ok);
+        if (!ok || startupBudget < 0) {
+            fputs(qPrintable(QObject::tr("Invalid startup budget: %1\n")
+                             .arg(parser.value(optStartupBudget))), stderr);
+            return 1;
+        }
+    }
+    end_phase("parse arguments", phaseStart);
+
+    RunStats::setEnabled(parser.isSet(optStats));
+    if (RunStats::isEnabled())
+        RunStats::setTotal("memo hits", "highlighted lines");
+
+    QStringList files = parser.positionalArguments();
 
     if (parser.isSet(optListThemes)) {
         puts(qPrintable(QObject::tr("Supported themes:")));
@@ -220,6 +580,60 @@ int main(int argc, char *argv[])
         ::exit(0);
     }
 
+    if (parser.isSet(optTranscode)) {
+        // Only needs the palette, so no themes or syntax definitions get loaded
+        const EscPalette *target = palette_for_name(parser.value(optTranscode));
+        if (!target) {
+            fputs(qPrintable(QObject::tr("Invalid color option: %1\n").arg(parser.value(optTranscode))),
+                  stderr);
+            fputs(qPrintable(QObject::tr("Supported values are: 8, 16, 88, 256, true, auto\n")),
+                  stderr);
+            return 1;
+        }
+        if (files.isEmpty())
+            files.append(QStringLiteral("-"));
+
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        SgrTranscoder transcoder(target);
+        int exitStatus = 0;
+        for (const QString &file : files) {
+            QFile in;
+            bool opened;
+            if (file == "-") {
+                opened = in.open(stdin, QIODevice::ReadOnly);
+            } else {
+                in.setFileName(file);
+                opened = in.open(QIODevice::ReadOnly);
+            }
+            if (!opened) {
+                fputs(qPrintable(QObject::tr("Could not open %1 for reading\n").arg(file)),
+                      stderr);
+                exitStatus = 1;
+                continue;
+            }
+
+            TraceSpan span("transcode", "file", file);
+            if (!transcoder.transcode(&in, &out)) {
+                fputs(qPrintable(QObject::tr("%1: %2\n").arg(file, transcoder.errorString())),
+                      stderr);
+                exitStatus = 1;
+            }
+        }
+        out.flush();
+        RunStats::count("transcoded colors", transcoder.rewrittenColors());
+        RunStats::addTime("total", TraceLog::now());
+        if (!TraceLog::finish())
+            exitStatus = 1;
+        RunStats::print();
+        return exitStatus;
+    }
+
+    phaseStart = TraceLog::now();
+    (void)syntax_repo();
+    end_phase("load syntax repository", phaseStart);
+
+    phaseStart = TraceLog::now();
     KSyntaxHighlighting::Theme theme;
     if (parser.isSet(optTheme))
         theme = syntax_repo()->theme(parser.value(optTheme));
@@ -233,81 +647,582 @@ int main(int argc, char *argv[])
             defaultTheme = KSyntaxHighlighting::Repository::DarkTheme;
         theme = syntax_repo()->defaultTheme(defaultTheme);
     }
+    end_phase("select theme", phaseStart, theme.name());
 
+    phaseStart = TraceLog::now();
     const EscPalette *palette;
-    if (parser.isSet(optColors)) {
-        QString colorType = parser.value(optColors);
-        if (colorType == "auto")
-            palette = detect_palette();
-        else if (colorType == "true")
-            palette = EscPalette::TrueColor();
-        else if (colorType == "8")
-            palette = EscPalette::Palette8();
-        else if (colorType == "16")
-            palette = EscPalette::Palette16();
-        else if (colorType == "88")
-            palette = EscPalette::Palette88();
-        else if (colorType == "256")
-            palette = EscPalette::Palette256();
-        else {
-            fputs(qPrintable(QObject::tr("Invalid color option: %1\n").arg(colorType)),
+    const bool remapColors = parser.value(optColors) == "remap";
+    if (remapColors) {
+        // Replaced by the remapped palette once we know where output goes
+        palette = detect_palette();
+    } else if (parser.isSet(optColors)) {
+        palette = palette_for_name(parser.value(optColors));
+        if (!palette) {
+            fputs(qPrintable(QObject::tr("Invalid color option: %1\n").arg(parser.value(optColors))),
                   stderr);
-            fputs(qPrintable(QObject::tr("Supported values are: 8, 16, 88, 256, true, auto\n")),
+            fputs(qPrintable(QObject::tr("Supported values are: 8, 16, 88, 256, true, auto, remap\n")),
                   stderr);
             return 1;
         }
     } else {
         palette = detect_palette();
     }
+    end_phase("select palette", phaseStart);
+
+    const bool watch = parser.isSet(optWatch);
+    const bool emitTokens = parser.isSet(optEmitTokens);
+    const bool preview = parser.isSet(optPreview);
 
 #ifndef Q_OS_WIN
+    const bool view = parser.isSet(optView);
+    if (view && (files.size() != 1 || files.first() == "-" || !isatty(STDOUT_FILENO))) {
+        fputs(qPrintable(QObject::tr("--view needs a single file and a terminal to show it on\n")),
+              stderr);
+        return 1;
+    }
+
     // Needs to be declared before outputStream, so that outputStream gets
     // deleted before pagerProcess in case there is any lingering output
     std::unique_ptr<PagerProcess> pagerProcess;
+    std::unique_ptr<AdaptiveOutput> adaptiveOutput;
 #endif
+    QFile stdoutFile;
+    std::unique_ptr<FirstWriteClock> outputClock;
     std::unique_ptr<QTextStream> outputStream;
+    QIODevice *outputDevice = Q_NULLPTR;
 
 #ifndef Q_OS_WIN
-    if (parser.isSet(optPager) || !qEnvironmentVariableIsEmpty("SRCCAT_PAGER")) {
+    const bool fromTokens = parser.isSet(optFromTokens);
+    const bool adaptive = parser.isSet(optAdaptive) && !emitTokens && !view && !fromTokens;
+    if (parser.isSet(optAdaptive) && !adaptive) {
+        fputs(qPrintable(QObject::tr("--adaptive has no effect with --view, --emit-tokens or --from-tokens\n")),
+              stderr);
+    }
+    if (!watch && !emitTokens && !preview && !view && !adaptive && (parser.isSet(optPager) || !qEnvironmentVariableIsEmpty("SRCCAT_PAGER"))) {
+        phaseStart = TraceLog::now();
         pagerProcess.reset(PagerProcess::create());
-        if (pagerProcess)
-            outputStream.reset(new QTextStream(pagerProcess.get()));
+        outputDevice = pagerProcess.get();
+        end_phase("spawn pager", phaseStart);
+    }
+#endif
+
+    // Anything not written to the terminal keeps using the detected palette
+    const EscPalette *basePalette = palette;
+    QByteArray remapSetup, remapRestore;
+#ifndef Q_OS_WIN
+    if (remapColors && !pagerProcess && !watch && !emitTokens && !preview
+            && remap_supported(palette)) {
+        palette = EscPalette::Remapped(theme_colors({theme}), &remapSetup, &remapRestore);
+    }
+
+    if (adaptive) {
+        // Only step through the levels that actually make the output
+        // cheaper with the palette the highlighter ends up using
+        QVector<EscCodeHighlighter::OutputLevel> levels{EscCodeHighlighter::FullOutput};
+        if (palette->isTrueColor())
+            levels.append(EscCodeHighlighter::Reduced256);
+        if (palette->isTrueColor() || palette->colorCount() > 16)
+            levels.append(EscCodeHighlighter::Reduced16);
+        levels.append(EscCodeHighlighter::NoAttributes);
+        levels.append(EscCodeHighlighter::MergedSpans);
+        adaptiveOutput.reset(new AdaptiveOutput(STDOUT_FILENO, levels));
+        outputDevice = adaptiveOutput.get();
+    }
+#endif
+    if (!outputDevice) {
+        stdoutFile.open(stdout, QIODevice::WriteOnly);
+        outputDevice = &stdoutFile;
+    }
+    outputClock.reset(new FirstWriteClock(outputDevice));
+    outputStream.reset(new QTextStream(outputClock.get()));
+
+    PaletteRemap remap;
+    if (!remapSetup.isEmpty())
+        remap.set(outputStream.get(), remapSetup, remapRestore);
+
+    const bool numberLines = parser.isSet(optNumberLines) || environ_to_bool("SRCCAT_NUMBER");
+    int exitStatus = 0;
+
+    if (parser.isSet(optFromTokens)) {
+        // Only the theme is needed here; no syntax definition gets loaded
+        TokenRenderer renderer(theme, palette);
+        remap.apply();
+        for (const QString &file : files) {
+            QFile in;
+            bool opened;
+            if (file == "-") {
+                opened = in.open(stdin, QIODevice::ReadOnly);
+            } else {
+                in.setFileName(file);
+                opened = in.open(QIODevice::ReadOnly);
+            }
+            if (!opened) {
+                fputs(qPrintable(QObject::tr("Could not open %1 for reading\n").arg(file)),
+                      stderr);
+                exitStatus = 1;
+                continue;
+            }
+
+            TraceSpan span("render tokens", "file", file);
+            outputStream->flush();
+            if (!renderer.render(in.readAll(), outputStream->device(), numberLines)) {
+                fputs(qPrintable(QObject::tr("%1: %2\n").arg(file, renderer.errorString())),
+                      stderr);
+                exitStatus = 1;
+            }
+        }
+        if (!TraceLog::finish())
+            exitStatus = 1;
+        remap.restore();
+
+#ifndef Q_OS_WIN
+        if (pagerProcess) {
+            int pagerStatus = pagerProcess->exec();
+            if (pagerStatus != 0)
+                exitStatus = pagerStatus;
+        }
+#endif
+        return exitStatus;
+    }
+
+#ifndef Q_OS_WIN
+    if (view) {
+        const QString &file = files.first();
+        Viewer viewer(palette);
+        viewer.setTheme(theme);
+        viewer.setNumberLines(numberLines);
+        if (!viewer.open(file)) {
+            fputs(qPrintable(QObject::tr("Could not open %1 for reading\n").arg(file)), stderr);
+            return 1;
+        }
+
+        if (parser.isSet(optSyntax)) {
+            viewer.setDefinition(syntax_repo()->definitionForName(parser.value(optSyntax)));
+        } else {
+            QFile in(file);
+            in.open(QIODevice::ReadOnly);
+            viewer.setDefinition(detect_highlighter(file, &in));
+        }
+
+        remap.apply();
+        if (!viewer.exec()) {
+            fputs(qPrintable(QObject::tr("%1\n").arg(viewer.errorString())), stderr);
+            exitStatus = 1;
+        }
+        remap.restore();
+        return exitStatus;
     }
 #endif
-    if (!outputStream)
-        outputStream.reset(new QTextStream(stdout));
 
     EscCodeHighlighter highlighter(*outputStream);
     highlighter.setTheme(theme);
     highlighter.setPalette(palette);
+    highlighter.setCountRemapSavings(remap.isSet() && RunStats::isEnabled());
+#ifndef Q_OS_WIN
+    highlighter.setAdaptiveOutput(adaptiveOutput.get());
+#endif
+    QStringList remapReport;
 
     if (parser.isSet(optSyntax))
         highlighter.setDefinition(syntax_repo()->definitionForName(parser.value(optSyntax)));
 
-    const bool numberLines = parser.isSet(optNumberLines) || environ_to_bool("SRCCAT_NUMBER");
+    std::unique_ptr<LineFilter> lineFilter;
+    if (parser.isSet(optGrep)) {
+        lineFilter.reset(new LineFilter(parser.value(optGrep)));
+        if (!lineFilter->isValid()) {
+            fputs(qPrintable(QObject::tr("Invalid pattern: %1\n")
+                             .arg(lineFilter->errorString())), stderr);
+            return 1;
+        }
 
-    int exitStatus = 0;
+        int contextLines[2] = {0, 0};
+        const QCommandLineOption *contextOpts[2] = {&optBefore, &optAfter};
+        for (int i = 0; i < 2; ++i) {
+            const QCommandLineOption &opt = parser.isSet(*contextOpts[i])
+                                          ? *contextOpts[i] : optContext;
+            if (!parser.isSet(opt))
+                continue;
+            bool ok;
+            contextLines[i] = parser.value(opt).toInt(&ok);
+            if (!ok || contextLines[i] < 0) {
+                fputs(qPrintable(QObject::tr("Invalid context line count: %1\n")
+                                 .arg(parser.value(opt))), stderr);
+                return 1;
+            }
+        }
+        highlighter.setLineFilter(lineFilter.get(), contextLines[0], contextLines[1]);
+    }
 
-    for (const QString &file : files) {
-        if (!parser.isSet(optSyntax))
-            highlighter.setDefinition(detect_highlighter(file));
+    std::unique_ptr<SyntaxProfile> profile;
+    if (parser.isSet(optProfileSyntax)) {
+        profile.reset(new SyntaxProfile);
+        highlighter.setProfile(profile.get());
+    }
 
-        if (file == "-") {
-            QTextStream stream(stdin);
-            highlighter.highlightFile(stream, numberLines);
-        } else {
-            QFile in(file);
-            if (in.open(QIODevice::ReadOnly)) {
-                QTextStream stream(&in);
-                highlighter.highlightFile(stream, numberLines);
+    if (parser.isSet(optStripAnsi) && parser.isSet(optKeepAnsi)) {
+        fputs(qPrintable(QObject::tr("--strip-ansi and --keep-ansi cannot be combined\n")), stderr);
+        return 1;
+    }
+    if (parser.isSet(optStripAnsi))
+        highlighter.setAnsiMode(EscCodeHighlighter::StripAnsi);
+    else if (parser.isSet(optKeepAnsi))
+        highlighter.setAnsiMode(EscCodeHighlighter::KeepAnsi);
+
+    if (parser.isSet(optMemo)) {
+        bool ok;
+        const qint64 memoSize = parser.value(optMemo).toLongLong(&ok);
+        if (!ok || memoSize < 0) {
+            fputs(qPrintable(QObject::tr("Invalid memo size: %1\n")
+                             .arg(parser.value(optMemo))), stderr);
+            return 1;
+        }
+        highlighter.setMemoBudget(memoSize * 1024 * 1024);
+    }
+
+    if (parser.isSet(optPipeline)) {
+        int depth = 8;
+        if (parser.isSet(optQueueDepth)) {
+            bool ok;
+            depth = parser.value(optQueueDepth).toInt(&ok);
+            if (!ok || depth <= 0) {
+                fputs(qPrintable(QObject::tr("Invalid queue depth: %1\n")
+                                 .arg(parser.value(optQueueDepth))), stderr);
+                return 1;
+            }
+        }
+        highlighter.setPipelineDepth(depth);
+    }
+
+    if (parser.isSet(optTail)) {
+        if (lineFilter) {
+            fputs(qPrintable(QObject::tr("--tail cannot be combined with --grep\n")), stderr);
+            return 1;
+        }
+        bool ok;
+        const int tailLines = parser.value(optTail).toInt(&ok);
+        if (!ok || tailLines <= 0) {
+            fputs(qPrintable(QObject::tr("Invalid tail line count: %1\n")
+                             .arg(parser.value(optTail))), stderr);
+            return 1;
+        }
+        int settle = 100;
+        if (parser.isSet(optTailSettle)) {
+            if (parser.value(optTailSettle) == QLatin1String("all")) {
+                settle = -1;
+            } else {
+                settle = parser.value(optTailSettle).toInt(&ok);
+                if (!ok || settle < 0) {
+                    fputs(qPrintable(QObject::tr("Invalid settle line count: %1\n")
+                                     .arg(parser.value(optTailSettle))), stderr);
+                    return 1;
+                }
+            }
+        }
+        highlighter.setTail(tailLines, settle);
+    }
+
+    qint64 budgets[2] = {0, 0};
+    const QCommandLineOption *budgetOpts[2] = {&optLineBudget, &optFileBudget};
+    for (int i = 0; i < 2; ++i) {
+        if (!parser.isSet(*budgetOpts[i]))
+            continue;
+        bool ok;
+        budgets[i] = parser.value(*budgetOpts[i]).toLongLong(&ok);
+        if (!ok || budgets[i] < 0) {
+            fputs(qPrintable(QObject::tr("Invalid time budget: %1\n")
+                             .arg(parser.value(*budgetOpts[i]))), stderr);
+            return 1;
+        }
+    }
+    highlighter.setTimeBudget(budgets[0], budgets[1]);
+
+    std::vector<std::unique_ptr<QFile>> renderFiles;
+    std::vector<std::unique_ptr<QTextStream>> renderStreams;
+    for (const QString &spec : parser.values(optRenderTo)) {
+        const QString colorType = spec.section(QLatin1Char(':'), 0, 0);
+        const QString themeName = spec.section(QLatin1Char(':'), 1, 1);
+        const QString filename = spec.section(QLatin1Char(':'), 2);
+        if (filename.isEmpty()) {
+            fputs(qPrintable(QObject::tr("Invalid render target: %1\n").arg(spec)), stderr);
+            return 1;
+        }
+
+        const EscPalette *renderPalette = colorType.isEmpty() ? basePalette
+                                        : palette_for_name(colorType);
+        if (!renderPalette) {
+            fputs(qPrintable(QObject::tr("Invalid color option: %1\n").arg(colorType)),
+                  stderr);
+            return 1;
+        }
+        auto renderTheme = theme;
+        if (!themeName.isEmpty()) {
+            renderTheme = syntax_repo()->theme(themeName);
+            if (!renderTheme.isValid()) {
+                fputs(qPrintable(QObject::tr("Unknown theme: %1\n").arg(themeName)), stderr);
+                return 1;
+            }
+        }
+
+        renderFiles.emplace_back(new QFile(filename));
+        if (!renderFiles.back()->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            fputs(qPrintable(QObject::tr("Could not open %1 for writing\n").arg(filename)),
+                  stderr);
+            return 1;
+        }
+        renderStreams.emplace_back(new QTextStream(renderFiles.back().get()));
+        highlighter.addOutput(*renderStreams.back(), renderTheme, renderPalette);
+    }
+    if (highlighter.hasExtraOutputs() && (lineFilter || parser.isSet(optCache)
+                                          || parser.isSet(optWatch))) {
+        fputs(qPrintable(QObject::tr("--render-to cannot be combined with --grep, --cache or --watch\n")),
+              stderr);
+        return 1;
+    }
+
+    std::unique_ptr<QFile> tokenFile;
+    std::unique_ptr<TokenWriter> tokenWriter;
+    if (emitTokens) {
+        if (lineFilter || highlighter.hasExtraOutputs() || parser.isSet(optCache) || watch) {
+            fputs(qPrintable(QObject::tr("--emit-tokens cannot be combined with --grep, --render-to, --cache or --watch\n")),
+                  stderr);
+            return 1;
+        }
+        tokenFile.reset(new QFile);
+        tokenFile->open(stdout, QIODevice::WriteOnly);
+        tokenWriter.reset(new TokenWriter(tokenFile.get()));
+        highlighter.setTokenWriter(tokenWriter.get());
+    }
+
+    if (preview) {
+        if (lineFilter || watch || parser.isSet(optDiff) || parser.isSet(optTail)) {
+            fputs(qPrintable(QObject::tr("--preview cannot be combined with --grep, --watch, --diff or --tail\n")),
+                  stderr);
+            return 1;
+        }
+        const QString spec = parser.value(optPreview);
+        bool linesOk, columnsOk = true;
+        const int previewLines = spec.section(QLatin1Char(','), 0, 0).toInt(&linesOk);
+        int previewColumns = 0;
+        if (spec.contains(QLatin1Char(',')))
+            previewColumns = spec.section(QLatin1Char(','), 1).toInt(&columnsOk);
+        if (!linesOk || !columnsOk || previewLines <= 0 || previewColumns < 0) {
+            fputs(qPrintable(QObject::tr("Invalid preview size: %1\n").arg(spec)), stderr);
+            return 1;
+        }
+        highlighter.setPreview(previewLines, previewColumns);
+
+#ifndef Q_OS_WIN
+        // Previewers close the pipe as soon as they have enough, and may
+        // have left SIGPIPE ignored for their children
+        ::signal(SIGPIPE, SIG_DFL);
+#endif
+    }
+
+    const bool diff = parser.isSet(optDiff);
+    if (diff) {
+        if (lineFilter || highlighter.hasExtraOutputs() || emitTokens || parser.isSet(optTail)) {
+            fputs(qPrintable(QObject::tr("--diff cannot be combined with --grep, --render-to, --emit-tokens or --tail\n")),
+                  stderr);
+            return 1;
+        }
+        // Only the names of the files inside a diff are known
+        highlighter.setDiffMode([](const QString &path) { return detect_highlighter(path); });
+
+        // Mostly used as a pager for git, which writes to stdin
+        if (files.isEmpty())
+            files.append(QStringLiteral("-"));
+    }
+
+    // Watch mode always keeps the cache in memory, so redraws only need to
+    // re-highlight the lines that were edited
+    std::unique_ptr<HighlightCache> cache;
+    if (parser.isSet(optCache) || watch) {
+        cache.reset(new HighlightCache(parser.value(optCache)));
+        highlighter.setCache(cache.get());
+    }
+
+    // Both only apply to plain highlighting, and the other modes take over
+    const bool budgeted = parser.isSet(optLineBudget) || parser.isSet(optFileBudget);
+    if (parser.isSet(optPipeline)
+            && (budgeted || profile || adaptive || parser.isSet(optKeepAnsi) || emitTokens
+                || highlighter.hasExtraOutputs() || lineFilter || cache || parser.isSet(optTail)
+                || diff || preview)) {
+        fputs(qPrintable(QObject::tr("--pipeline cannot be combined with --line-budget, --file-budget,\n"
+                                     "--profile-syntax, --adaptive, --keep-ansi, --emit-tokens, --render-to,\n"
+                                     "--grep, --cache, --watch, --tail, --diff or --preview\n")),
+              stderr);
+        return 1;
+    }
+    if (parser.isSet(optMemo)
+            && (parser.isSet(optPipeline) || emitTokens || highlighter.hasExtraOutputs()
+                || profile || adaptive)) {
+        fputs(qPrintable(QObject::tr("--memo cannot be combined with --pipeline, --emit-tokens, --render-to,\n"
+                                     "--profile-syntax or --adaptive\n")),
+              stderr);
+        return 1;
+    }
+
+    const bool recursive = parser.isSet(optRecursive);
+    if (recursive) {
+        DirWalker walker;
+        if (parser.isSet(optMaxSize)) {
+            bool ok;
+            const qint64 maxSize = parser.value(optMaxSize).toLongLong(&ok);
+            if (!ok || maxSize < 0) {
+                fputs(qPrintable(QObject::tr("Invalid maximum file size: %1\n")
+                                 .arg(parser.value(optMaxSize))), stderr);
+                return 1;
+            }
+            walker.setMaxFileSize(maxSize * 1024);
+        }
+        if (files.isEmpty())
+            files.append(QStringLiteral("."));
+        phaseStart = TraceLog::now();
+        files = walker.walk(files);
+        end_phase("walk directories", phaseStart);
+    }
+
+#ifndef Q_OS_WIN
+    // Only worth the extra thread when there's more than one file to read
+    int readAhead = 4;
+    if (parser.isSet(optReadAhead)) {
+        bool ok;
+        readAhead = parser.value(optReadAhead).toInt(&ok);
+        if (!ok || readAhead < 0) {
+            fputs(qPrintable(QObject::tr("Invalid read-ahead count: %1\n")
+                             .arg(parser.value(optReadAhead))), stderr);
+            return 1;
+        }
+    }
+    std::unique_ptr<FilePrefetcher> prefetcher;
+    if (readAhead > 0 && files.size() > 1 && !watch) {
+        prefetcher.reset(new FilePrefetcher(files, readAhead));
+        prefetcher->start();
+    }
+#endif
+
+    auto highlightFiles = [&]() {
+        int status = 0;
+        for (int fileIndex = 0; fileIndex < files.size(); ++fileIndex) {
+            const QString &file = files.at(fileIndex);
+            if (recursive)
+                highlighter.writeHeader(file);
+
+            const qint64 openStart = TraceLog::now();
+            QFile in;
+            bool opened;
+            if (file == "-") {
+                opened = in.open(stdin, QIODevice::ReadOnly);
             } else {
+                in.setFileName(file);
+#ifndef Q_OS_WIN
+                if (prefetcher) {
+                    int error;
+                    const int fd = prefetcher->take(fileIndex, &error);
+                    opened = fd >= 0 && in.open(fd, QIODevice::ReadOnly,
+                                                QFileDevice::AutoCloseHandle);
+                    if (fd >= 0 && !opened)
+                        ::close(fd);
+                } else
+#endif
+                {
+                    opened = in.open(QIODevice::ReadOnly);
+                }
+            }
+            TraceLog::addSpan("open", "file", openStart, file);
+
+            if (!opened) {
                 fputs(qPrintable(QObject::tr("Could not open %1 for reading\n").arg(file)),
                       stderr);
-                exitStatus = 1;
+                status = 1;
+                continue;
             }
+
+            if (!parser.isSet(optSyntax) && !diff) {
+                // The first lookup also pays for setting up QMimeDatabase
+                const qint64 detectStart = TraceLog::now();
+                highlighter.setDefinition(detect_highlighter(file, &in));
+                TraceLog::addSpan("detect", "file", detectStart, file);
+                RunStats::addTime("detect syntax", TraceLog::now() - detectStart);
+            }
+
+            TraceSpan span("highlight", "file", file);
+            QTextStream stream(&in);
+            highlighter.setSourcePath(file == "-" ? QString() : QFileInfo(file).absoluteFilePath());
+            highlighter.highlightFile(stream, numberLines);
+            if (remap.isSet() && RunStats::isEnabled()) {
+                const qint64 saved = highlighter.takeRemapSavings();
+                RunStats::count("remap bytes saved", saved);
+                remapReport.append(QObject::tr("%1: %2 bytes saved by remapping\n")
+                                   .arg(file).arg(saved));
+            }
+        }
+        return status;
+    };
+
+    remap.apply();
+    exitStatus = highlightFiles();
+
+    const qint64 firstOutput = outputClock->firstWrite();
+    if (firstOutput >= 0)
+        RunStats::addTime("time to first output", firstOutput);
+    if (startupBudget >= 0) {
+        if (firstOutput < 0) {
+            // Nothing to measure doesn't count as meeting the budget
+            fputs(qPrintable(QObject::tr("No output was produced within the startup budget\n")),
+                  stderr);
+            exitStatus = 1;
+        } else if (firstOutput > startupBudget * 1000000) {
+            fputs(qPrintable(QObject::tr("First output took %1 ms, over the budget of %2 ms\n")
+                             .arg(firstOutput / 1000000).arg(startupBudget)), stderr);
+            exitStatus = 1;
         }
     }
 
+#ifndef Q_OS_WIN
+    prefetcher.reset();
+#endif
+    if (!TraceLog::finish())
+        exitStatus = 1;
+
+    if (watch) {
+        QFileSystemWatcher watcher;
+        auto watchFiles = [&]() {
+            // Editors that save by replacing the file drop it from the
+            // watch list, so keep adding back any that exist again
+            const QStringList watched = watcher.files();
+            for (const QString &file : files) {
+                if (file != "-" && !watched.contains(file) && QFile::exists(file))
+                    watcher.addPath(file);
+            }
+        };
+        watchFiles();
+
+        // Coalesce the burst of change notifications from a single save
+        QTimer redraw;
+        redraw.setSingleShot(true);
+        redraw.setInterval(50);
+        QObject::connect(&watcher, &QFileSystemWatcher::fileChanged,
+                         [&](const QString &) { redraw.start(); });
+        QObject::connect(&redraw, &QTimer::timeout, [&]() {
+            watchFiles();
+            *outputStream << "\033[H\033[2J";
+            exitStatus = highlightFiles();
+        });
+
+        // Windows has no equivalent, so Ctrl+C there ends --watch without
+        // the cleanup and stats below
+#ifndef Q_OS_WIN
+        quit_on_signals(&app);
+#endif
+        app.exec();
+    }
+
+    remap.restore();
+
+    // Not counting the time spent reading in the pager
+    RunStats::addTime("total", TraceLog::now());
+
 #ifndef Q_OS_WIN
     if (pagerProcess) {
         int pagerStatus = pagerProcess->exec();
@@ -316,5 +1231,16 @@ int main(int argc, char *argv[])
     }
 #endif
 
+    if (profile)
+        profile->print(20);
+    for (const QString &line : remapReport)
+        fputs(qPrintable(line), stderr);
+#ifndef Q_OS_WIN
+    if (adaptiveOutput && RunStats::isEnabled()) {
+        outputStream->flush();
+        adaptiveOutput->printChanges();
+    }
+#endif
+    RunStats::print();
     return exitStatus;
 }
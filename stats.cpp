@@ -0,0 +1,129 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+
+#include <QMutex>
+#include <QVector>
+
+#include <cstdio>
+#include <cstring>
+
+bool RunStats::s_enabled = true;
+
+namespace {
+
+struct Counter
+{
+    const char *m_name;
+    const char *m_total;
+    qint64 m_value;
+    bool m_time;
+};
+
+QMutex s_mutex;
+
+// Allocated one by one, so that RunStats::counter() handles stay valid
+QVector<Counter *> s_counters;
+
+// These are called with s_mutex held.  There are only ever a handful of
+// counters, so a linear search is fine.
+Counter *find_counter(const char *name)
+{
+    for (Counter *counter : s_counters) {
+        if (strcmp(counter->m_name, name) == 0)
+            return counter;
+    }
+    return Q_NULLPTR;
+}
+
+Counter &add_counter(const char *name)
+{
+    if (Counter *counter = find_counter(name))
+        return *counter;
+    s_counters.append(new Counter{name, Q_NULLPTR, 0, false});
+    return *s_counters.last();
+}
+
+}
+
+void RunStats::setEnabled(bool enabled)
+{
+    s_enabled = enabled;
+    if (!enabled) {
+        QMutexLocker locker(&s_mutex);
+        qDeleteAll(s_counters);
+        s_counters.clear();
+    }
+}
+
+void RunStats::count(const char *name, qint64 amount)
+{
+    if (!s_enabled)
+        return;
+
+    QMutexLocker locker(&s_mutex);
+    add_counter(name).m_value += amount;
+}
+
+qint64 *RunStats::counter(const char *name)
+{
+    if (!s_enabled)
+        return Q_NULLPTR;
+
+    QMutexLocker locker(&s_mutex);
+    return &add_counter(name).m_value;
+}
+
+void RunStats::addTime(const char *name, qint64 nsecs)
+{
+    if (!s_enabled)
+        return;
+
+    QMutexLocker locker(&s_mutex);
+    Counter &counter = add_counter(name);
+    counter.m_value += nsecs;
+    counter.m_time = true;
+}
+
+void RunStats::setTotal(const char *name, const char *total)
+{
+    QMutexLocker locker(&s_mutex);
+    add_counter(name).m_total = total;
+}
+
+void RunStats::print()
+{
+    if (!s_enabled)
+        return;
+
+    QMutexLocker locker(&s_mutex);
+    for (const Counter *counter : s_counters) {
+        if (counter->m_time) {
+            fprintf(stderr, "%-24s %12.3f ms\n", counter->m_name, counter->m_value / 1e6);
+            continue;
+        }
+        fprintf(stderr, "%-24s %12lld", counter->m_name,
+                static_cast<long long>(counter->m_value));
+        const Counter *total = counter->m_total ? find_counter(counter->m_total) : Q_NULLPTR;
+        if (total && total->m_value > 0) {
+            fprintf(stderr, "  (%.1f%% of %s)", 100.0 * counter->m_value / total->m_value,
+                    counter->m_total);
+        }
+        fputc('\n', stderr);
+    }
+}
@@ -0,0 +1,54 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <QtGlobal>
+
+/* Named counters and timings reported on stderr by --stats at the end of a
+ * run.  They are printed in the order they were first recorded, counters
+ * optionally as a share of another counter.  Like TraceLog, values are
+ * collected from the start of main(), before we know if stats were asked
+ * for, and recording costs a single flag check once they're turned off. */
+class RunStats
+{
+public:
+    // Keep what was recorded so far, or throw it away and stop recording
+    static void setEnabled(bool enabled);
+    static bool isEnabled() { return s_enabled; }
+
+    // Adds amount to the counter (does nothing if not enabled)
+    static void count(const char *name, qint64 amount);
+
+    // The counter itself, for loops that can't take count()'s lock and lookup
+    // on every pass.  Null if not enabled; only one thread may update it.
+    static qint64 *counter(const char *name);
+
+    // Adds to a duration, reported in milliseconds
+    static void addTime(const char *name, qint64 nsecs);
+
+    // Print name as a percentage of total, when total is nonzero
+    static void setTotal(const char *name, const char *total);
+
+    static void print();
+
+private:
+    static bool s_enabled;
+};
+
+#endif // _STATS_H
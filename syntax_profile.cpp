@@ -0,0 +1,135 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "syntax_profile.h"
+
+#include <KSyntaxHighlighting/Format>
+#include <QCoreApplication>
+
+#include <algorithm>
+#include <cstdio>
+
+void SyntaxProfile::addSpan(const KSyntaxHighlighting::Format &format, int length)
+{
+    m_lineSpans.append(qMakePair(format.id(), length));
+
+    auto iter = m_formats.find(format.id());
+    if (iter == m_formats.end()) {
+        FormatCost cost;
+        cost.m_name = format.name();
+        cost.m_spans = 0;
+        cost.m_chars = 0;
+        cost.m_nsecs = 0.0;
+        iter = m_formats.insert(format.id(), cost);
+    }
+    ++iter->m_spans;
+    iter->m_chars += length;
+}
+
+void SyntaxProfile::indexDefinition(const KSyntaxHighlighting::Definition &definition)
+{
+    // The outer definition claims its formats first, so a format is only
+    // credited to an included definition when it really comes from there
+    m_indexedDefinition = definition;
+    QVector<KSyntaxHighlighting::Definition> definitions{definition};
+    for (const auto &included : definition.includedDefinitions())
+        definitions.append(included);
+
+    for (const auto &def : definitions) {
+        for (const auto &format : def.formats()) {
+            if (!m_owners.contains(format.id()))
+                m_owners.insert(format.id(), def.name());
+        }
+    }
+}
+
+void SyntaxProfile::endLine(const KSyntaxHighlighting::Definition &definition, qint64 nsecs)
+{
+    if (definition != m_indexedDefinition)
+        indexDefinition(definition);
+
+    ++m_lines;
+    m_nsecs += nsecs;
+
+    qint64 chars = 0;
+    for (const auto &span : m_lineSpans)
+        chars += span.second;
+    if (chars == 0) {
+        m_emptyNsecs += nsecs;
+        return;
+    }
+
+    for (const auto &span : m_lineSpans) {
+        FormatCost &cost = m_formats[span.first];
+        if (cost.m_definition.isEmpty())
+            cost.m_definition = m_owners.value(span.first, QStringLiteral("?"));
+        cost.m_nsecs += double(nsecs) * span.second / chars;
+    }
+}
+
+void SyntaxProfile::print(int top) const
+{
+    struct DefinitionCost
+    {
+        QString m_name;
+        qint64 m_spans;
+        double m_nsecs;
+    };
+    QVector<DefinitionCost> definitions;
+    QVector<FormatCost> formats;
+    for (const auto &cost : m_formats) {
+        formats.append(cost);
+        auto def = std::find_if(definitions.begin(), definitions.end(),
+                                [&](const DefinitionCost &d) { return d.m_name == cost.m_definition; });
+        if (def == definitions.end()) {
+            definitions.append(DefinitionCost{cost.m_definition, cost.m_spans, cost.m_nsecs});
+        } else {
+            def->m_spans += cost.m_spans;
+            def->m_nsecs += cost.m_nsecs;
+        }
+    }
+    std::sort(definitions.begin(), definitions.end(),
+              [](const DefinitionCost &l, const DefinitionCost &r) { return l.m_nsecs > r.m_nsecs; });
+    std::sort(formats.begin(), formats.end(),
+              [](const FormatCost &l, const FormatCost &r) { return l.m_nsecs > r.m_nsecs; });
+
+    const double totalMsecs = m_nsecs / 1.0e6;
+    auto percent = [&](double nsecs) { return m_nsecs ? 100.0 * nsecs / m_nsecs : 0.0; };
+
+    fputs(qPrintable(QObject::tr("Syntax profile: %1 lines, %2 ms in highlightLine()\n")
+                     .arg(m_lines).arg(totalMsecs, 0, 'f', 3)), stderr);
+
+    fputs(qPrintable(QObject::tr("  Definitions:\n")), stderr);
+    for (const auto &def : definitions) {
+        fprintf(stderr, "    %10.3f ms %5.1f%% %10lld spans  %s\n", def.m_nsecs / 1.0e6,
+                percent(def.m_nsecs), static_cast<long long>(def.m_spans),
+                qPrintable(def.m_name));
+    }
+    if (m_emptyNsecs) {
+        fprintf(stderr, "    %10.3f ms %5.1f%% %10s        %s\n", m_emptyNsecs / 1.0e6,
+                percent(m_emptyNsecs), "", qPrintable(QObject::tr("(empty lines)")));
+    }
+
+    fputs(qPrintable(QObject::tr("  Formats:\n")), stderr);
+    for (int i = 0; i < formats.size() && i < top; ++i) {
+        const FormatCost &cost = formats.at(i);
+        fprintf(stderr, "    %10.3f ms %5.1f%% %10lld spans %10lld chars  %s/%s\n",
+                cost.m_nsecs / 1.0e6, percent(cost.m_nsecs),
+                static_cast<long long>(cost.m_spans), static_cast<long long>(cost.m_chars),
+                qPrintable(cost.m_definition), qPrintable(cost.m_name));
+    }
+}
@@ -0,0 +1,73 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SYNTAX_PROFILE_H
+#define _SYNTAX_PROFILE_H
+
+#include <KSyntaxHighlighting/Definition>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+namespace KSyntaxHighlighting
+{
+    class Format;
+}
+
+/* Attributes the time spent in highlightLine() to the formats it produced,
+ * and through them to the definitions (including included ones) that own
+ * those formats.  KSyntaxHighlighting doesn't say which rule matched, so
+ * each line's time is split between its spans in proportion to their
+ * length; slow rules still stand out through the formats they apply. */
+class SyntaxProfile
+{
+public:
+    SyntaxProfile() : m_lines(), m_nsecs(), m_emptyNsecs() { }
+
+    void beginLine() { m_lineSpans.clear(); }
+    void addSpan(const KSyntaxHighlighting::Format &format, int length);
+    void endLine(const KSyntaxHighlighting::Definition &definition, qint64 nsecs);
+
+    // Prints the most expensive definitions and formats to stderr
+    void print(int top) const;
+
+private:
+    struct FormatCost
+    {
+        QString m_name;
+        QString m_definition;
+        qint64 m_spans;
+        qint64 m_chars;
+        double m_nsecs;
+    };
+
+    QHash<quint16, FormatCost> m_formats;
+    QVector<QPair<quint16, int>> m_lineSpans;
+
+    // Which definition each format id belongs to
+    QHash<quint16, QString> m_owners;
+    KSyntaxHighlighting::Definition m_indexedDefinition;
+
+    qint64 m_lines;
+    qint64 m_nsecs;
+    qint64 m_emptyNsecs;
+
+    void indexDefinition(const KSyntaxHighlighting::Definition &definition);
+};
+
+#endif // _SYNTAX_PROFILE_H
@@ -0,0 +1,8 @@
+// A tiny input for the startup tests and benchmarks
+#include <cstdio>
+
+int main()
+{
+    printf("Hello, world\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "line_filter.h"
+
+#include <QObject>
+
+#include <cstdio>
+
+struct FilterCase
+{
+    const char *pattern;
+    const char *line;
+    bool matches;
+};
+
+int main()
+{
+    // The prefilter must never reject a line the regex itself would match
+    const FilterCase cases[] = {
+        {"foo", "a foo b", true},
+        {"foo", "a fo b", false},
+        {"fo+bar", "fooobar", true},
+        {"\\bword\\b", "a word here", true},
+        {"a\\.b", "a.b", true},
+        {"a\\.b", "axb", false},
+        {"\\x41BC", "ABC", true},
+        {"\\x{41}BC", "ABC", true},
+        {"\\101BC", "ABC", true},
+        {"\\o{101}BC", "ABC", true},
+        {"(a)\\1bc", "aabc", true},
+        {"\\QA|B\\E", "A|B", true},
+        {"\\p{Lu}xyz", "Axyz", true},
+        {"\\N{U+0041}BC", "ABC", true},
+        {"\\cAxyz", "\001xyz", true},
+    };
+
+    int failures = 0;
+    for (const auto &test : cases) {
+        LineFilter filter(QString::fromLatin1(test.pattern));
+        if (!filter.isValid()) {
+            fputs(qPrintable(QObject::tr("%1: invalid pattern: %2\n")
+                             .arg(QString::fromLatin1(test.pattern), filter.errorString())),
+                  stderr);
+            ++failures;
+        } else if (filter.matches(QString::fromLatin1(test.line)) != test.matches) {
+            fputs(qPrintable(QObject::tr("%1: expected \"%2\" to %3\n")
+                             .arg(QString::fromLatin1(test.pattern), QString::fromLatin1(test.line),
+                                  test.matches ? QStringLiteral("match")
+                                               : QStringLiteral("not match"))),
+                  stderr);
+            ++failures;
+        }
+    }
+    return failures ? 1 : 0;
+}
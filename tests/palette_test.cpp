@@ -0,0 +1,333 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esc_color.h"
+#include "theme_colors.h"
+
+#include <KSyntaxHighlighting/Repository>
+#include <QCoreApplication>
+#include <QFile>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cstdio>
+
+/* Checks the colors each indexed palette picks against a golden table,
+ * which lists the mapping of every color used by the installed themes and
+ * of a coarse grid over the RGB cube, along with a fingerprint of the
+ * mappings and the mean and max error over a much finer grid.  After a
+ * deliberate change to the lookups, regenerate it with
+ *     palette_test --update <table>
+ * and explain the moved mappings in the commit message. */
+
+// Error values are written with this many decimals, and compared to within
+// one step of the last one
+static const int ErrorDecimals = 4;
+static const double ErrorTolerance = 1.0e-4;
+
+// Every level of the xterm color cube is on both grids
+static const int FineGridStep = 5;
+static const int CoarseGridStep = 51;
+
+static QVector<QColor> grid_colors(int step)
+{
+    QVector<QColor> colors;
+    for (int r = 0; r <= 255; r += step) {
+        for (int g = 0; g <= 255; g += step) {
+            for (int b = 0; b <= 255; b += step)
+                colors.append(QColor(r, g, b));
+        }
+    }
+    return colors;
+}
+
+struct ErrorStats
+{
+    ErrorStats() : m_total(), m_max(), m_count() { }
+
+    void add(float error)
+    {
+        m_total += error;
+        m_max = std::max(m_max, double(error));
+        ++m_count;
+    }
+
+    double mean() const { return m_count ? m_total / m_count : 0.0; }
+
+    double m_total;
+    double m_max;
+    int m_count;
+};
+
+// "error <set> <count> <HSL mean> <HSL max> <Lab dE mean> <Lab dE max>"
+static QString error_line(const QString &set, const EscPalette *palette,
+                          const QVector<QColor> &samples)
+{
+    ErrorStats hslError, labError;
+    for (const auto &color : samples) {
+        const QColor match = palette->color(palette->closestIndex(color));
+        hslError.add(EscPalette::distance(color, match, EscPalette::HslSpace));
+        labError.add(EscPalette::distance(color, match, EscPalette::LabSpace));
+    }
+
+    return QStringLiteral("error %1 %2 %3 %4 %5 %6").arg(set).arg(samples.size())
+            .arg(hslError.mean(), 0, 'f', ErrorDecimals)
+            .arg(hslError.m_max, 0, 'f', ErrorDecimals)
+            .arg(labError.mean(), 0, 'f', ErrorDecimals)
+            .arg(labError.m_max, 0, 'f', ErrorDecimals);
+}
+
+// "map <set> <color> <closest palette color> <foreground code>"
+static QString map_line(const QString &set, const EscPalette *palette, const QColor &color)
+{
+    const QColor match = palette->color(palette->closestIndex(color));
+    return QStringLiteral("map %1 %2 %3 %4").arg(set, color.name(), match.name(),
+                                                 QString::fromLatin1(palette->foreground(color)));
+}
+
+// "fingerprint <hash>", an FNV-1a over the color chosen for each grid color
+static QString fingerprint_line(const EscPalette *palette, const QVector<QColor> &grid)
+{
+    quint32 hash = 2166136261u;
+    for (const auto &color : grid) {
+        const QRgb match = palette->color(palette->closestIndex(color)).rgb();
+        hash = (hash ^ static_cast<quint32>(qRed(match))) * 16777619u;
+        hash = (hash ^ static_cast<quint32>(qGreen(match))) * 16777619u;
+        hash = (hash ^ static_cast<quint32>(qBlue(match))) * 16777619u;
+    }
+    return QStringLiteral("fingerprint %1").arg(hash, 8, 16, QLatin1Char('0'));
+}
+
+static QVector<QColor> installed_theme_colors()
+{
+    KSyntaxHighlighting::Repository repository;
+    QVector<QColor> colors = theme_colors(repository.themes());
+    std::sort(colors.begin(), colors.end(), [](const QColor &l, const QColor &r) {
+        return l.rgb() < r.rgb();
+    });
+    return colors;
+}
+
+static QVector<const EscPalette *> indexed_palettes()
+{
+    QVector<const EscPalette *> palettes;
+    for (const EscPalette *palette : EscPalette::builtins()) {
+        if (!palette->isTrueColor())
+            palettes.append(palette);
+    }
+    return palettes;
+}
+
+static bool write_table(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        fputs(qPrintable(QObject::tr("Could not open %1 for writing\n").arg(filename)), stderr);
+        return false;
+    }
+
+    const QVector<QColor> themeColors = installed_theme_colors();
+    const QVector<QColor> fineGrid = grid_colors(FineGridStep);
+    const QVector<QColor> coarseGrid = grid_colors(CoarseGridStep);
+
+    QTextStream out(&file);
+    out << "# Golden palette mappings for palette_test; regenerate with\n"
+           "#     palette_test --update <this file>\n"
+           "#\n"
+           "# For each palette:\n"
+           "#   fingerprint <hash of the mappings of the " << 256 / FineGridStep + 1
+        << "^3 color grid>\n"
+           "#   error <set> <colors> <HSL mean> <HSL max> <Lab dE mean> <Lab dE max>\n"
+           "#   map <set> <color> <closest palette color> <foreground code>\n"
+           "# where the sets are \"grid\" (the " << 256 / FineGridStep + 1
+        << "^3 grid for errors, " << 256 / CoarseGridStep + 1 << "^3 for maps)\n"
+           "# and \"theme\" (every color of the installed themes).\n";
+
+    for (const EscPalette *palette : indexed_palettes()) {
+        out << "\n[" << palette->name() << "]\n";
+        out << fingerprint_line(palette, fineGrid) << "\n";
+        out << error_line(QStringLiteral("grid"), palette, fineGrid) << "\n";
+        if (!themeColors.isEmpty())
+            out << error_line(QStringLiteral("theme"), palette, themeColors) << "\n";
+        for (const auto &color : themeColors)
+            out << map_line(QStringLiteral("theme"), palette, color) << "\n";
+        for (const auto &color : coarseGrid)
+            out << map_line(QStringLiteral("grid"), palette, color) << "\n";
+    }
+    return true;
+}
+
+static bool check_error_line(const EscPalette *palette, const QString &expected,
+                             const QString &actual)
+{
+    // Only getting worse is a failure; an improvement just needs the table
+    // updated to keep it
+    const QStringList expectedFields = expected.split(QLatin1Char(' '));
+    const QStringList actualFields = actual.split(QLatin1Char(' '));
+    if (expectedFields.size() != 7 || expectedFields.mid(0, 3) != actualFields.mid(0, 3)) {
+        fputs(qPrintable(QObject::tr("  %1 colors: got \"%2\", expected \"%3\"\n")
+                         .arg(QString::fromLatin1(palette->name()), actual, expected)),
+              stderr);
+        return false;
+    }
+
+    bool ok = true;
+    for (int field = 3; field < 7; ++field) {
+        const double limit = expectedFields.at(field).toDouble() + ErrorTolerance;
+        if (actualFields.at(field).toDouble() > limit)
+            ok = false;
+    }
+    if (!ok) {
+        fputs(qPrintable(QObject::tr("  %1 colors: error went up to \"%2\", from \"%3\"\n")
+                         .arg(QString::fromLatin1(palette->name()), actual, expected)),
+              stderr);
+    } else if (actual != expected) {
+        printf("  %s colors: error went down to \"%s\", from \"%s\"\n", palette->name(),
+               qPrintable(actual), qPrintable(expected));
+    }
+    return ok;
+}
+
+static QColor parse_color(const QString &line)
+{
+    // The color is the third field of a map line
+    return QColor(line.section(QLatin1Char(' '), 2, 2));
+}
+
+static bool check_table(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        fputs(qPrintable(QObject::tr("Could not open %1 for reading\n").arg(filename)), stderr);
+        return false;
+    }
+
+    // Everything is recomputed from the colors in the table itself, so
+    // themes installed (or not) on this system don't affect the result
+    struct Section
+    {
+        const EscPalette *m_palette;
+        QStringList m_lines;
+    };
+    QVector<Section> sections;
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        const QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+        if (line.startsWith(QLatin1Char('['))) {
+            const QString name = line.mid(1, line.size() - 2);
+            const EscPalette *palette = Q_NULLPTR;
+            for (const EscPalette *candidate : indexed_palettes()) {
+                if (name == QLatin1String(candidate->name()))
+                    palette = candidate;
+            }
+            if (!palette) {
+                fputs(qPrintable(QObject::tr("Unknown palette \"%1\"\n").arg(name)), stderr);
+                return false;
+            }
+            sections.append(Section{palette, QStringList()});
+        } else if (!sections.isEmpty()) {
+            sections.last().m_lines.append(line);
+        }
+    }
+    if (sections.size() != indexed_palettes().size()) {
+        fputs(qPrintable(QObject::tr("%1 covers %2 palettes, expected %3\n")
+                         .arg(filename).arg(sections.size()).arg(indexed_palettes().size())),
+              stderr);
+        return false;
+    }
+
+    const QVector<QColor> fineGrid = grid_colors(FineGridStep);
+    QSet<QRgb> tableThemeColors;
+    int failures = 0;
+    for (const Section &section : sections) {
+        const EscPalette *palette = section.m_palette;
+        QVector<QColor> themeColors;
+        for (const QString &line : section.m_lines) {
+            if (line.startsWith(QLatin1String("map theme "))) {
+                themeColors.append(parse_color(line));
+                tableThemeColors.insert(themeColors.last().rgb());
+            }
+        }
+
+        int moved = 0;
+        for (const QString &line : section.m_lines) {
+            const QString kind = line.section(QLatin1Char(' '), 0, 0);
+            const QString set = line.section(QLatin1Char(' '), 1, 1);
+            if (kind == QLatin1String("map")) {
+                const QString actual = map_line(set, palette, parse_color(line));
+                if (actual != line) {
+                    fputs(qPrintable(QObject::tr("  %1 colors: got \"%2\", expected \"%3\"\n")
+                                     .arg(QString::fromLatin1(palette->name()), actual, line)),
+                          stderr);
+                    ++moved;
+                }
+            } else if (kind == QLatin1String("fingerprint")) {
+                const QString actual = fingerprint_line(palette, fineGrid);
+                if (actual != line) {
+                    fputs(qPrintable(QObject::tr("  %1 colors: got \"%2\", expected \"%3\"\n")
+                                     .arg(QString::fromLatin1(palette->name()), actual, line)),
+                          stderr);
+                    ++moved;
+                }
+            } else if (kind == QLatin1String("error")) {
+                const QString actual = error_line(set, palette,
+                        set == QLatin1String("theme") ? themeColors : fineGrid);
+                if (!check_error_line(palette, line, actual))
+                    ++failures;
+            } else {
+                fputs(qPrintable(QObject::tr("Unknown line in %1: %2\n").arg(filename, line)),
+                      stderr);
+                ++failures;
+            }
+        }
+        if (moved == 0)
+            printf("  %s colors: ok\n", palette->name());
+        failures += moved;
+    }
+
+    // Not a failure, since the installed themes vary, but the table should
+    // be updated to cover them
+    int uncovered = 0;
+    for (const auto &color : installed_theme_colors()) {
+        if (!tableThemeColors.contains(color.rgb()))
+            ++uncovered;
+    }
+    if (uncovered) {
+        printf("  %d colors of the installed themes aren't in %s; run with --update to add them\n",
+               uncovered, qPrintable(filename));
+    }
+    return failures == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+
+    if (args.size() == 3 && args.at(1) == QLatin1String("--update"))
+        return write_table(args.at(2)) ? 0 : 1;
+    if (args.size() != 2) {
+        fputs(qPrintable(QObject::tr("Usage: palette_test [--update] <table>\n")), stderr);
+        return 1;
+    }
+    return check_table(args.at(1)) ? 0 : 1;
+}
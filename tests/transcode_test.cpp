@@ -0,0 +1,85 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "transcode.h"
+#include "esc_color.h"
+
+#include <QBuffer>
+#include <QObject>
+
+#include <cstdio>
+
+struct TranscodeCase
+{
+    const char *name;
+    const EscPalette *palette;
+    const char *input;
+    const char *expected;
+};
+
+static QByteArray transcode(const EscPalette *palette, const QByteArray &input)
+{
+    QByteArray inData(input), outData;
+    QBuffer in(&inData), out(&outData);
+    in.open(QIODevice::ReadOnly);
+    out.open(QIODevice::WriteOnly);
+    SgrTranscoder transcoder(palette);
+    transcoder.transcode(&in, &out);
+    return outData;
+}
+
+// Escapes shown as \e, so failures are readable on a terminal
+static QByteArray printable(QByteArray text)
+{
+    return text.replace('\033', "\\e");
+}
+
+int main()
+{
+    const TranscodeCase cases[] = {
+        {"plain text", EscPalette::Palette256(),
+         "no escapes here\n", "no escapes here\n"},
+        {"truecolor to 256", EscPalette::Palette256(),
+         "\033[38;2;255;0;0mX\033[0m", "\033[38;5;196mX\033[0m"},
+        {"indexed color untouched", EscPalette::Palette256(),
+         "\033[38;2;255;0;0;48;5;3mX", "\033[38;5;196;48;5;3mX"},
+        {"reset kept", EscPalette::Palette8(),
+         "\033[mX\033[;1mY", "\033[mX\033[;1mY"},
+        // Palette8's bright entries have no background code, so the
+        // background is dropped instead of becoming a trailing "0"
+        {"empty background dropped", EscPalette::Palette8(),
+         "\033[38;2;200;0;0;48;2;0;255;0mX", "\033[1;31mX"},
+        {"empty background between codes", EscPalette::Palette8(),
+         "\033[1;48;2;255;0;0;4mX", "\033[1;4mX"},
+        {"only an empty background", EscPalette::Palette8(),
+         "\033[48;2;255;0;0mX", "X"},
+    };
+
+    int failures = 0;
+    for (const auto &test : cases) {
+        const QByteArray result = transcode(test.palette, test.input);
+        if (result != test.expected) {
+            fputs(qPrintable(QObject::tr("%1: got \"%2\", expected \"%3\"\n")
+                             .arg(QString::fromLatin1(test.name),
+                                  QString::fromLatin1(printable(result)),
+                                  QString::fromLatin1(printable(test.expected)))),
+                  stderr);
+            ++failures;
+        }
+    }
+    return failures ? 1 : 0;
+}
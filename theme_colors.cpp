@@ -0,0 +1,43 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "theme_colors.h"
+
+#include <QSet>
+
+QVector<QColor> theme_colors(const QVector<KSyntaxHighlighting::Theme> &themes)
+{
+    using KSyntaxHighlighting::Theme;
+
+    QSet<QRgb> seen;
+    QVector<QColor> colors;
+    auto addColor = [&](QRgb rgb) {
+        // Unset theme colors are reported as 0 (fully transparent)
+        if (qAlpha(rgb) == 0 || seen.contains(rgb))
+            return;
+        seen.insert(rgb);
+        colors.append(QColor::fromRgba(rgb));
+    };
+
+    for (const auto &theme : themes) {
+        for (int style = Theme::Normal; style <= Theme::Error; ++style) {
+            addColor(theme.textColor(static_cast<Theme::TextStyle>(style)));
+            addColor(theme.backgroundColor(static_cast<Theme::TextStyle>(style)));
+        }
+    }
+    return colors;
+}
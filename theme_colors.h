@@ -0,0 +1,31 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _THEME_COLORS_H
+#define _THEME_COLORS_H
+
+#include <KSyntaxHighlighting/Theme>
+#include <QColor>
+#include <QVector>
+
+/* Every color the given themes set for their text styles, without
+ * duplicates, in the order they're first used.  Colors set only by a
+ * syntax definition's own formats aren't known until its files are
+ * highlighted, so they aren't included. */
+QVector<QColor> theme_colors(const QVector<KSyntaxHighlighting::Theme> &themes);
+
+#endif // _THEME_COLORS_H
@@ -0,0 +1,379 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "token_stream.h"
+#include "esc_color.h"
+
+#include <KSyntaxHighlighting/Format>
+#include <QCoreApplication>
+#include <QIODevice>
+
+#include <cstring>
+
+static const char TokenMagic[4] = {'S', 'C', 'T', '1'};
+
+// Buffered output is written out once it grows past this
+static const int FlushSize = 64 * 1024;
+
+enum FormatFlags
+{
+    HasForeground = 1 << 0,
+    HasBackground = 1 << 1,
+    OverrideBold = 1 << 2,
+    Bold = 1 << 3,
+    OverrideItalic = 1 << 4,
+    Italic = 1 << 5,
+    OverrideUnderline = 1 << 6,
+    Underline = 1 << 7,
+    OverrideStrikeThrough = 1 << 8,
+    StrikeThrough = 1 << 9,
+};
+
+static void put_varint(QByteArray &out, quint32 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+static void put_rgb(QByteArray &out, QRgb rgb)
+{
+    out.append(char(rgb >> 24));
+    out.append(char(rgb >> 16));
+    out.append(char(rgb >> 8));
+    out.append(char(rgb));
+}
+
+static bool get_varint(const uchar *&pos, const uchar *end, quint32 *value)
+{
+    quint32 result = 0;
+    for (int shift = 0; shift < 35 && pos < end; shift += 7) {
+        const uchar byte = *pos++;
+        result |= quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool get_rgb(const uchar *&pos, const uchar *end, QRgb *rgb)
+{
+    if (end - pos < 4)
+        return false;
+    *rgb = (QRgb(pos[0]) << 24) | (QRgb(pos[1]) << 16) | (QRgb(pos[2]) << 8) | QRgb(pos[3]);
+    pos += 4;
+    return true;
+}
+
+TokenWriter::TokenWriter(QIODevice *output)
+    : m_output(output)
+{
+    m_buffer.reserve(FlushSize * 2);
+    m_buffer.append(TokenMagic, sizeof(TokenMagic));
+}
+
+TokenWriter::~TokenWriter()
+{
+    flush();
+}
+
+int TokenWriter::formatId(const KSyntaxHighlighting::Format &format,
+                          const KSyntaxHighlighting::Theme &theme)
+{
+    auto iter = m_formatIds.constFind(format.id());
+    if (iter != m_formatIds.constEnd())
+        return iter.value();
+
+    const int id = m_formatIds.size();
+    m_formatIds.insert(format.id(), id);
+
+    // Override values don't depend on the theme they're queried with
+    quint32 flags = 0;
+    if (format.hasTextColorOverride())
+        flags |= HasForeground;
+    if (format.hasBackgroundColorOverride())
+        flags |= HasBackground;
+    if (format.hasBoldOverride())
+        flags |= OverrideBold | (format.isBold(theme) ? Bold : 0);
+    if (format.hasItalicOverride())
+        flags |= OverrideItalic | (format.isItalic(theme) ? Italic : 0);
+    if (format.hasUnderlineOverride())
+        flags |= OverrideUnderline | (format.isUnderline(theme) ? Underline : 0);
+    if (format.hasStrikeThroughOverride())
+        flags |= OverrideStrikeThrough | (format.isStrikeThrough(theme) ? StrikeThrough : 0);
+
+    m_buffer.append('S');
+    put_varint(m_buffer, id);
+    put_varint(m_buffer, format.textStyle());
+    put_varint(m_buffer, flags);
+    if (flags & HasForeground)
+        put_rgb(m_buffer, format.textColor(theme).rgb());
+    if (flags & HasBackground)
+        put_rgb(m_buffer, format.backgroundColor(theme).rgb());
+    return id;
+}
+
+void TokenWriter::addSpan(int offset, int length, const KSyntaxHighlighting::Format &format,
+                          const KSyntaxHighlighting::Theme &theme)
+{
+    m_spans.append(Span{offset, length, formatId(format, theme)});
+}
+
+void TokenWriter::beginFile()
+{
+    m_buffer.append('F');
+}
+
+void TokenWriter::writeHeader(const QString &title)
+{
+    const QByteArray utf8 = title.toUtf8();
+    m_buffer.append('H');
+    put_varint(m_buffer, utf8.size());
+    m_buffer.append(utf8);
+}
+
+void TokenWriter::writeLine(const QString &text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    m_buffer.append('L');
+    put_varint(m_buffer, utf8.size());
+    m_buffer.append(utf8);
+    put_varint(m_buffer, m_spans.size());
+
+    // Spans come in UTF-16 offsets, which only match the UTF-8 ones for
+    // plain ASCII lines
+    const bool ascii = (utf8.size() == text.size());
+    if (!ascii) {
+        m_utf8Offsets.resize(text.size() + 1);
+        int bytes = 0;
+        for (int i = 0; i < text.size(); ++i) {
+            m_utf8Offsets[i] = bytes;
+            const QChar ch = text.at(i);
+            if (ch.unicode() < 0x80) {
+                bytes += 1;
+            } else if (ch.unicode() < 0x800) {
+                bytes += 2;
+            } else if (ch.isHighSurrogate() && i + 1 < text.size()
+                       && text.at(i + 1).isLowSurrogate()) {
+                m_utf8Offsets[++i] = bytes;
+                bytes += 4;
+            } else {
+                // Including unpaired surrogates, which become U+FFFD
+                bytes += 3;
+            }
+        }
+        m_utf8Offsets[text.size()] = bytes;
+    }
+
+    int previousEnd = 0;
+    for (const Span &span : m_spans) {
+        const int start = ascii ? span.m_offset : m_utf8Offsets.at(span.m_offset);
+        const int end = ascii ? span.m_offset + span.m_length
+                              : m_utf8Offsets.at(span.m_offset + span.m_length);
+        put_varint(m_buffer, start - previousEnd);
+        put_varint(m_buffer, end - start);
+        put_varint(m_buffer, span.m_id);
+        previousEnd = end;
+    }
+    m_spans.clear();
+
+    if (m_buffer.size() >= FlushSize)
+        flush();
+}
+
+void TokenWriter::flush()
+{
+    if (!m_buffer.isEmpty()) {
+        m_output->write(m_buffer);
+        m_buffer.clear();
+    }
+}
+
+TokenRenderer::TokenRenderer(const KSyntaxHighlighting::Theme &theme,
+                             const EscPalette *palette)
+    : m_theme(theme), m_palette(palette)
+{
+}
+
+static void add_code(QByteArray &fmtStart, const QByteArray &code)
+{
+    if (!code.isEmpty()) {
+        if (!fmtStart.endsWith('['))
+            fmtStart.append(';');
+        fmtStart.append(code);
+    }
+}
+
+QByteArray TokenRenderer::resolveFormat(int style, quint32 flags, QRgb foreground,
+                                        QRgb background) const
+{
+    using KSyntaxHighlighting::Theme;
+    const auto textStyle = static_cast<Theme::TextStyle>(style);
+
+    // Same rules as KSyntaxHighlighting::Format uses for the live output
+    const bool bold = (flags & OverrideBold) ? (flags & Bold) : m_theme.isBold(textStyle);
+    const bool italic = (flags & OverrideItalic) ? (flags & Italic) : m_theme.isItalic(textStyle);
+    const bool underline = (flags & OverrideUnderline) ? (flags & Underline)
+                                                       : m_theme.isUnderline(textStyle);
+    const bool strikeThrough = (flags & OverrideStrikeThrough) ? (flags & StrikeThrough)
+                                                               : m_theme.isStrikeThrough(textStyle);
+    if (!(flags & HasForeground))
+        foreground = m_theme.textColor(textStyle);
+    if (!(flags & HasBackground))
+        background = m_theme.backgroundColor(textStyle);
+    const bool hasForeground = foreground && foreground != m_theme.textColor(Theme::Normal);
+    const bool hasBackground = background && background != m_theme.backgroundColor(Theme::Normal);
+
+    if (!bold && !italic && !underline && !strikeThrough && !hasForeground && !hasBackground)
+        return QByteArray();
+
+    QByteArray fmtStart("\033[");
+    if (bold)
+        add_code(fmtStart, "1");
+    if (italic)
+        add_code(fmtStart, "3");
+    if (underline)
+        add_code(fmtStart, "4");
+    if (strikeThrough)
+        add_code(fmtStart, "9");
+    if (hasBackground)
+        add_code(fmtStart, m_palette->background(QColor::fromRgb(background)));
+    if (hasForeground)
+        add_code(fmtStart, m_palette->foreground(QColor::fromRgb(foreground)));
+    fmtStart.append('m');
+    return fmtStart;
+}
+
+bool TokenRenderer::render(const QByteArray &tokens, QIODevice *output, bool numberLines)
+{
+    m_formats.clear();
+    m_errorString.clear();
+
+    if (tokens.size() < int(sizeof(TokenMagic))
+            || memcmp(tokens.constData(), TokenMagic, sizeof(TokenMagic)) != 0) {
+        m_errorString = QObject::tr("Not a token stream");
+        return false;
+    }
+
+    const uchar *pos = reinterpret_cast<const uchar *>(tokens.constData()) + sizeof(TokenMagic);
+    const uchar *end = reinterpret_cast<const uchar *>(tokens.constData()) + tokens.size();
+
+    // Everything past the highlighter is copying bytes around, so the
+    // output is assembled in a buffer and written in large blocks
+    QByteArray out;
+    out.reserve(FlushSize * 2);
+    int line = 0;
+    bool valid = true;
+
+    while (valid && pos < end) {
+        switch (*pos++) {
+        case 'F':
+            line = 0;
+            break;
+
+        case 'H':
+        {
+            quint32 length;
+            valid = get_varint(pos, end, &length) && length <= quint32(end - pos);
+            if (valid) {
+                out.append("\033[1m==> ");
+                out.append(reinterpret_cast<const char *>(pos), length);
+                out.append(" <==\033[0m\n");
+                pos += length;
+            }
+            break;
+        }
+
+        case 'S':
+        {
+            quint32 id, style, flags;
+            QRgb foreground = 0, background = 0;
+            valid = get_varint(pos, end, &id) && id == quint32(m_formats.size())
+                    && get_varint(pos, end, &style)
+                    && style <= quint32(KSyntaxHighlighting::Theme::Error)
+                    && get_varint(pos, end, &flags)
+                    && (!(flags & HasForeground) || get_rgb(pos, end, &foreground))
+                    && (!(flags & HasBackground) || get_rgb(pos, end, &background));
+            if (valid)
+                m_formats.append(resolveFormat(style, flags, foreground, background));
+            break;
+        }
+
+        case 'L':
+        {
+            quint32 length, count;
+            valid = get_varint(pos, end, &length) && length <= quint32(end - pos);
+            if (!valid)
+                break;
+            const char *text = reinterpret_cast<const char *>(pos);
+            pos += length;
+            valid = get_varint(pos, end, &count);
+
+            if (numberLines) {
+                out.append("\033[7;37m");
+                out.append(QByteArray::number(++line).rightJustified(7));
+                out.append(" \033[0m");
+            }
+
+            quint32 offset = 0;
+            for (quint32 i = 0; valid && i < count; ++i) {
+                quint32 gap, spanLength, id;
+                valid = get_varint(pos, end, &gap) && get_varint(pos, end, &spanLength)
+                        && get_varint(pos, end, &id) && id < quint32(m_formats.size())
+                        && gap <= length - offset && spanLength <= length - offset - gap;
+                if (!valid)
+                    break;
+
+                out.append(text + offset, gap);
+                offset += gap;
+                const QByteArray &fmtStart = m_formats.at(id);
+                if (fmtStart.isEmpty()) {
+                    out.append(text + offset, spanLength);
+                } else {
+                    out.append(fmtStart);
+                    out.append(text + offset, spanLength);
+                    out.append("\033[0m");
+                }
+                offset += spanLength;
+            }
+            if (valid) {
+                out.append(text + offset, length - offset);
+                out.append('\n');
+            }
+            break;
+        }
+
+        default:
+            valid = false;
+            break;
+        }
+
+        if (out.size() >= FlushSize) {
+            output->write(out);
+            out.clear();
+        }
+    }
+
+    output->write(out);
+    if (!valid)
+        m_errorString = QObject::tr("Corrupt or truncated token stream");
+    return valid;
+}
@@ -0,0 +1,104 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TOKEN_STREAM_H
+#define _TOKEN_STREAM_H
+
+#include <KSyntaxHighlighting/Theme>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+namespace KSyntaxHighlighting
+{
+    class Format;
+}
+
+class QIODevice;
+class EscPalette;
+
+/* Records the result of a syntax pass as a compact binary stream, which
+ * TokenRenderer can turn into escape codes for any theme and palette later
+ * without running the highlighter again.
+ *
+ * The stream starts with the "SCT1" magic, followed by records tagged with
+ * a single byte.  Numbers are unsigned LEB128 varints, and text is UTF-8:
+ *   'F'                            start of a file (restarts line numbers)
+ *   'H' length bytes               a header line, as in recursive mode
+ *   'S' id style flags [fg] [bg]   a format, written before its first use
+ *   'L' length bytes count (gap length id)...
+ *                                  one line of text and its formatted spans
+ * Span gaps and lengths are in bytes of the line's UTF-8 text, and each gap
+ * is counted from the end of the previous span.  Formats only store their
+ * theme text style and the attributes the definition overrides, so they
+ * can be resolved against whichever theme is used for rendering. */
+class TokenWriter
+{
+public:
+    explicit TokenWriter(QIODevice *output);
+    ~TokenWriter();
+
+    void addSpan(int offset, int length, const KSyntaxHighlighting::Format &format,
+                 const KSyntaxHighlighting::Theme &theme);
+    void clearSpans() { m_spans.clear(); }
+
+    void beginFile();
+    void writeHeader(const QString &title);
+    void writeLine(const QString &text);
+    void flush();
+
+private:
+    struct Span
+    {
+        int m_offset;
+        int m_length;
+        int m_id;
+    };
+
+    QIODevice *m_output;
+    QByteArray m_buffer;
+    QHash<quint16, int> m_formatIds;
+    QVector<Span> m_spans;
+    QVector<int> m_utf8Offsets;
+
+    int formatId(const KSyntaxHighlighting::Format &format,
+                 const KSyntaxHighlighting::Theme &theme);
+};
+
+class TokenRenderer
+{
+public:
+    TokenRenderer(const KSyntaxHighlighting::Theme &theme, const EscPalette *palette);
+
+    // Returns false if the stream is malformed or truncated
+    bool render(const QByteArray &tokens, QIODevice *output, bool numberLines);
+    QString errorString() const { return m_errorString; }
+
+private:
+    KSyntaxHighlighting::Theme m_theme;
+    const EscPalette *m_palette;
+
+    // The escape sequence starting each format, or empty for plain text
+    QVector<QByteArray> m_formats;
+    QString m_errorString;
+
+    QByteArray resolveFormat(int style, quint32 flags, QRgb foreground,
+                             QRgb background) const;
+};
+
+#endif // _TOKEN_STREAM_H
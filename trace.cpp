@@ -0,0 +1,157 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+
+#include <cstdio>
+
+bool TraceLog::s_enabled = false;
+qint64 TraceLog::s_lineThreshold = -1;
+
+namespace {
+
+struct TraceEvent
+{
+    const char *m_name;
+    const char *m_category;
+    qint64 m_start;
+    qint64 m_duration;
+    int m_thread;
+    QString m_detail;
+};
+
+QElapsedTimer s_clock;
+QMutex s_mutex;
+QVector<TraceEvent> s_events;
+QStringList s_threadNames;
+QString s_filename;
+
+thread_local int t_threadId = -1;
+
+int current_thread_id()
+{
+    // Called with s_mutex held
+    if (t_threadId < 0) {
+        QString name;
+        QThread *thread = QThread::currentThread();
+        if (QCoreApplication::instance()
+                && thread == QCoreApplication::instance()->thread())
+            name = QStringLiteral("main");
+        else if (!thread->objectName().isEmpty())
+            name = thread->objectName();
+        else
+            name = QStringLiteral("worker %1").arg(s_threadNames.size());
+        t_threadId = s_threadNames.size();
+        s_threadNames.append(name);
+    }
+    return t_threadId;
+}
+
+}
+
+void TraceLog::begin()
+{
+    s_clock.start();
+    s_enabled = true;
+}
+
+void TraceLog::setOutput(const QString &filename)
+{
+    QMutexLocker lock(&s_mutex);
+    s_filename = filename;
+}
+
+void TraceLog::discard()
+{
+    s_enabled = false;
+
+    QMutexLocker lock(&s_mutex);
+    s_events.clear();
+}
+
+qint64 TraceLog::now()
+{
+    return s_clock.nsecsElapsed();
+}
+
+void TraceLog::addSpan(const char *name, const char *category, qint64 start,
+                       const QString &detail)
+{
+    if (!s_enabled)
+        return;
+    const qint64 end = now();
+
+    QMutexLocker lock(&s_mutex);
+    s_events.append(TraceEvent{name, category, start, end - start,
+                               current_thread_id(), detail});
+}
+
+bool TraceLog::finish()
+{
+    if (!s_enabled)
+        return true;
+    s_enabled = false;
+
+    QMutexLocker lock(&s_mutex);
+    QJsonArray events;
+    for (int tid = 0; tid < s_threadNames.size(); ++tid) {
+        events.append(QJsonObject{
+            {QStringLiteral("name"), QStringLiteral("thread_name")},
+            {QStringLiteral("ph"), QStringLiteral("M")},
+            {QStringLiteral("pid"), 1},
+            {QStringLiteral("tid"), tid},
+            {QStringLiteral("args"), QJsonObject{
+                {QStringLiteral("name"), s_threadNames.at(tid)},
+            }},
+        });
+    }
+    for (const auto &event : s_events) {
+        QJsonObject json{
+            {QStringLiteral("name"), QString::fromLatin1(event.m_name)},
+            {QStringLiteral("cat"), QString::fromLatin1(event.m_category)},
+            {QStringLiteral("ph"), QStringLiteral("X")},
+            {QStringLiteral("ts"), double(event.m_start) / 1000.0},
+            {QStringLiteral("dur"), double(event.m_duration) / 1000.0},
+            {QStringLiteral("pid"), 1},
+            {QStringLiteral("tid"), event.m_thread},
+        };
+        if (!event.m_detail.isEmpty())
+            json.insert(QStringLiteral("args"), QJsonObject{{QStringLiteral("detail"), event.m_detail}});
+        events.append(json);
+    }
+    s_events.clear();
+
+    QFile out(s_filename);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        fputs(qPrintable(QObject::tr("Could not open %1 for writing\n").arg(s_filename)),
+              stderr);
+        return false;
+    }
+    const QJsonObject root{{QStringLiteral("traceEvents"), events}};
+    out.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return true;
+}
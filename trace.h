@@ -0,0 +1,83 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <QString>
+
+/* Collects timed spans and writes them out as a Chrome trace-event JSON
+ * file, which can be loaded into chrome://tracing or Perfetto.  Each thread
+ * that records a span gets its own track.  When tracing is not enabled,
+ * recording a span costs a single flag check. */
+class TraceLog
+{
+public:
+    // Starts the clock and begins buffering spans, before we know if the
+    // user actually asked for a trace
+    static void begin();
+
+    // Either keep the buffered spans and write them to filename at finish(),
+    // or throw them away and stop recording
+    static void setOutput(const QString &filename);
+    static void discard();
+    static bool finish();
+
+    static bool isEnabled() { return s_enabled; }
+    static qint64 now();
+
+    // Records a span from start until now (does nothing if not enabled)
+    static void addSpan(const char *name, const char *category, qint64 start,
+                        const QString &detail = QString());
+
+    // Per-line spans are only recorded when they exceed this duration
+    static void setLineThreshold(qint64 nsecs) { s_lineThreshold = nsecs; }
+    static void addLineSpan(int line, qint64 start)
+    {
+        if (s_lineThreshold >= 0 && now() - start >= s_lineThreshold)
+            addSpan("line", "line", start, QString::number(line));
+    }
+
+private:
+    static bool s_enabled;
+    static qint64 s_lineThreshold;
+};
+
+class TraceSpan
+{
+public:
+    TraceSpan(const char *name, const char *category,
+              const QString &detail = QString())
+        : m_name(name), m_category(category), m_detail(detail),
+          m_start(TraceLog::isEnabled() ? TraceLog::now() : 0) { }
+
+    ~TraceSpan()
+    {
+        if (TraceLog::isEnabled())
+            TraceLog::addSpan(m_name, m_category, m_start, m_detail);
+    }
+
+private:
+    const char *m_name;
+    const char *m_category;
+    QString m_detail;
+    qint64 m_start;
+
+    Q_DISABLE_COPY(TraceSpan)
+};
+
+#endif // _TRACE_H
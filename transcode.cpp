@@ -0,0 +1,205 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "transcode.h"
+#include "esc_color.h"
+
+#include <QIODevice>
+#include <QObject>
+
+#include <cstring>
+
+// Longer "sequences" are probably just garbage, and get copied as they are
+static const int MaxSequence = 256;
+static const int MaxParams = 32;
+static const qint64 ChunkSize = 1024 * 1024;
+
+SgrTranscoder::SgrTranscoder(const EscPalette *palette)
+    : m_palette(palette), m_rewritten()
+{
+}
+
+const QByteArray &SgrTranscoder::color(bool background, int red, int green, int blue)
+{
+    const quint32 key = (background ? 0x1000000 : 0) | (qRgb(red, green, blue) & 0xffffff);
+    auto iter = m_colors.find(key);
+    if (iter == m_colors.end()) {
+        const QColor color(red, green, blue);
+        iter = m_colors.insert(key, background ? m_palette->background(color)
+                                               : m_palette->foreground(color));
+    }
+    return *iter;
+}
+
+static int param_value(const char *start, const char *end)
+{
+    // An empty parameter means 0
+    int value = 0;
+    for (const char *digit = start; digit < end && value < 100000; ++digit)
+        value = (value * 10) + (*digit - '0');
+    return value;
+}
+
+void SgrTranscoder::rewriteSgr(const char *params, int length, QByteArray &out)
+{
+    // Parameters are split first, since a color spans several of them.
+    // Colon subparameters and anything else unusual are left alone.
+    const char *starts[MaxParams];
+    const char *ends[MaxParams];
+    int count = 0;
+    starts[count] = params;
+    bool plain = true;
+    for (int i = 0; i < length && plain; ++i) {
+        if (params[i] == ';') {
+            ends[count++] = params + i;
+            if (count == MaxParams)
+                plain = false;
+            else
+                starts[count] = params + i + 1;
+        } else if (params[i] < '0' || params[i] > '9') {
+            plain = false;
+        }
+    }
+    if (plain)
+        ends[count++] = params + length;
+
+    if (!plain) {
+        out.append("\033[", 2);
+        out.append(params, length);
+        out.append('m');
+        return;
+    }
+
+    auto value = [&](int index) { return param_value(starts[index], ends[index]); };
+
+    // Parameters are copied as they are, including empty ones (which mean
+    // 0), but a color the palette has no code for is left out along with
+    // its separator.  Otherwise it would become an empty parameter, and
+    // reset everything set before it.
+    const int sequenceStart = out.size();
+    out.append("\033[", 2);
+    bool first = true;
+    auto appendParam = [&](const char *param, int paramLength) {
+        if (!first)
+            out.append(';');
+        out.append(param, paramLength);
+        first = false;
+    };
+    auto copyParams = [&](int firstParam, int lastParam) {
+        appendParam(starts[firstParam], static_cast<int>(ends[lastParam] - starts[firstParam]));
+    };
+
+    for (int i = 0; i < count; ) {
+        const int code = value(i);
+        if ((code == 38 || code == 48) && i + 1 < count) {
+            const int kind = value(i + 1);
+            if (kind == 2 && i + 4 < count) {
+                const QByteArray &replacement = color(code == 48, qMin(value(i + 2), 255),
+                                                      qMin(value(i + 3), 255),
+                                                      qMin(value(i + 4), 255));
+                if (!replacement.isEmpty())
+                    appendParam(replacement.constData(), replacement.size());
+                ++m_rewritten;
+                i += 5;
+                continue;
+            }
+            if (kind == 5 && i + 2 < count) {
+                // An indexed color, which shouldn't be mistaken for codes
+                copyParams(i, i + 2);
+                i += 3;
+                continue;
+            }
+        }
+        copyParams(i, i);
+        ++i;
+    }
+
+    // Nothing left means the sequence only set colors with no code here,
+    // and "\033[m" would be a reset, so it is dropped entirely
+    if (first)
+        out.truncate(sequenceStart);
+    else
+        out.append('m');
+}
+
+qint64 SgrTranscoder::transcodeChunk(const char *data, qint64 size, bool atEnd, QByteArray &out)
+{
+    qint64 pos = 0;
+    while (pos < size) {
+        const void *escape = memchr(data + pos, '\033', size - pos);
+        if (!escape) {
+            out.append(data + pos, static_cast<int>(size - pos));
+            return size;
+        }
+        const qint64 start = static_cast<const char *>(escape) - data;
+        out.append(data + pos, static_cast<int>(start - pos));
+
+        // Parameter and intermediate bytes, then the final byte
+        qint64 end = start + 1;
+        if (end < size && data[end] == '[') {
+            ++end;
+            while (end < size && end - start < MaxSequence && data[end] >= 0x20 && data[end] <= 0x3f)
+                ++end;
+        }
+        if (end >= size && !atEnd && end - start < MaxSequence) {
+            // Finish the sequence with the next chunk
+            return start;
+        }
+        if (end >= size || end == start + 1) {
+            out.append(data + start, static_cast<int>(qMin(end, size) - start));
+            pos = qMin(end, size);
+            continue;
+        }
+
+        if (data[end] == 'm')
+            rewriteSgr(data + start + 2, static_cast<int>(end - start - 2), out);
+        else
+            out.append(data + start, static_cast<int>(end + 1 - start));
+        pos = end + 1;
+    }
+    return size;
+}
+
+bool SgrTranscoder::transcode(QIODevice *in, QIODevice *out)
+{
+    // Anything left over is an escape sequence cut off at the end of the
+    // previous chunk
+    QByteArray buffer;
+    QByteArray output;
+    output.reserve(ChunkSize + ChunkSize / 4);
+    for ( ;; ) {
+        const int carried = buffer.size();
+        buffer.resize(carried + ChunkSize);
+        const qint64 bytes = in->read(buffer.data() + carried, ChunkSize);
+        if (bytes < 0) {
+            m_error = in->errorString();
+            return false;
+        }
+        buffer.resize(carried + static_cast<int>(bytes));
+        const bool atEnd = (bytes == 0);
+
+        output.clear();
+        const qint64 used = transcodeChunk(buffer.constData(), buffer.size(), atEnd, output);
+        buffer.remove(0, static_cast<int>(used));
+        if (!output.isEmpty() && out->write(output) != output.size()) {
+            m_error = out->errorString();
+            return false;
+        }
+        if (atEnd)
+            return true;
+    }
+}
@@ -0,0 +1,54 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TRANSCODE_H
+#define _TRANSCODE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+class QIODevice;
+class EscPalette;
+
+/* Rewrites the truecolor SGR colors ("38;2;R;G;B" and "48;2;R;G;B") in an
+ * already rendered stream for another palette, copying everything else
+ * through unchanged.  This is far cheaper than highlighting again: plain
+ * text is only scanned for escapes with memchr(), and each distinct color
+ * is quantized once and remembered. */
+class SgrTranscoder
+{
+public:
+    explicit SgrTranscoder(const EscPalette *palette);
+
+    bool transcode(QIODevice *in, QIODevice *out);
+    QString errorString() const { return m_error; }
+
+    qint64 rewrittenColors() const { return m_rewritten; }
+
+private:
+    const EscPalette *m_palette;
+    QHash<quint32, QByteArray> m_colors;
+    qint64 m_rewritten;
+    QString m_error;
+
+    const QByteArray &color(bool background, int red, int green, int blue);
+    qint64 transcodeChunk(const char *data, qint64 size, bool atEnd, QByteArray &out);
+    void rewriteSgr(const char *params, int length, QByteArray &out);
+};
+
+#endif // _TRANSCODE_H
@@ -0,0 +1,629 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "viewer.h"
+#include "esc_highlight.h"
+
+#include <QFileInfo>
+
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <limits>
+
+enum Key
+{
+    KeyNone = -1,
+    KeyUp = 0x100,
+    KeyDown,
+    KeyPageUp,
+    KeyPageDown,
+    KeyHome,
+    KeyEnd,
+};
+
+// Like --preview, nothing past the first 64K of a line is worth highlighting
+static const qint64 MaxLineBytes = 64 * 1024;
+
+static const qint64 EndOfFile = std::numeric_limits<qint64>::max() / 2;
+static const qint64 UnknownLine = -1;
+
+Viewer::Viewer(const EscPalette *palette)
+    : m_palette(palette), m_numberLines(), m_data(), m_size(), m_lineCount(),
+      m_scanPos(), m_indexComplete(), m_textColumns(), m_clip(),
+      m_suppressOutput(), m_tty(-1), m_rows(24), m_columns(80), m_top(), m_topOffset()
+{
+    m_checkpoints.insert(0, KSyntaxHighlighting::State());
+}
+
+bool Viewer::open(const QString &filename)
+{
+    m_file.setFileName(filename);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size > 0) {
+        m_data = reinterpret_cast<const char *>(m_file.map(0, m_size));
+        if (!m_data) {
+            m_error = m_file.errorString();
+            return false;
+        }
+    }
+    m_name = QFileInfo(filename).fileName();
+    m_indexComplete = (m_size == 0);
+    return true;
+}
+
+void Viewer::indexTo(qint64 line)
+{
+    // m_scanPos is always the start of line m_lineCount
+    while (!m_indexComplete && m_lineCount <= line) {
+        if (m_lineCount % IndexStride == 0)
+            m_lineIndex.push_back(m_scanPos);
+        ++m_lineCount;
+
+        const void *newline = memchr(m_data + m_scanPos, '\n', m_size - m_scanPos);
+        m_scanPos = newline ? static_cast<const char *>(newline) - m_data + 1 : m_size;
+        if (m_scanPos == m_size)
+            m_indexComplete = true;
+    }
+}
+
+qint64 Viewer::lineStart(qint64 line)
+{
+    indexTo(line);
+    if (line < 0 || line >= m_lineCount)
+        return -1;
+
+    qint64 pos = m_lineIndex[line / IndexStride];
+    for (qint64 skip = line % IndexStride; skip > 0; --skip) {
+        const void *newline = memchr(m_data + pos, '\n', m_size - pos);
+        pos = static_cast<const char *>(newline) - m_data + 1;
+    }
+    return pos;
+}
+
+qint64 Viewer::lineForOffset(qint64 offset)
+{
+    while (!m_indexComplete && m_scanPos <= offset)
+        indexTo(m_lineCount);
+
+    const auto indexed = std::upper_bound(m_lineIndex.begin(), m_lineIndex.end(), offset) - 1;
+    qint64 line = (indexed - m_lineIndex.begin()) * IndexStride;
+    qint64 pos = *indexed;
+    while (const void *newline = memchr(m_data + pos, '\n', offset - pos)) {
+        pos = static_cast<const char *>(newline) - m_data + 1;
+        ++line;
+    }
+    return line;
+}
+
+qint64 Viewer::nextLine(qint64 offset) const
+{
+    const void *newline = memchr(m_data + offset, '\n', m_size - offset);
+    return newline ? static_cast<const char *>(newline) - m_data + 1 : m_size;
+}
+
+qint64 Viewer::backLines(qint64 offset, qint64 lines) const
+{
+    // Like tail_start() for --tail: offset is the start of a line or the end
+    // of the file, so the byte before it belongs to the previous line
+    qint64 pos = offset;
+    for ( ; lines > 0 && pos > 0; --lines) {
+        --pos;
+        while (pos > 0 && m_data[pos - 1] != '\n')
+            --pos;
+    }
+    return pos;
+}
+
+QString Viewer::lineTextAt(qint64 start) const
+{
+    if (start >= m_size)
+        return QString();
+
+    const void *newline = memchr(m_data + start, '\n', m_size - start);
+    qint64 length = newline ? static_cast<const char *>(newline) - (m_data + start)
+                            : m_size - start;
+    if (length > 0 && m_data[start + length - 1] == '\r')
+        --length;
+    return QString::fromUtf8(m_data + start, static_cast<int>(qMin(length, MaxLineBytes)));
+}
+
+void Viewer::applyFormat(int offset, int length, const KSyntaxHighlighting::Format &format)
+{
+    if (m_suppressOutput || length == 0 || offset >= m_clip)
+        return;
+    EscCodeHighlighter::formatSpan(m_rendered, m_line, offset, qMin(length, m_clip - offset),
+                                   format, theme(), m_palette);
+}
+
+KSyntaxHighlighting::State Viewer::stateAt(qint64 line)
+{
+    // There is always a checkpoint for the first line
+    auto checkpoint = m_checkpoints.upperBound(line);
+    --checkpoint;
+    qint64 from = checkpoint.key();
+    KSyntaxHighlighting::State state = checkpoint.value();
+
+    // The settle point is aligned to the checkpoints, so the same line
+    // always gets the same highlighting however it was reached
+    const qint64 settleFrom = ((line - SettleLines) / CheckpointLines) * CheckpointLines;
+    if (line - from > SettleLines && settleFrom > from) {
+        from = settleFrom;
+        state = KSyntaxHighlighting::State();
+        m_checkpoints.insert(from, state);
+    }
+
+    m_suppressOutput = true;
+    qint64 pos = lineStart(from);
+    for (qint64 skip = from; skip < line; ++skip) {
+        m_line = lineTextAt(pos);
+        pos = nextLine(pos);
+        state = highlightLine(m_line, state);
+        if ((skip + 1) % CheckpointLines == 0)
+            m_checkpoints.insert(skip + 1, state);
+    }
+    m_suppressOutput = false;
+    return state;
+}
+
+KSyntaxHighlighting::State Viewer::stateAtOffset(qint64 offset)
+{
+    // Scrolling down only needs the state the line above ended with
+    if (offset > 0) {
+        const auto above = m_renderCache.constFind(backLines(offset, 1));
+        if (above != m_renderCache.constEnd())
+            return above->m_nextState;
+    }
+
+    // Otherwise continue from a checkpoint, unless the closest one is more
+    // than SettleLines back; then start over from the default state that
+    // far back, the same way --tail does
+    qint64 from = -1;
+    KSyntaxHighlighting::State state;
+    auto checkpoint = m_offsetCheckpoints.upperBound(offset);
+    if (checkpoint != m_offsetCheckpoints.begin()) {
+        --checkpoint;
+        qint64 pos = checkpoint.key();
+        int lines = 0;
+        while (pos < offset && lines <= SettleLines) {
+            pos = nextLine(pos);
+            ++lines;
+        }
+        if (lines <= SettleLines) {
+            from = checkpoint.key();
+            state = checkpoint.value();
+        }
+    }
+    if (from < 0) {
+        from = backLines(offset, SettleLines);
+        m_offsetCheckpoints.insert(from, state);
+    }
+
+    m_suppressOutput = true;
+    int lines = 0;
+    for (qint64 pos = from; pos < offset; ) {
+        m_line = lineTextAt(pos);
+        pos = nextLine(pos);
+        state = highlightLine(m_line, state);
+        if (++lines % CheckpointLines == 0)
+            m_offsetCheckpoints.insert(pos, state);
+    }
+    m_suppressOutput = false;
+    return state;
+}
+
+KSyntaxHighlighting::State Viewer::renderLine(qint64 line, qint64 offset,
+        const KSyntaxHighlighting::State &state)
+{
+    m_line = lineTextAt(offset);
+    m_clip = EscCodeHighlighter::clipColumns(m_line, m_textColumns);
+    m_rendered.clear();
+
+    const auto nextState = highlightLine(m_line, state);
+    if (line != UnknownLine && (line + 1) % CheckpointLines == 0)
+        m_checkpoints.insert(line + 1, nextState);
+    return nextState;
+}
+
+void Viewer::scrollTo(qint64 top)
+{
+    // Stopping at the last full page only needs the index to reach one
+    // page past the new top, not the end of the file
+    indexTo(top + pageRows());
+    if (m_indexComplete)
+        top = qMin(top, m_lineCount - pageRows());
+    m_top = qMax<qint64>(0, top);
+    m_topOffset = qMax<qint64>(0, lineStart(m_top));
+}
+
+void Viewer::scrollBy(qint64 lines)
+{
+    if (m_top != UnknownLine) {
+        scrollTo(m_top + lines);
+        return;
+    }
+
+    qint64 offset = m_topOffset;
+    if (lines < 0) {
+        offset = backLines(offset, -lines);
+    } else {
+        const qint64 last = lastPage();
+        for ( ; lines > 0 && offset < last; --lines)
+            offset = nextLine(offset);
+    }
+    moveTo(offset);
+}
+
+void Viewer::moveTo(qint64 offset)
+{
+    // The line number is only looked up if the index already covers it
+    m_topOffset = qMin(offset, lastPage());
+    if (m_topOffset < m_scanPos)
+        m_top = lineForOffset(m_topOffset);
+    else
+        m_top = UnknownLine;
+}
+
+static void write_all(const QByteArray &data)
+{
+    const char *buffer = data.constData();
+    qint64 left = data.size();
+    while (left > 0) {
+        const ssize_t bytes = ::write(STDOUT_FILENO, buffer, left);
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        buffer += bytes;
+        left -= bytes;
+    }
+}
+
+void Viewer::updateSize()
+{
+    winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) < 0 || size.ws_row == 0 || size.ws_col == 0)
+        return;
+    if (size.ws_row != m_rows || size.ws_col != m_columns) {
+        m_rows = size.ws_row;
+        m_columns = size.ws_col;
+        m_renderCache.clear();
+        scrollBy(0);
+    }
+}
+
+void Viewer::draw()
+{
+    const int rows = pageRows();
+    m_textColumns = qMax(1, m_columns - (m_numberLines ? 8 : 0));
+
+    // Only keep a few pages around the current one
+    if (m_renderCache.size() > rows * 4) {
+        const qint64 keepFrom = backLines(m_topOffset, rows);
+        qint64 keepTo = m_topOffset;
+        for (int row = 0; row < rows * 2 && keepTo < m_size; ++row)
+            keepTo = nextLine(keepTo);
+        for (auto it = m_renderCache.begin(); it != m_renderCache.end(); ) {
+            if (it.key() < keepFrom || it.key() > keepTo)
+                it = m_renderCache.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    QByteArray frame("\033[H");
+    KSyntaxHighlighting::State state;
+    bool haveState = false;
+    qint64 offset = m_topOffset;
+    int shown = 0;
+    for (int row = 0; row < rows; ++row) {
+        if (offset >= m_size) {
+            frame += "~\033[K\r\n";
+            continue;
+        }
+
+        const qint64 line = (m_top != UnknownLine) ? m_top + row : UnknownLine;
+        auto cached = m_renderCache.constFind(offset);
+        if (cached == m_renderCache.constEnd()) {
+            if (!haveState)
+                state = (line != UnknownLine) ? stateAt(line) : stateAtOffset(offset);
+            state = renderLine(line, offset, state);
+            cached = m_renderCache.insert(offset, RenderedLine{m_rendered, state});
+        } else {
+            state = cached->m_nextState;
+        }
+        haveState = true;
+        if (m_numberLines) {
+            frame += "\033[7;37m";
+            frame += (line != UnknownLine ? QByteArray::number(line + 1)
+                                          : QByteArray("?")).rightJustified(7);
+            frame += " \033[0m";
+        }
+        frame += cached->m_text.toUtf8();
+        frame += "\033[K\r\n";
+        offset = nextLine(offset);
+        ++shown;
+    }
+
+    QString status = m_message;
+    m_message.clear();
+    if (status.isEmpty()) {
+        const bool known = (m_top != UnknownLine);
+        status = QObject::tr("%1  lines %2-%3/%4  %5%")
+                 .arg(m_name)
+                 .arg(known ? QString::number(m_top + 1) : QStringLiteral("?"))
+                 .arg(known ? QString::number(m_top + shown) : QStringLiteral("?"))
+                 .arg(m_indexComplete ? QString::number(m_lineCount) : QStringLiteral("?"))
+                 .arg(m_size > 0 ? offset * 100 / m_size : 100);
+    }
+    frame += "\033[7m";
+    frame += status.left(m_columns).toUtf8();
+    frame += "\033[0m\033[K";
+    write_all(frame);
+}
+
+int Viewer::readKey()
+{
+    unsigned char ch;
+    const ssize_t bytes = ::read(m_tty, &ch, 1);
+    if (bytes < 0 && errno == EINTR)
+        return KeyNone;     // Probably a resize, so just redraw
+    if (bytes <= 0)
+        return 'q';
+    if (ch != '\033')
+        return ch;
+
+    // The rest of an escape sequence arrives right away, but a lone Escape
+    // key press doesn't have anything after it
+    char seq[8];
+    int length = 0;
+    pollfd pfd = { m_tty, POLLIN, 0 };
+    while (length < int(sizeof(seq)) && poll(&pfd, 1, 30) > 0) {
+        if (::read(m_tty, seq + length, 1) != 1)
+            break;
+        const char last = seq[length++];
+        if (length >= 2 && ((last >= 'A' && last <= 'Z') || last == '~'))
+            break;
+    }
+    if (length == 0)
+        return '\033';
+
+    const QByteArray code(seq, length);
+    if (code == "[A" || code == "OA")
+        return KeyUp;
+    if (code == "[B" || code == "OB")
+        return KeyDown;
+    if (code == "[5~")
+        return KeyPageUp;
+    if (code == "[6~")
+        return KeyPageDown;
+    if (code == "[H" || code == "OH" || code == "[1~")
+        return KeyHome;
+    if (code == "[F" || code == "OF" || code == "[4~")
+        return KeyEnd;
+    return KeyNone;
+}
+
+QByteArray Viewer::readPattern()
+{
+    QByteArray pattern;
+    write_all("\033[?25h");
+    for ( ;; ) {
+        write_all("\033[" + QByteArray::number(m_rows) + ";1H/" + pattern + "\033[K");
+        const int key = readKey();
+        if (key == '\r' || key == '\n')
+            break;
+        if (key == '\033' || key == 3) {
+            pattern.clear();
+            break;
+        }
+        if (key == 127 || key == 8) {
+            // Drop a whole UTF-8 character
+            while (!pattern.isEmpty() && (pattern.at(pattern.size() - 1) & 0xC0) == 0x80)
+                pattern.chop(1);
+            pattern.chop(1);
+        } else if (key >= 0x20 && key < 0x100 && key != 127) {
+            pattern.append(static_cast<char>(key));
+        }
+    }
+    write_all("\033[?25l");
+    return pattern;
+}
+
+// The last match starting before end, searching back in blocks
+static qint64 find_last(const char *data, qint64 size, qint64 end, const QByteArray &pattern)
+{
+    static const qint64 BlockSize = 256 * 1024;
+    while (end > 0) {
+        const qint64 start = qMax<qint64>(0, end - BlockSize);
+        const qint64 limit = qMin(size, end + pattern.size() - 1);
+        qint64 found = -1;
+        qint64 pos = start;
+        while (const void *match = memmem(data + pos, limit - pos,
+                                          pattern.constData(), pattern.size())) {
+            const qint64 offset = static_cast<const char *>(match) - data;
+            if (offset >= end)
+                break;
+            found = offset;
+            pos = offset + 1;
+        }
+        if (found >= 0)
+            return found;
+        end = start;
+    }
+    return -1;
+}
+
+void Viewer::search(bool forward)
+{
+    if (m_pattern.isEmpty()) {
+        m_message = QObject::tr("No previous search");
+        return;
+    }
+
+    // Searching the mapped file directly means matching the plain text, and
+    // only indexing lines up to the match
+    qint64 found = -1;
+    if (forward) {
+        // Matches on the top line have already been seen
+        const qint64 from = (m_topOffset < m_size) ? nextLine(m_topOffset) : m_size;
+        if (from < m_size) {
+            const void *match = memmem(m_data + from, m_size - from,
+                                       m_pattern.constData(), m_pattern.size());
+            if (match)
+                found = static_cast<const char *>(match) - m_data;
+        }
+    } else if (m_data) {
+        found = find_last(m_data, m_size, m_topOffset, m_pattern);
+    }
+
+    if (found < 0) {
+        m_message = QObject::tr("Pattern not found: %1").arg(QString::fromUtf8(m_pattern));
+        return;
+    }
+
+    // Past the end of the index, the match is shown without a line number
+    // rather than indexing everything up to it
+    if (m_top != UnknownLine)
+        scrollTo(lineForOffset(found));
+    else
+        moveTo(backLines(nextLine(found), 1));
+}
+
+static void on_resize(int)
+{
+    // Nothing to do here; interrupting read() is enough to redraw
+}
+
+bool Viewer::exec()
+{
+    m_tty = ::open("/dev/tty", O_RDWR);
+    termios savedTerm;
+    if (m_tty < 0 || tcgetattr(m_tty, &savedTerm) < 0) {
+        m_error = QObject::tr("Could not open the terminal");
+        if (m_tty >= 0)
+            ::close(m_tty);
+        return false;
+    }
+
+    // Ctrl+C is read as a key, so the terminal always gets restored
+    termios rawTerm = savedTerm;
+    rawTerm.c_lflag &= ~(ICANON | ECHO | ISIG);
+    rawTerm.c_cc[VMIN] = 1;
+    rawTerm.c_cc[VTIME] = 0;
+    tcsetattr(m_tty, TCSAFLUSH, &rawTerm);
+
+    struct sigaction resizeAction, savedAction;
+    memset(&resizeAction, 0, sizeof(resizeAction));
+    resizeAction.sa_handler = on_resize;
+    sigemptyset(&resizeAction.sa_mask);
+    sigaction(SIGWINCH, &resizeAction, &savedAction);
+
+    write_all("\033[?1049h\033[?25l");
+    updateSize();
+
+    bool quit = false;
+    while (!quit) {
+        draw();
+        const int key = readKey();
+        updateSize();
+
+        switch (key) {
+        case 'q':
+        case 'Q':
+        case 3:
+            quit = true;
+            break;
+        case 'j':
+        case '\r':
+        case '\n':
+        case KeyDown:
+            scrollBy(1);
+            break;
+        case 'k':
+        case KeyUp:
+            scrollBy(-1);
+            break;
+        case ' ':
+        case 'f':
+        case KeyPageDown:
+            scrollBy(pageRows());
+            break;
+        case 'b':
+        case KeyPageUp:
+            scrollBy(-pageRows());
+            break;
+        case 'd':
+            scrollBy(pageRows() / 2);
+            break;
+        case 'u':
+            scrollBy(-pageRows() / 2);
+            break;
+        case 'g':
+        case '<':
+        case KeyHome:
+            scrollTo(0);
+            break;
+        case 'G':
+        case '>':
+        case KeyEnd:
+            if (m_size - m_scanPos <= QuickIndexBytes)
+                indexTo(EndOfFile);
+            if (m_indexComplete)
+                scrollTo(m_lineCount);
+            else
+                moveTo(lastPage());
+            break;
+        case '/':
+            {
+                const QByteArray pattern = readPattern();
+                if (!pattern.isEmpty()) {
+                    m_pattern = pattern;
+                    search(true);
+                }
+            }
+            break;
+        case 'n':
+            search(true);
+            break;
+        case 'N':
+            search(false);
+            break;
+        default:
+            break;
+        }
+    }
+
+    write_all("\033[?25h\033[?1049l");
+    sigaction(SIGWINCH, &savedAction, Q_NULLPTR);
+    tcsetattr(m_tty, TCSAFLUSH, &savedTerm);
+    ::close(m_tty);
+    m_tty = -1;
+    return true;
+}
@@ -0,0 +1,141 @@
+/* This file is part of srccat.
+ * Copyright (c) 2017 Michael Hansen
+ *
+ * srccat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * srccat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with srccat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VIEWER_H
+#define _VIEWER_H
+
+#include <KSyntaxHighlighting/AbstractHighlighter>
+#include <KSyntaxHighlighting/State>
+
+#include <QFile>
+#include <QHash>
+#include <QMap>
+
+#include <vector>
+
+class EscPalette;
+
+/* The built-in pager for --view.  Instead of highlighting the whole file up
+ * front for less, only the lines on screen are highlighted: line offsets
+ * are indexed only as far as needed, and the highlighter state is saved
+ * every CheckpointLines lines.  Showing a line means highlighting again
+ * the lines since the checkpoint before it, or after a long jump, up to
+ * SettleLines + CheckpointLines lines from the default state.  Searches
+ * match the plain text.
+ *
+ * Jumping to the end seeks there by byte offset instead of indexing the
+ * whole file, the same way --tail does.  Line numbers past the index show
+ * as unknown until moving back towards the start reaches them. */
+class Viewer : public KSyntaxHighlighting::AbstractHighlighter
+{
+public:
+    explicit Viewer(const EscPalette *palette);
+
+    // The file is mapped rather than read, so it has to be a regular file
+    bool open(const QString &filename);
+    QString errorString() const { return m_error; }
+
+    void setNumberLines(bool numberLines) { m_numberLines = numberLines; }
+
+    // Runs until the user quits; returns false if there is no terminal
+    bool exec();
+
+    enum
+    {
+        CheckpointLines = 64,
+        IndexStride = 16,
+
+        // Jumping further than this past the last checkpoint starts over
+        // from the default state, the same way --tail does.  The restart
+        // is aligned down to a checkpoint, so it can be up to
+        // CheckpointLines - 1 lines further back.
+        SettleLines = 512,
+
+        // Jumping to the end just indexes the rest of the file when there
+        // is no more than this left to scan
+        QuickIndexBytes = 1024 * 1024,
+    };
+
+protected:
+    void applyFormat(int offset, int length, const KSyntaxHighlighting::Format &format) Q_DECL_OVERRIDE;
+
+private:
+    const EscPalette *m_palette;
+    QString m_error;
+    QString m_name;
+    bool m_numberLines;
+
+    QFile m_file;
+    const char *m_data;
+    qint64 m_size;
+
+    // The start of every IndexStride'th line, as far as it has been scanned
+    std::vector<qint64> m_lineIndex;
+    qint64 m_lineCount;
+    qint64 m_scanPos;
+    bool m_indexComplete;
+
+    QMap<qint64, KSyntaxHighlighting::State> m_checkpoints;
+    // Checkpoints by line start, for lines whose number isn't known yet
+    QMap<qint64, KSyntaxHighlighting::State> m_offsetCheckpoints;
+    struct RenderedLine
+    {
+        QString m_text;
+        KSyntaxHighlighting::State m_nextState;
+    };
+    // By line start, so it stays valid once the line numbers are known
+    QHash<qint64, RenderedLine> m_renderCache;
+    QString m_line;
+    QString m_rendered;
+    int m_textColumns;
+    int m_clip;
+    bool m_suppressOutput;
+
+    int m_tty;
+    int m_rows;
+    int m_columns;
+    qint64 m_top;           // UnknownLine if not indexed that far yet
+    qint64 m_topOffset;
+    QByteArray m_pattern;
+    QString m_message;
+
+    void indexTo(qint64 line);
+    qint64 lineStart(qint64 line);
+    qint64 lineForOffset(qint64 offset);
+    qint64 nextLine(qint64 offset) const;
+    qint64 backLines(qint64 offset, qint64 lines) const;
+    qint64 lastPage() const { return backLines(m_size, pageRows()); }
+    QString lineTextAt(qint64 offset) const;
+
+    KSyntaxHighlighting::State stateAt(qint64 line);
+    KSyntaxHighlighting::State stateAtOffset(qint64 offset);
+    KSyntaxHighlighting::State renderLine(qint64 line, qint64 offset,
+                                          const KSyntaxHighlighting::State &state);
+
+    int pageRows() const { return qMax(1, m_rows - 1); }
+    void scrollTo(qint64 top);
+    void scrollBy(qint64 lines);
+    void moveTo(qint64 offset);
+    void updateSize();
+
+    void draw();
+    int readKey();
+    QByteArray readPattern();
+    void search(bool forward);
+};
+
+#endif // _VIEWER_H